@@ -17,16 +17,43 @@ CREATE TABLE IF NOT EXISTS task_queue (
     status TEXT NOT NULL DEFAULT 'ready' CHECK (status IN ('ready', 'stopped', 'running', 'complete', 'error')),
     is_complete INTEGER DEFAULT 0,
     meta_data TEXT NOT NULL CHECK (json_valid(meta_data)),
+    -- meta_data.body is the request body as a JSON string; its keys are
+    -- promoted so status polls filter on plain columns
+    sk TEXT GENERATED ALWAYS AS (json_extract(json_extract(meta_data, '$.body'), '$.sk')) STORED,
+    pk TEXT GENERATED ALWAYS AS (json_extract(json_extract(meta_data, '$.body'), '$.pk')) STORED,
+    -- outgoing invocation drained by dispatcher.zig; cleared once sent
+    dispatch_target TEXT,
+    dispatch_payload TEXT,
+    complete_on_send INTEGER DEFAULT 0,
+    attempts INTEGER DEFAULT 0,
+    not_before INTEGER DEFAULT 0, -- unix seconds: retry backoff or in-flight lease
     created_at DATETIME DEFAULT (datetime('now', 'utc')),
-    updated_at DATETIME DEFAULT (datetime('now', 'utc'))
+    updated_at DATETIME DEFAULT (datetime('now', 'utc')) -- set by the UPDATEs in tasks.zig
 );
+DROP TRIGGER IF EXISTS task_queue_updated_at;
+CREATE INDEX IF NOT EXISTS task_queue_token ON task_queue (token);
+-- only unfinished tasks are polled, so the indexes leave finished ones out
+CREATE INDEX IF NOT EXISTS task_queue_active ON task_queue (user_email, task, updated_at) WHERE is_complete = 0;
+CREATE INDEX IF NOT EXISTS task_queue_active_reference ON task_queue (reference) WHERE is_complete = 0;
+CREATE INDEX IF NOT EXISTS task_queue_dispatch ON task_queue (not_before) WHERE status = 'ready' AND dispatch_payload IS NOT NULL;
 
-CREATE TRIGGER IF NOT EXISTS task_queue_updated_at
-AFTER UPDATE ON task_queue 
-FOR EACH ROW
-BEGIN
-    UPDATE task_queue SET updated_at = datetime('now', 'utc') WHERE id = OLD.id;
-END; 
+-- finished tasks moved out of task_queue by tasks.archiveFinished
+CREATE TABLE IF NOT EXISTS task_queue_archive (
+    id INTEGER PRIMARY KEY,
+    task TEXT NOT NULL,
+    step INTEGER,
+    reference TEXT,
+    token TEXT NOT NULL,
+    user_email TEXT NOT NULL,
+    status TEXT NOT NULL,
+    is_complete INTEGER,
+    meta_data TEXT NOT NULL,
+    sk TEXT,
+    pk TEXT,
+    created_at DATETIME,
+    updated_at DATETIME,
+    archived_at DATETIME DEFAULT (datetime('now', 'utc'))
+);
 
 CREATE TABLE IF NOT EXISTS chats (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -39,23 +66,55 @@ CREATE TABLE IF NOT EXISTS chats (
 
 
 
-CREATE TABLE IF NOT EXISTS fetch_cache (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
+-- fetch_cache holds disposable response caches, so it is rebuilt rather
+-- than migrated. Rows carry their own expiry; readers filter on it through
+-- fetch_cache_live and the server's sweeper deletes expired rows in batches.
+DROP TRIGGER IF EXISTS fetch_cache_updated_at;
+DROP TABLE IF EXISTS fetch_cache;
+CREATE TABLE fetch_cache (
+    id INTEGER PRIMARY KEY,
     data_type TEXT NOT NULL,
     name TEXT NOT NULL,
     user_email TEXT NOT NULL,
-
-    data TEXT DEFAULT '{}',
-    created_at DATETIME DEFAULT (datetime('now', 'utc')),
-    updated_at DATETIME DEFAULT (datetime('now', 'utc')),
-    UNIQUE(name, user_email, data_type)
+    expires_at INTEGER NOT NULL, -- unix seconds
+    data BLOB NOT NULL,
+    UNIQUE(user_email, data_type, name)
 );
-CREATE TRIGGER IF NOT EXISTS fetch_cache_updated_at
-AFTER UPDATE ON fetch_cache
-FOR EACH ROW
-BEGIN
-    UPDATE fetch_cache SET updated_at = datetime('now', 'utc') WHERE id = OLD.id;
-END; 
-
+-- lookups resolve the key and the expiry check from the index alone
+CREATE INDEX fetch_cache_live ON fetch_cache (data_type, name, expires_at);
+CREATE INDEX fetch_cache_expiry ON fetch_cache (expires_at);
 
+-- Whole-list caches for GET /submissions and GET /assignments, one row per
+-- item so writes can patch a cached list in place. A list is served while
+-- its list_cache_lists row is unexpired; version counts the patches so a
+-- fill that raced one is dropped. Disposable, rebuilt like fetch_cache.
+DROP TABLE IF EXISTS list_cache;
+DROP TABLE IF EXISTS list_cache_lists;
+CREATE TABLE list_cache_lists (
+    user_email TEXT NOT NULL,
+    list TEXT NOT NULL,
+    expires_at INTEGER NOT NULL, -- unix seconds
+    version INTEGER NOT NULL DEFAULT 0,
+    PRIMARY KEY (user_email, list)
+) WITHOUT ROWID;
+CREATE TABLE list_cache (
+    user_email TEXT NOT NULL,
+    list TEXT NOT NULL,
+    sk TEXT NOT NULL,
+    pos INTEGER NOT NULL, -- order the list query returned, new items last
+    item BLOB NOT NULL,
+    PRIMARY KEY (user_email, list, sk)
+) WITHOUT ROWID;
 
+-- Latest change per submission and owner, read by GET /submissions?since=.
+-- changed_at is ISO 8601 in one fixed format (2024-01-15T10:30:00.000Z) so
+-- it orders as text. Rows past the retention window are pruned hourly.
+CREATE TABLE IF NOT EXISTS submission_changes (
+    user_email TEXT NOT NULL,
+    pk TEXT NOT NULL,
+    sk TEXT NOT NULL,
+    deleted INTEGER NOT NULL DEFAULT 0,
+    changed_at TEXT NOT NULL,
+    PRIMARY KEY (user_email, pk, sk)
+) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS submission_changes_since ON submission_changes (user_email, changed_at);
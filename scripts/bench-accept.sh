@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+# Compares accept throughput and p99 latency of the shared listening socket
+# against per-worker SO_REUSEPORT listeners. Every request opens a fresh
+# connection so the accept path dominates. The load is CORS preflights,
+# OPTIONS /submissions: a real route the router answers itself, with no auth
+# and no SQLite or DynamoDB work behind it.
+#
+# The output is a markdown table for the "Accept benchmark" section of
+# ZOI.md.
+#
+# usage: scripts/bench-accept.sh [duration] [connections]
+# requires: wrk, a built server (zig build -Doptimize=ReleaseFast)
+set -e
+
+DURATION="${1:-15s}"
+CONNECTIONS="${2:-256}"
+PORT=18081
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BIN="$ROOT/zig-out/bin/server"
+WORKDIR="$(mktemp -d)"
+SERVER_PID=
+trap 'kill $SERVER_PID 2>/dev/null || true; rm -rf "$WORKDIR"' EXIT
+
+if [ ! -x "$BIN" ]; then
+    echo "server binary not found, run: zig build -Doptimize=ReleaseFast" >&2
+    exit 1
+fi
+
+cat > "$WORKDIR/preflight.lua" <<'LUA'
+wrk.method = "OPTIONS"
+wrk.headers["Connection"] = "close"
+LUA
+
+run_mode() {
+    mode="$1"
+    reuse="$2"
+    cat > "$WORKDIR/config.json" <<CONF
+{
+    "address": "127.0.0.1",
+    "port": "$PORT",
+    "workers": 3,
+    "reusePort": $reuse
+}
+CONF
+    (cd "$WORKDIR" && JWT_SECRET=bench "$BIN" > /dev/null 2>&1) &
+    SERVER_PID=$!
+    sleep 1
+
+    out=$(wrk -t4 -c"$CONNECTIONS" -d"$DURATION" --latency -s "$WORKDIR/preflight.lua" "http://127.0.0.1:$PORT/submissions")
+    rps=$(echo "$out" | awk '/Requests\/sec/ {print $2}')
+    p99=$(echo "$out" | awk '$1 == "99%" {print $2}')
+    printf "| %s | %s | %s |\n" "$mode" "$rps" "$p99"
+    if echo "$out" | grep -q "Non-2xx"; then
+        echo "$mode: some responses were not 2xx, the numbers are not comparable" >&2
+        echo "$out" | grep "Non-2xx" >&2
+    fi
+
+    kill $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null || true
+    sleep 1
+}
+
+echo "accept benchmark: $CONNECTIONS connections for $DURATION, Connection: close"
+echo "host: $(uname -sr), $(nproc 2>/dev/null || sysctl -n hw.ncpu) CPUs, 3 workers"
+echo
+echo "| mode | req/s | p99 |"
+echo "|------|-------|-----|"
+run_mode shared false
+run_mode reuseport true
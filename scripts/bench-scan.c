@@ -0,0 +1,136 @@
+/*
+ * Decodes Query pages of submission-sized items with each scanning kernel
+ * set in dynamo.c and reports throughput against the scalar kernels.
+ * Items mirror production submissions: several KB of text plus rationale
+ * and feedback strings, with the escapes real essays contain.
+ *
+ * usage: cc -O2 -std=gnu11 -Isrc scripts/bench-scan.c -lcurl -lpthread \
+ *            -o /tmp/bench-scan && /tmp/bench-scan [pages]
+ */
+#include "../src/dynamo.c"
+
+#define ITEMS_PER_PAGE 25
+
+static const char *words[] = {
+    "the",      "argument", "evidence", "however,", "students", "analysis",
+    "paragraph", "claim",   "support",  "which",    "\\\"quoted\\\"", "a",
+    "thesis",   "because",  "sources",  "and",      "of",       "clearly",
+};
+
+/* appends about n bytes of essay-like prose, newlines escaped */
+static void prose(Buf *b, size_t n) {
+    size_t start = b->n;
+    while (b->n - start < n) {
+        b_str(b, words[rand() % (sizeof(words) / sizeof(*words))]);
+        b_str(b, rand() % 40 ? " " : ".\\n\\n");
+    }
+}
+
+static void grade_item(Buf *b, const char *name, size_t rationale) {
+    b_fmt(b, "{\"M\":{\"name\":{\"S\":\"%s\"},\"score\":{\"N\":\"%d\"},"
+             "\"points\":{\"N\":\"10\"},\"rationale\":{\"S\":\"",
+          name, rand() % 100);
+    prose(b, rationale);
+    b_str(b, "\"},\"metaData\":{\"M\":{\"feedbackOnly\":{\"BOOL\":false}}}}}");
+}
+
+static char *make_page(void) {
+    Buf b = {0};
+    b_str(&b, "{\"Count\":25,\"Items\":[");
+    for (int i = 0; i < ITEMS_PER_PAGE; i++) {
+        if (i)
+            b_chr(&b, ',');
+        b_fmt(&b,
+              "{\"pk\":{\"S\":\"SUBMISSION#a%d\"},\"sk\":{\"S\":\"SUBMISSION#s%d\"},"
+              "\"DATATYPE\":{\"S\":\"SUBMISSION\"},\"status\":{\"S\":\"graded\"},"
+              "\"severity\":{\"N\":\"2.5\"},\"isStarred\":{\"BOOL\":true},"
+              "\"text\":{\"S\":\"",
+              i, i);
+        prose(&b, 4096 + rand() % 8192);
+        b_str(&b, "\"},\"overallFeedback\":");
+        grade_item(&b, "overall", 1500);
+        b_str(&b, ",\"criteria\":{\"L\":[");
+        for (int k = 0; k < 5; k++) {
+            if (k)
+                b_chr(&b, ',');
+            grade_item(&b, "criterion", 600);
+        }
+        b_str(&b, "]}}");
+    }
+    b_str(&b, "],\"ScannedCount\":25,\"LastEvaluatedKey\":"
+              "{\"pk\":{\"S\":\"SUBMISSION#a24\"},\"sk\":{\"S\":\"SUBMISSION#s24\"}}}");
+    return b.b;
+}
+
+static double now_ms(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/* decodes the page `pages` times; returns ms and the first decode's bytes */
+static double run(const char *page, int pages, Buf *first) {
+    double t0 = now_ms();
+    for (int r = 0; r < pages; r++) {
+        ItemSink sink = {0};
+        char *last_key = NULL;
+        decode_query_page(page, &sink, &last_key);
+        if (r == 0 && first)
+            b_write(first, sink.data.b, sink.data.n);
+        item_sink_free(&sink);
+        free(last_key);
+    }
+    return now_ms() - t0;
+}
+
+int main(int argc, char **argv) {
+    int pages = argc > 1 ? atoi(argv[1]) : 200;
+    srand(42);
+    char *page = make_page();
+    double mb = (double)strlen(page) * pages / (1024.0 * 1024.0);
+
+    const ScanKernels *sets[] = {
+        &scan_scalar,
+#if defined(SCAN_X86)
+        &scan_sse2,
+        &scan_avx2,
+#elif defined(SCAN_NEON)
+        &scan_neon,
+#endif
+    };
+    size_t nsets = sizeof(sets) / sizeof(*sets);
+    const ScanKernels *best = scan;
+
+    printf("page %.1f KB, %d pages, auto-selected %s\n",
+           strlen(page) / 1024.0, pages, best->name);
+
+    Buf reference = {0};
+    double scalar_ms = 0;
+    for (size_t k = 0; k < nsets; k++) {
+#if defined(SCAN_X86)
+        if (sets[k] == &scan_avx2 && !__builtin_cpu_supports("avx2"))
+            continue;
+#endif
+        scan = sets[k];
+        Buf out = {0};
+        run(page, pages / 10 + 1, NULL); /* warm caches */
+        double ms = run(page, pages, &out);
+        if (k == 0) {
+            scalar_ms = ms;
+            reference = out;
+        } else {
+            if (out.n != reference.n || memcmp(out.b, reference.b, out.n)) {
+                fprintf(stderr, "%s output differs from scalar\n",
+                        sets[k]->name);
+                return 1;
+            }
+            free(out.b);
+        }
+        printf("%-7s %8.1f MB/s  %6.3f ms/page  %.2fx\n", sets[k]->name,
+               mb / (ms / 1e3), ms / pages, scalar_ms / ms);
+    }
+    scan = best;
+    free(reference.b);
+    free(page);
+    return 0;
+}
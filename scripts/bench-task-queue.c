@@ -0,0 +1,183 @@
+/*
+ * Times the task_queue status polls against a 1M-row queue, on the old
+ * schema (JSON extracted per row, no indexes) and on the one in
+ * migration.sql (generated sk/pk, partial indexes on active tasks). Most
+ * rows are finished tasks, as in production; about 1% are active.
+ *
+ * usage: cc -O2 scripts/bench-task-queue.c -lsqlite3 -o /tmp/bench-task-queue \
+ *            && /tmp/bench-task-queue [rows] [polls]
+ */
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define USERS 2000
+
+static const char *old_schema =
+    "CREATE TABLE task_queue ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT, task TEXT NOT NULL,"
+    " step INTEGER DEFAULT 0, reference TEXT, token TEXT NOT NULL,"
+    " user_email TEXT NOT NULL, status TEXT NOT NULL DEFAULT 'ready',"
+    " is_complete INTEGER DEFAULT 0,"
+    " meta_data TEXT NOT NULL CHECK (json_valid(meta_data)),"
+    " created_at DATETIME DEFAULT (datetime('now', 'utc')),"
+    " updated_at DATETIME DEFAULT (datetime('now', 'utc')));";
+
+static const char *old_polls[] = {
+    "SELECT status, updated_at || 'Z', json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, "
+    "json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue "
+    "WHERE user_email = ?1 AND task = 'grade_submission' AND is_complete = 0 "
+    "AND updated_at >= datetime('now', '-2 minutes', 'utc')",
+    "SELECT status, updated_at || 'Z', json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, "
+    "json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue "
+    "WHERE task = 'optimize_criterion' AND is_complete = 0 "
+    "AND updated_at >= datetime('now', '-5 minutes', 'utc') AND reference = ?2",
+    "SELECT status, json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, "
+    "json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue "
+    "WHERE user_email = ?1 AND task = 'grade_submission' AND is_complete = 0 "
+    "AND json_extract(json_extract(meta_data, '$.body'), '$.sk') = ?3 "
+    "AND updated_at >= datetime('now', '-1 minutes', 'utc')",
+};
+
+static const char *new_polls[] = {
+    "SELECT status, updated_at || 'Z', sk, pk, step, 5 steps FROM task_queue "
+    "WHERE user_email = ?1 AND task = 'grade_submission' AND is_complete = 0 "
+    "AND updated_at >= datetime('now', '-2 minutes', 'utc')",
+    "SELECT status, updated_at || 'Z', sk, pk, step, 5 steps FROM task_queue "
+    "WHERE task = 'optimize_criterion' AND is_complete = 0 "
+    "AND updated_at >= datetime('now', '-5 minutes', 'utc') AND reference = ?2",
+    "SELECT status, sk, pk, step, 5 steps FROM task_queue "
+    "WHERE user_email = ?1 AND task = 'grade_submission' AND is_complete = 0 "
+    "AND sk = ?3 AND updated_at >= datetime('now', '-1 minutes', 'utc')",
+};
+
+static const char *poll_names[] = {"grading status", "optimize status", "grade debounce"};
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *s = malloc(n + 1);
+    s[fread(s, 1, n, f)] = 0;
+    fclose(f);
+    return s;
+}
+
+static void must(sqlite3 *db, int rc) {
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        fprintf(stderr, "sqlite: %s\n", sqlite3_errmsg(db));
+        exit(1);
+    }
+}
+
+static void fill(sqlite3 *db, int rows) {
+    sqlite3_stmt *st;
+    must(db, sqlite3_exec(db, "BEGIN", NULL, NULL, NULL));
+    must(db, sqlite3_prepare_v2(db,
+                                "INSERT INTO task_queue (task, reference, token, user_email, status, "
+                                "is_complete, meta_data, updated_at) VALUES (?, ?, ?, ?, ?, ?, ?, "
+                                "datetime('now', ?, 'utc'))",
+                                -1, &st, NULL));
+    srand(7);
+    for (int i = 0; i < rows; i++) {
+        char ref[32], token[32], email[32], meta[160], age[32];
+        int active = rand() % 100 == 0;
+        int optimize = rand() % 4 == 0;
+        snprintf(ref, sizeof ref, "s%d", i);
+        snprintf(token, sizeof token, "t%d", i);
+        snprintf(email, sizeof email, "user%d@x.edu", rand() % USERS);
+        snprintf(meta, sizeof meta,
+                 "{\"body\":\"{\\\"pk\\\":\\\"SUBMISSION#a%d\\\",\\\"sk\\\":\\\"SUBMISSION#s%d\\\"}\"}",
+                 i % 500, i);
+        snprintf(age, sizeof age, "-%d minutes", active ? rand() % 3 : 60 + rand() % 100000);
+        sqlite3_bind_text(st, 1, optimize ? "optimize_criterion" : "grade_submission", -1, SQLITE_STATIC);
+        sqlite3_bind_text(st, 2, ref, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 3, token, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 4, email, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 5, active ? "running" : "complete", -1, SQLITE_STATIC);
+        sqlite3_bind_int(st, 6, !active);
+        sqlite3_bind_text(st, 7, meta, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 8, age, -1, SQLITE_TRANSIENT);
+        must(db, sqlite3_step(st));
+        sqlite3_reset(st);
+    }
+    sqlite3_finalize(st);
+    must(db, sqlite3_exec(db, "COMMIT", NULL, NULL, NULL));
+    must(db, sqlite3_exec(db, "ANALYZE", NULL, NULL, NULL));
+}
+
+static double now_ms(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/* runs `polls` random polls of one query; returns ms per poll */
+static double time_poll(sqlite3 *db, const char *sql, int rows, int polls, long *hits) {
+    sqlite3_stmt *st;
+    must(db, sqlite3_prepare_v2(db, sql, -1, &st, NULL));
+    srand(11);
+    double t0 = now_ms();
+    for (int i = 0; i < polls; i++) {
+        char email[32], ref[32], sk[48];
+        int id = rand() % rows;
+        snprintf(email, sizeof email, "user%d@x.edu", rand() % USERS);
+        snprintf(ref, sizeof ref, "s%d", id);
+        snprintf(sk, sizeof sk, "SUBMISSION#s%d", id);
+        sqlite3_bind_text(st, 1, email, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 2, ref, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(st, 3, sk, -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(st) == SQLITE_ROW)
+            (*hits)++;
+        sqlite3_reset(st);
+    }
+    double ms = (now_ms() - t0) / polls;
+    sqlite3_finalize(st);
+    return ms;
+}
+
+int main(int argc, char **argv) {
+    int rows = argc > 1 ? atoi(argv[1]) : 1000000;
+    int polls = argc > 2 ? atoi(argv[2]) : 200;
+    char *migration = read_file("migration.sql");
+    if (!migration) {
+        fprintf(stderr, "run from the repository root\n");
+        return 1;
+    }
+
+    sqlite3 *old_db, *new_db;
+    must(NULL, sqlite3_open(":memory:", &old_db));
+    must(NULL, sqlite3_open(":memory:", &new_db));
+    must(old_db, sqlite3_exec(old_db, old_schema, NULL, NULL, NULL));
+    must(new_db, sqlite3_exec(new_db, migration, NULL, NULL, NULL));
+
+    double t0 = now_ms();
+    fill(old_db, rows);
+    double old_fill = now_ms() - t0;
+    t0 = now_ms();
+    fill(new_db, rows);
+    double new_fill = now_ms() - t0;
+    printf("%d rows, %d polls per query\n", rows, polls);
+    printf("%-16s %10.0f ms old %10.0f ms new\n", "insert", old_fill, new_fill);
+
+    for (int q = 0; q < 3; q++) {
+        long old_hits = 0, new_hits = 0;
+        double o = time_poll(old_db, old_polls[q], rows, polls, &old_hits);
+        double n = time_poll(new_db, new_polls[q], rows, polls, &new_hits);
+        if (old_hits != new_hits) {
+            fprintf(stderr, "%s: %ld rows on the old schema, %ld on the new\n", poll_names[q],
+                    old_hits, new_hits);
+            return 1;
+        }
+        printf("%-16s %10.3f ms old %10.3f ms new  %8.0fx\n", poll_names[q], o, n, o / n);
+    }
+    sqlite3_close(old_db);
+    sqlite3_close(new_db);
+    free(migration);
+    return 0;
+}
@@ -0,0 +1,32 @@
+-- One-off rebuild of an existing task_queue into the schema in migration.sql.
+-- SQLite cannot add STORED generated columns with ALTER TABLE, so the table
+-- is copied. Run once, with the server stopped:
+--
+--   sqlite3 main.db < scripts/migrate-task-queue.sql && sqlite3 main.db < migration.sql
+BEGIN IMMEDIATE;
+DROP TRIGGER IF EXISTS task_queue_updated_at;
+ALTER TABLE task_queue RENAME TO task_queue_old;
+CREATE TABLE task_queue (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    task TEXT NOT NULL,
+    step INTEGER DEFAULT 0,
+    reference TEXT,
+    token TEXT NOT NULL,
+    user_email TEXT NOT NULL,
+    status TEXT NOT NULL DEFAULT 'ready' CHECK (status IN ('ready', 'stopped', 'running', 'complete', 'error')),
+    is_complete INTEGER DEFAULT 0,
+    meta_data TEXT NOT NULL CHECK (json_valid(meta_data)),
+    sk TEXT GENERATED ALWAYS AS (json_extract(json_extract(meta_data, '$.body'), '$.sk')) STORED,
+    pk TEXT GENERATED ALWAYS AS (json_extract(json_extract(meta_data, '$.body'), '$.pk')) STORED,
+    dispatch_target TEXT,
+    dispatch_payload TEXT,
+    complete_on_send INTEGER DEFAULT 0,
+    attempts INTEGER DEFAULT 0,
+    not_before INTEGER DEFAULT 0,
+    created_at DATETIME DEFAULT (datetime('now', 'utc')),
+    updated_at DATETIME DEFAULT (datetime('now', 'utc'))
+);
+INSERT INTO task_queue (id, task, step, reference, token, user_email, status, is_complete, meta_data, created_at, updated_at)
+    SELECT id, task, step, reference, token, user_email, status, is_complete, meta_data, created_at, updated_at FROM task_queue_old;
+DROP TABLE task_queue_old;
+COMMIT;
@@ -0,0 +1,110 @@
+//! Change log behind `GET /submissions?since=`. Every write path that
+//! touches a submission records its key here under the owner's email, and a
+//! client that already holds the list asks for what changed after its last
+//! sync instead of refetching everything. Only the latest change per
+//! submission is kept, so a sync costs one row and one item read per
+//! changed submission.
+const std = @import("std");
+const sql = @import("sql.zig");
+const dynamo = @import("dynamo.zig");
+
+/// changes older than this are pruned; older `since` values get a 410 and
+/// the client falls back to the full list
+pub const retention_days = 30;
+/// a sync touching more submissions than this is answered with a 410 too,
+/// the full list is cheaper by then
+pub const max_changes = 1000;
+
+/// the one timestamp format stored in changed_at, ordered as text
+const iso = "'%Y-%m-%dT%H:%M:%fZ'";
+
+/// Notes that `sk` in `pk` was written (or deleted) for `owner`. Failures
+/// are logged and swallowed: the write itself already succeeded, and a
+/// missed change only costs the client a stale row until its next full
+/// fetch.
+pub fn record(allocator: std.mem.Allocator, owner: []const u8, pk: []const u8, sk: []const u8, deleted: bool) void {
+    if (std.mem.containsAtLeast(u8, sk, 1, "BACKUP")) return;
+    sql.exec(allocator, "INSERT INTO submission_changes (user_email, pk, sk, deleted, changed_at) VALUES (?, ?, ?, ?, strftime(" ++ iso ++ ", 'now')) ON CONFLICT (user_email, pk, sk) DO UPDATE SET deleted = excluded.deleted, changed_at = excluded.changed_at", .{ owner, pk, sk, deleted }) catch |err| {
+        std.log.err("change log write failed: {}\n", .{err});
+    };
+}
+
+pub const Key = struct { pk: []const u8, sk: []const u8 };
+
+pub const Delta = struct {
+    /// changed submissions in list form
+    items: []const std.json.Value,
+    deleted: []const Key,
+    /// pass back as `since` on the next sync
+    syncedAt: []const u8,
+};
+
+const Since = struct {
+    since: ?[]const u8,
+    expired: bool,
+};
+
+const Change = struct {
+    pk: []const u8,
+    sk: []const u8,
+    deleted: bool,
+    changed_at: []const u8,
+};
+
+/// What changed for `owner` at or after `since`. error.InvalidSince when it
+/// is not a timestamp, error.SyncExpired when it is older than the log
+/// reaches or too much changed.
+pub fn since(allocator: std.mem.Allocator, owner: []const u8, since_iso: []const u8) !Delta {
+    const bound = (try sql.one(Since, allocator, "SELECT strftime(" ++ iso ++ ", ?1), strftime(" ++ iso ++ ", ?1) < strftime(" ++ iso ++ ", 'now', '-" ++ std.fmt.comptimePrint("{d}", .{retention_days}) ++ " days')", .{since_iso})).?;
+    const from = bound.since orelse return error.InvalidSince;
+    if (bound.expired) return error.SyncExpired;
+
+    // inclusive: writes are timestamped under SQLite's write lock, so a
+    // change committed after this read is never stamped before the newest
+    // one it returns
+    var rows = try sql.query(allocator, "SELECT pk, sk, deleted, changed_at FROM submission_changes WHERE user_email = ? AND changed_at >= ? ORDER BY changed_at LIMIT ?", .{ owner, from, max_changes + 1 });
+    defer rows.deinit();
+    var changed: std.ArrayList(dynamo.Key) = .empty;
+    var deleted: std.ArrayList(Key) = .empty;
+    var synced_at: []const u8 = from;
+    var n: usize = 0;
+    while (try rows.next()) |row| {
+        n += 1;
+        if (n > max_changes) return error.SyncExpired;
+        const c = row.decode(Change);
+        const key: Key = .{ .pk = try allocator.dupe(u8, c.pk), .sk = try allocator.dupe(u8, c.sk) };
+        synced_at = try allocator.dupe(u8, c.changed_at);
+        if (c.deleted) {
+            try deleted.append(allocator, key);
+        } else {
+            try changed.append(allocator, .{ .prefix = "SUBMISSION", .pk = dynamo.stringStem(key.pk), .sk = dynamo.stringStem(key.sk) });
+        }
+    }
+
+    var items: std.ArrayList(std.json.Value) = .empty;
+    var rest = changed.items;
+    while (rest.len > 0) {
+        const chunk = rest[0..@min(rest.len, 100)];
+        rest = rest[chunk.len..];
+        for (try dynamo.batchGetItems(std.json.Value, allocator, chunk)) |found| {
+            // gone from DynamoDB without a logged delete: nothing to send
+            const item = found orelse continue;
+            try items.append(allocator, try dynamo.SubmissionList.fields(allocator, item));
+        }
+    }
+    return .{ .items = items.items, .deleted = deleted.items, .syncedAt = synced_at };
+}
+
+/// Deletes changes past the retention window every hour. Runs on its own
+/// thread.
+pub fn prune(io: std.Io) void {
+    var arena = std.heap.ArenaAllocator.init(std.heap.c_allocator);
+    defer arena.deinit();
+    while (true) {
+        _ = arena.reset(.retain_capacity);
+        sql.exec(arena.allocator(), "DELETE FROM submission_changes WHERE changed_at < strftime(" ++ iso ++ ", 'now', '-" ++ std.fmt.comptimePrint("{d}", .{retention_days}) ++ " days')", .{}) catch |err| {
+            std.log.err("change log prune failed: {}\n", .{err});
+        };
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(60 * 60 * 1000), std.Io.Clock.awake) catch {};
+    }
+}
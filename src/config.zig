@@ -5,8 +5,37 @@ pub const Config = @This();
 address: []const u8,
 port: u16,
 workers: usize = 1,
+/// threads serving routes marked `.class = .slow`, on top of `workers`
+slowWorkers: usize = 2,
+/// slow requests that may wait for a slow worker before new ones get a 503
+slowQueueDepth: usize = 8,
 hideDotFiles: bool = true,
 useArena: bool = true,
+/// seconds a kept-alive connection may sit idle before the worker drops it
+keepAliveTimeout: u32 = 5,
+/// requests served on one connection before it is closed
+maxRequestsPerConnection: usize = 100,
+/// seconds a client has to send a whole request, head and body, once its first byte arrives
+requestTimeout: u32 = 10,
+/// largest request, head and body, buffered before it is answered with 413
+maxRequestBytes: usize = 8 << 20,
+/// open connections the event loop will hold, idle or busy
+maxConnections: usize = 4096,
+/// give every worker its own listening socket and let the kernel balance accepts between them
+reusePort: bool = false,
+/// bytes the shared DynamoDB item cache may hold, 0 disables it
+itemCacheBytes: usize = 64 << 20,
+/// per-prefix item cache TTLs overriding the client defaults; prefix "*" sets the fallback
+itemCacheTtl: []const ItemCacheTtl = &.{},
+/// threads sending queued parser invocations
+dispatchWorkers: usize = 2,
+/// invocations each dispatch thread keeps open at once
+dispatchInFlight: usize = 16,
+
+pub const ItemCacheTtl = struct {
+    prefix: []const u8,
+    seconds: i32,
+};
 
 /// Initialize the `Config` from a JSON file.
 pub fn init(io: std.Io, filename: []const u8, allocator: std.mem.Allocator) !Config {
@@ -24,15 +53,33 @@ pub fn init(io: std.Io, filename: []const u8, allocator: std.mem.Allocator) !Con
 
     // Duplicate the address string so it remains valid
     const address_copy = try allocator.dupe(u8, settings.value.address);
+    const ttls = try allocator.alloc(ItemCacheTtl, settings.value.itemCacheTtl.len);
+    for (ttls, settings.value.itemCacheTtl) |*dst, src| {
+        dst.* = .{ .prefix = try allocator.dupe(u8, src.prefix), .seconds = src.seconds };
+    }
     return Config{
         .address = address_copy,
         .port = settings.value.port,
         .workers = settings.value.workers,
+        .slowWorkers = settings.value.slowWorkers,
+        .slowQueueDepth = settings.value.slowQueueDepth,
+        .keepAliveTimeout = settings.value.keepAliveTimeout,
+        .maxRequestsPerConnection = settings.value.maxRequestsPerConnection,
+        .requestTimeout = settings.value.requestTimeout,
+        .maxRequestBytes = settings.value.maxRequestBytes,
+        .maxConnections = settings.value.maxConnections,
+        .reusePort = settings.value.reusePort,
+        .itemCacheBytes = settings.value.itemCacheBytes,
+        .itemCacheTtl = ttls,
+        .dispatchWorkers = settings.value.dispatchWorkers,
+        .dispatchInFlight = settings.value.dispatchInFlight,
     };
 }
 
 /// Deallocate dynamically allocated memory in `Config`.
 pub fn deinit(self: *Config, allocator: std.mem.Allocator) void {
     allocator.free(self.address);
+    for (self.itemCacheTtl) |ttl| allocator.free(ttl.prefix);
+    allocator.free(self.itemCacheTtl);
     self.* = undefined; // Prevent accidental use-after-free
 }
@@ -0,0 +1,202 @@
+//! Sends parser invocations queued in task_queue. Handlers store the
+//! payload on the task row with `enqueue` and return; a fixed pool of
+//! threads claims ready rows, posts each claim concurrently over one curl
+//! multi handle and retries failures with backoff. Claims are leases, so
+//! rows a crashed or restarted server had in flight are picked up again;
+//! a live thread renews the lease of every post it still has open, so a
+//! slow post is never claimed and sent a second time.
+const std = @import("std");
+const dynamo = @import("dynamo.zig");
+const sql = @import("sql.zig");
+const tasks = @import("tasks.zig");
+
+/// sends attempted before the task is marked as failed
+const max_attempts = 5;
+/// seconds a claimed row stays hidden from other claims while it is sent
+const lease_seconds = 60;
+/// a post still open this long after its lease was taken gets a new one
+const renew_seconds = lease_seconds / 3;
+/// longest a post may take before it counts as failed; the local parser
+/// answers only once it is done, so this is well past any lease
+const post_timeout_seconds = 300;
+/// longest wait between retries
+const max_backoff_seconds = 60;
+const default_parser = "ai-parser-AiParserLambda8BD704BF-vi2FDv4rLltq";
+
+var lock: std.Io.Mutex = .init;
+var wake: std.Io.Condition = .init;
+var pending: bool = false;
+
+/// Where parser invocations go: the local parser's URL when LOCAL_PARSER is
+/// set, else the Lambda function named by PARSER.
+pub fn parserTarget() []const u8 {
+    if (dynamo.c.getenv("LOCAL_PARSER") != null) return "http://localhost:3002";
+    const fn_env = dynamo.c.getenv("PARSER");
+    return if (fn_env != null) std.mem.span(fn_env) else default_parser;
+}
+
+pub const EnqueueOptions = struct {
+    /// for fire-and-forget invocations that never call back: the task is
+    /// complete once the payload has been delivered
+    complete_on_send: bool = false,
+};
+
+/// Attaches `payload` to the task `token` for delivery to `parserTarget()`
+/// and wakes the pool.
+pub fn enqueue(io: std.Io, allocator: std.mem.Allocator, token: []const u8, payload: []const u8, options: EnqueueOptions) !void {
+    try sql.exec(allocator, "UPDATE task_queue SET dispatch_target = ?, dispatch_payload = ?, complete_on_send = ?, attempts = 0, not_before = 0 WHERE token = ?", .{ parserTarget(), payload, options.complete_on_send, token });
+    notify(io);
+}
+
+fn notify(io: std.Io) void {
+    lock.lock(io) catch return;
+    defer lock.unlock(io);
+    pending = true;
+    wake.broadcast(io);
+}
+
+/// Starts `workers` dispatch threads that each keep up to `in_flight`
+/// invocations open, plus a ticker that wakes them for retries and expired
+/// leases.
+pub fn start(io: std.Io, workers: usize, in_flight: usize) !void {
+    for (0..@max(workers, 1)) |_| {
+        const t = try std.Thread.spawn(.{}, work, .{ io, @max(in_flight, 1) });
+        t.detach();
+    }
+    const ticker = try std.Thread.spawn(.{}, tick, .{io});
+    ticker.detach();
+}
+
+fn tick(io: std.Io) void {
+    while (true) {
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(1000), std.Io.Clock.awake) catch {};
+        notify(io);
+    }
+}
+
+const Claim = struct {
+    id: i64,
+    token: []const u8,
+    target: []const u8,
+    payload: []const u8,
+    attempts: i64,
+    complete_on_send: bool,
+};
+
+fn work(io: std.Io, in_flight: usize) void {
+    var arena = std.heap.ArenaAllocator.init(std.heap.c_allocator);
+    defer arena.deinit();
+    while (true) {
+        _ = arena.reset(.retain_capacity);
+        const claims = claim(arena.allocator(), in_flight) catch |err| blk: {
+            std.log.err("dispatch claim failed: {}\n", .{err});
+            break :blk &.{};
+        };
+        if (claims.len == 0) {
+            waitForWork(io);
+            continue;
+        }
+        send(io, arena.allocator(), claims);
+    }
+}
+
+fn waitForWork(io: std.Io) void {
+    lock.lock(io) catch return;
+    defer lock.unlock(io);
+    while (!pending) wake.wait(io, &lock) catch return;
+    pending = false;
+}
+
+/// Leases up to `limit` ready rows to this thread.
+fn claim(allocator: std.mem.Allocator, limit: usize) ![]const Claim {
+    var rows = try sql.query(allocator, "UPDATE task_queue SET not_before = unixepoch() + ? WHERE id IN (SELECT id FROM task_queue WHERE status = 'ready' AND dispatch_payload IS NOT NULL AND not_before <= unixepoch() ORDER BY not_before LIMIT ?) RETURNING id, token, dispatch_target, dispatch_payload, attempts, complete_on_send", .{ lease_seconds, limit });
+    defer rows.deinit();
+    var out: std.ArrayList(Claim) = .empty;
+    while (try rows.next()) |row| {
+        const c = row.decode(Claim);
+        try out.append(allocator, .{
+            .id = c.id,
+            .token = try allocator.dupe(u8, c.token),
+            .target = try allocator.dupe(u8, c.target),
+            .payload = try allocator.dupeZ(u8, c.payload),
+            .attempts = c.attempts,
+            .complete_on_send = c.complete_on_send,
+        });
+    }
+    return out.toOwnedSlice(allocator);
+}
+
+/// Posts every claim at once and records each outcome as its post finishes.
+fn send(io: std.Io, allocator: std.mem.Allocator, claims: []const Claim) void {
+    const batch = dynamo.c.dynamo_batch_new() orelse return;
+    defer dynamo.c.dynamo_batch_free(batch);
+    dynamo.c.dynamo_batch_set_post_timeout(batch, post_timeout_seconds);
+    const ops = allocator.alloc(c_int, claims.len) catch return;
+    for (claims, ops) |c, *op| {
+        const target = allocator.dupeZ(u8, c.target) catch {
+            op.* = -1;
+            continue;
+        };
+        const payload: [*:0]const u8 = @ptrCast(c.payload.ptr);
+        op.* = if (std.mem.startsWith(u8, c.target, "http://") or std.mem.startsWith(u8, c.target, "https://"))
+            dynamo.c.dynamo_batch_http_post(batch, target, payload)
+        else
+            dynamo.c.dynamo_batch_invoke_lambda(batch, target, payload);
+    }
+    const recorded = allocator.alloc(bool, claims.len) catch return;
+    @memset(recorded, false);
+    var leased_at = now(io);
+    while (true) {
+        const left = dynamo.c.dynamo_batch_step(batch, 1000);
+        for (claims, ops, recorded) |c, op, *done| {
+            if (done.*) continue;
+            const status = if (op >= 0) dynamo.c.dynamo_batch_status(batch, op) else -1;
+            if (status == 1) continue;
+            done.* = true;
+            if (status == 0) delivered(io, allocator, c) else failed(io, allocator, c);
+        }
+        if (left == 0) break;
+        if (now(io) - leased_at >= renew_seconds) {
+            renew(allocator, claims, recorded);
+            leased_at = now(io);
+        }
+    }
+}
+
+/// Extends the lease of every claim whose post is still open.
+fn renew(allocator: std.mem.Allocator, claims: []const Claim, recorded: []const bool) void {
+    for (claims, recorded) |c, done| {
+        if (done) continue;
+        sql.exec(allocator, "UPDATE task_queue SET not_before = unixepoch() + ? WHERE id = ?", .{ lease_seconds, c.id }) catch |err| {
+            std.log.err("dispatch lease renewal failed: {}\n", .{err});
+        };
+    }
+}
+
+fn now(io: std.Io) i64 {
+    const ts = std.Io.Clock.awake.now(io) catch return 0;
+    return ts.toSeconds();
+}
+
+fn delivered(io: std.Io, allocator: std.mem.Allocator, c: Claim) void {
+    sql.exec(allocator, "UPDATE task_queue SET dispatch_payload = NULL, not_before = 0 WHERE id = ?", .{c.id}) catch |err| {
+        std.log.err("dispatch bookkeeping failed: {}\n", .{err});
+    };
+    if (c.complete_on_send) {
+        tasks.updateTask(io, allocator, c.token, "complete", 0, true, null) catch {};
+    }
+}
+
+fn failed(io: std.Io, allocator: std.mem.Allocator, c: Claim) void {
+    const attempts = c.attempts + 1;
+    if (attempts >= max_attempts) {
+        std.log.err("dispatch of task {d} failed {d} times, giving up\n", .{ c.id, attempts });
+        sql.exec(allocator, "UPDATE task_queue SET dispatch_payload = NULL, attempts = ? WHERE id = ?", .{ attempts, c.id }) catch {};
+        tasks.markError(io, allocator, c.token, null) catch {};
+        return;
+    }
+    const backoff = @min(@as(i64, 1) << @intCast(attempts), max_backoff_seconds);
+    sql.exec(allocator, "UPDATE task_queue SET attempts = ?, not_before = unixepoch() + ? WHERE id = ?", .{ attempts, backoff, c.id }) catch |err| {
+        std.log.err("dispatch bookkeeping failed: {}\n", .{err});
+    };
+}
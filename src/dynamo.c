@@ -1,6 +1,8 @@
 #include <ctype.h>
 #include <curl/curl.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,9 +12,15 @@
 /* types                                                              */
 /* ================================================================== */
 
+typedef struct {
+    void *(*grow)(void *ctx, void *old, size_t old_cap, size_t new_cap);
+    void *ctx;
+    int wire; /* list items stay in DynamoDB wire format */
+} DynamoAlloc;
 typedef struct {
     char *b;
     size_t n, cap;
+    const DynamoAlloc *a; /* NULL: malloc */
 } Buf;
 typedef struct {
     const char *s;
@@ -25,7 +33,19 @@ typedef struct {
 typedef struct {
     char **items;
     size_t count;
+    char *block;  /* when set, items point into it */
+    int external; /* memory belongs to a caller DynamoAlloc */
 } ItemList;
+typedef struct {
+    const char *prefix;
+    const char *pk;
+    const char *sk;
+} ItemKey;
+typedef struct {
+    unsigned long hits, misses, evictions, invalidations;
+    size_t entries, bytes, max_bytes;
+} DynamoCacheStats;
+typedef int (*ItemPageFn)(void *ctx, const char *const *items, size_t count);
 
 /* ================================================================== */
 /* buffer                                                             */
@@ -33,8 +53,12 @@ typedef struct {
 
 static void b_write(Buf *b, const char *s, size_t n) {
     if (b->n + n + 1 > b->cap) {
-        b->cap = (b->cap + n + 1) * 2;
-        b->b = realloc(b->b, b->cap);
+        size_t cap = (b->cap + n + 1) * 2;
+        if (b->a)
+            b->b = b->a->grow(b->a->ctx, b->b, b->cap, cap);
+        else
+            b->b = realloc(b->b, cap);
+        b->cap = cap;
     }
     memcpy(b->b + b->n, s, n);
     b->n += n;
@@ -55,108 +79,282 @@ static void b_fmt(Buf *b, const char *fmt, ...) {
     b_str(b, tmp);
 }
 
+/* ================================================================== */
+/* scanning kernels                                                     */
+/* ================================================================== */
+
+/*
+ * Each kernel returns the index of the first byte at or after i that
+ * matters to the parser; the terminating NUL always matches. Most time
+ * goes to string bodies (multi-KB text, rationale and feedback fields),
+ * so the vector versions test 16 or 32 bytes per step. Loads are aligned,
+ * which keeps a block from reaching into an unmapped page past the NUL;
+ * bytes before i are masked off. Define DYNAMO_SCAN_SCALAR to build
+ * without vector code.
+ *
+ *   scan_ws      first byte that is not JSON whitespace
+ *   scan_str     first '"' or '\\' (inside a string body)
+ *   scan_struct  first '"', '{', '}', '[' or ']' (skipping a container)
+ */
+
+static int is_ws(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+static size_t scan_ws_scalar(const char *s, size_t i) {
+    while (is_ws(s[i]))
+        i++;
+    return i;
+}
+
+static size_t scan_str_scalar(const char *s, size_t i) {
+    while (s[i] && s[i] != '"' && s[i] != '\\')
+        i++;
+    return i;
+}
+
+static size_t scan_struct_scalar(const char *s, size_t i) {
+    while (s[i] && s[i] != '"' && s[i] != '{' && s[i] != '}' &&
+           s[i] != '[' && s[i] != ']')
+        i++;
+    return i;
+}
+
+#if !defined(DYNAMO_SCAN_SCALAR) && (defined(__x86_64__) || defined(_M_X64))
+#include <immintrin.h>
+#define SCAN_X86 1
+
+/* expands to a kernel whose match mask for one block is MATCH(v) */
+#define SCAN_SSE2_KERNEL(name, MATCH)                                          \
+    static size_t name(const char *s, size_t i) {                              \
+        const char *p = s + i;                                                 \
+        const char *a = (const char *)((uintptr_t)p & ~(uintptr_t)15);         \
+        __m128i v = _mm_load_si128((const __m128i *)a);                        \
+        unsigned m = (unsigned)_mm_movemask_epi8(MATCH(v)) &                   \
+                     (0xFFFFu << (p - a));                                     \
+        while (!m) {                                                           \
+            a += 16;                                                           \
+            v = _mm_load_si128((const __m128i *)a);                            \
+            m = (unsigned)_mm_movemask_epi8(MATCH(v));                         \
+        }                                                                      \
+        return (size_t)(a + __builtin_ctz(m) - s);                             \
+    }
+
+#define SCAN_AVX2_KERNEL(name, MATCH)                                          \
+    __attribute__((target("avx2"))) static size_t name(const char *s,          \
+                                                       size_t i) {             \
+        const char *p = s + i;                                                 \
+        const char *a = (const char *)((uintptr_t)p & ~(uintptr_t)31);         \
+        __m256i v = _mm256_load_si256((const __m256i *)a);                     \
+        unsigned m = (unsigned)_mm256_movemask_epi8(MATCH(v)) &                \
+                     (0xFFFFFFFFu << (p - a));                                 \
+        while (!m) {                                                           \
+            a += 32;                                                           \
+            v = _mm256_load_si256((const __m256i *)a);                         \
+            m = (unsigned)_mm256_movemask_epi8(MATCH(v));                      \
+        }                                                                      \
+        return (size_t)(a + __builtin_ctz(m) - s);                             \
+    }
+
+#define EQ128(v, ch) _mm_cmpeq_epi8(v, _mm_set1_epi8(ch))
+#define EQ256(v, ch) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch))
+
+#define WS128(v)                                                               \
+    _mm_xor_si128(_mm_or_si128(_mm_or_si128(EQ128(v, ' '), EQ128(v, '\n')),    \
+                               _mm_or_si128(EQ128(v, '\r'), EQ128(v, '\t'))),  \
+                  _mm_set1_epi8(-1))
+#define STR128(v)                                                              \
+    _mm_or_si128(_mm_or_si128(EQ128(v, '"'), EQ128(v, '\\')), EQ128(v, 0))
+#define STRUCT128(v)                                                           \
+    _mm_or_si128(                                                              \
+        _mm_or_si128(_mm_or_si128(EQ128(v, '"'), EQ128(v, 0)),                 \
+                     _mm_or_si128(EQ128(v, '{'), EQ128(v, '}'))),              \
+        _mm_or_si128(EQ128(v, '['), EQ128(v, ']')))
+
+#define WS256(v)                                                               \
+    _mm256_xor_si256(                                                          \
+        _mm256_or_si256(_mm256_or_si256(EQ256(v, ' '), EQ256(v, '\n')),        \
+                        _mm256_or_si256(EQ256(v, '\r'), EQ256(v, '\t'))),      \
+        _mm256_set1_epi8(-1))
+#define STR256(v)                                                              \
+    _mm256_or_si256(_mm256_or_si256(EQ256(v, '"'), EQ256(v, '\\')),           \
+                    EQ256(v, 0))
+#define STRUCT256(v)                                                           \
+    _mm256_or_si256(                                                           \
+        _mm256_or_si256(_mm256_or_si256(EQ256(v, '"'), EQ256(v, 0)),           \
+                        _mm256_or_si256(EQ256(v, '{'), EQ256(v, '}'))),        \
+        _mm256_or_si256(EQ256(v, '['), EQ256(v, ']')))
+
+SCAN_SSE2_KERNEL(scan_ws_sse2, WS128)
+SCAN_SSE2_KERNEL(scan_str_sse2, STR128)
+SCAN_SSE2_KERNEL(scan_struct_sse2, STRUCT128)
+SCAN_AVX2_KERNEL(scan_ws_avx2, WS256)
+SCAN_AVX2_KERNEL(scan_str_avx2, STR256)
+SCAN_AVX2_KERNEL(scan_struct_avx2, STRUCT256)
+
+#elif !defined(DYNAMO_SCAN_SCALAR) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+
+/* narrows a byte mask to 4 bits per byte; ctz / 4 gives the byte index */
+static inline uint64_t neon_mask(uint8x16_t m) {
+    return vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+#define SCAN_NEON_KERNEL(name, MATCH)                                          \
+    static size_t name(const char *s, size_t i) {                              \
+        const char *p = s + i;                                                 \
+        const char *a = (const char *)((uintptr_t)p & ~(uintptr_t)15);         \
+        uint8x16_t v = vld1q_u8((const uint8_t *)a);                           \
+        uint64_t m = neon_mask(MATCH(v)) & (~0ull << ((p - a) * 4));           \
+        while (!m) {                                                           \
+            a += 16;                                                           \
+            v = vld1q_u8((const uint8_t *)a);                                  \
+            m = neon_mask(MATCH(v));                                           \
+        }                                                                      \
+        return (size_t)(a + __builtin_ctzll(m) / 4 - s);                       \
+    }
+
+#define EQN(v, ch) vceqq_u8(v, vdupq_n_u8(ch))
+#define WSN(v)                                                                 \
+    vmvnq_u8(vorrq_u8(vorrq_u8(EQN(v, ' '), EQN(v, '\n')),                     \
+                      vorrq_u8(EQN(v, '\r'), EQN(v, '\t'))))
+#define STRN(v) vorrq_u8(vorrq_u8(EQN(v, '"'), EQN(v, '\\')), EQN(v, 0))
+#define STRUCTN(v)                                                             \
+    vorrq_u8(vorrq_u8(vorrq_u8(EQN(v, '"'), EQN(v, 0)),                        \
+                      vorrq_u8(EQN(v, '{'), EQN(v, '}'))),                     \
+             vorrq_u8(EQN(v, '['), EQN(v, ']')))
+
+SCAN_NEON_KERNEL(scan_ws_neon, WSN)
+SCAN_NEON_KERNEL(scan_str_neon, STRN)
+SCAN_NEON_KERNEL(scan_struct_neon, STRUCTN)
+#endif
+
+typedef size_t (*ScanFn)(const char *s, size_t i);
+typedef struct {
+    const char *name;
+    ScanFn ws, str, structural;
+} ScanKernels;
+
+static const ScanKernels scan_scalar = {"scalar", scan_ws_scalar,
+                                        scan_str_scalar, scan_struct_scalar};
+#if defined(SCAN_X86)
+static const ScanKernels scan_sse2 = {"sse2", scan_ws_sse2, scan_str_sse2,
+                                      scan_struct_sse2};
+static const ScanKernels scan_avx2 = {"avx2", scan_ws_avx2, scan_str_avx2,
+                                      scan_struct_avx2};
+#elif defined(SCAN_NEON)
+static const ScanKernels scan_neon = {"neon", scan_ws_neon, scan_str_neon,
+                                      scan_struct_neon};
+#endif
+
+/* picks the widest kernels the CPU supports before main runs */
+static const ScanKernels *scan = &scan_scalar;
+
+__attribute__((constructor)) static void scan_init(void) {
+#if defined(SCAN_X86)
+    __builtin_cpu_init();
+    scan = __builtin_cpu_supports("avx2") ? &scan_avx2 : &scan_sse2;
+#elif defined(SCAN_NEON)
+    scan = &scan_neon;
+#endif
+}
+
 /* ================================================================== */
 /* cursor / json primitives                                           */
 /* ================================================================== */
 
 static void ws(Cur *c) {
-    while (isspace((unsigned char)c->s[c->i]))
-        c->i++;
+    /* compact responses rarely have any, check before calling out */
+    if (is_ws(c->s[c->i]))
+        c->i = scan->ws(c->s, c->i);
 }
 
-static char *read_str(Cur *c) {
+/*
+ * Advances past the string at c. body and len (optional) receive the span
+ * between the quotes, escapes left as-is. Returns 0 if c is not at a string.
+ */
+static int str_span(Cur *c, const char **body, size_t *len) {
     ws(c);
     if (c->s[c->i] != '"')
-        return NULL;
-    c->i++;
-    Buf tmp = {0};
-    while (c->s[c->i] && c->s[c->i] != '"') {
-        if (c->s[c->i] == '\\') {
-            b_chr(&tmp, c->s[c->i++]);
-            if (c->s[c->i])
-                b_chr(&tmp, c->s[c->i++]);
-        } else {
-            b_chr(&tmp, c->s[c->i++]);
-        }
+        return 0;
+    size_t start = ++c->i;
+    while ((c->i = scan->str(c->s, c->i), c->s[c->i] == '\\')) {
+        c->i++;
+        if (c->s[c->i])
+            c->i++;
     }
+    if (body)
+        *body = c->s + start;
+    if (len)
+        *len = c->i - start;
     if (c->s[c->i] == '"')
         c->i++;
-    if (!tmp.b)
-        tmp.b = strdup("");
-    return tmp.b;
+    return 1;
 }
 
-/* copies the current JSON value verbatim (with its delimiters) into out */
-static void copy_raw_value(Cur *c, Buf *out) {
+/* returns the string at c with escapes left as-is, or NULL; caller frees */
+static char *read_str(Cur *c) {
+    const char *body;
+    size_t len;
+    if (!str_span(c, &body, &len))
+        return NULL;
+    char *out = malloc(len + 1);
+    memcpy(out, body, len);
+    out[len] = '\0';
+    return out;
+}
+
+/* 1 if the span equals the NUL-terminated name */
+static int span_is(const char *s, size_t n, const char *name) {
+    return strlen(name) == n && memcmp(s, name, n) == 0;
+}
+
+/* advances past the current JSON value without copying it */
+static void skip_value(Cur *c) {
     ws(c);
-    if (c->s[c->i] == '"') {
-        b_chr(out, '"');
-        c->i++;
-        while (c->s[c->i] && c->s[c->i] != '"') {
-            if (c->s[c->i] == '\\') {
-                b_chr(out, '\\');
-                c->i++;
-                if (c->s[c->i])
-                    b_chr(out, c->s[c->i++]);
-            } else {
-                b_chr(out, c->s[c->i++]);
-            }
-        }
-        if (c->s[c->i] == '"') {
-            b_chr(out, '"');
-            c->i++;
-        }
+    char ch = c->s[c->i];
+    if (ch == '"') {
+        str_span(c, NULL, NULL);
         return;
     }
-    if (c->s[c->i] == '{' || c->s[c->i] == '[') {
-        int depth = 0, in_str = 0;
-        while (c->s[c->i]) {
-            char ch = c->s[c->i];
-            b_chr(out, ch);
-            if (in_str) {
-                if (ch == '\\') {
-                    c->i++;
-                    if (c->s[c->i])
-                        b_chr(out, c->s[c->i++]);
-                    continue;
-                }
-                if (ch == '"')
-                    in_str = 0;
-            } else {
-                if (ch == '"')
-                    in_str = 1;
-                else if (ch == '{' || ch == '[')
-                    depth++;
-                else if (ch == '}' || ch == ']') {
-                    depth--;
-                    if (!depth) {
-                        c->i++;
-                        return;
-                    }
-                }
+    if (ch == '{' || ch == '[') {
+        int depth = 0;
+        while ((c->i = scan->structural(c->s, c->i), c->s[c->i])) {
+            ch = c->s[c->i];
+            if (ch == '"') {
+                str_span(c, NULL, NULL);
+                continue;
             }
             c->i++;
+            if (ch == '{' || ch == '[')
+                depth++;
+            else if ((ch == '}' || ch == ']') && !--depth)
+                return;
         }
         return;
     }
     /* scalar */
     while (c->s[c->i] && !isspace((unsigned char)c->s[c->i]) &&
            c->s[c->i] != ',' && c->s[c->i] != '}' && c->s[c->i] != ']')
-        b_chr(out, c->s[c->i++]);
+        c->i++;
 }
 
-static void skip_value(Cur *c) {
-    Buf d = {0};
-    copy_raw_value(c, &d);
-    free(d.b);
+/* copies the current JSON value verbatim (with its delimiters) into out */
+static void copy_raw_value(Cur *c, Buf *out) {
+    ws(c);
+    size_t start = c->i;
+    skip_value(c);
+    b_write(out, c->s + start, c->i - start);
 }
 
 /* ================================================================== */
 /* json utilities                                                       */
 /* ================================================================== */
 
-/* returns raw JSON value for key in a JSON object, caller frees */
-static char *json_get_raw(const char *json, const char *key) {
+/* points at the value for key in a top-level JSON object, or NULL */
+static const char *json_find(const char *json, const char *key) {
     if (!json)
         return NULL;
     Cur c = {json, 0};
@@ -168,19 +366,17 @@ static char *json_get_raw(const char *json, const char *key) {
         ws(&c);
         if (!c.s[c.i] || c.s[c.i] == '}')
             break;
-        char *k = read_str(&c);
-        if (!k)
+        const char *k;
+        size_t kn;
+        if (!str_span(&c, &k, &kn))
             break;
         ws(&c);
         if (c.s[c.i] == ':')
             c.i++;
-        if (strcmp(k, key) == 0) {
-            free(k);
-            Buf tmp = {0};
-            copy_raw_value(&c, &tmp);
-            return tmp.b ? tmp.b : strdup("");
+        if (span_is(k, kn, key)) {
+            ws(&c);
+            return c.s + c.i;
         }
-        free(k);
         skip_value(&c);
         ws(&c);
         if (c.s[c.i] == ',')
@@ -189,6 +385,27 @@ static char *json_get_raw(const char *json, const char *key) {
     return NULL;
 }
 
+/*
+ * Appends the raw value for key in a top-level JSON object to out.
+ * Returns 0 if found, -1 otherwise.
+ */
+static int json_copy_raw(const char *json, const char *key, Buf *out) {
+    const char *v = json_find(json, key);
+    if (!v)
+        return -1;
+    Cur c = {v, 0};
+    copy_raw_value(&c, out);
+    return 0;
+}
+
+/* returns raw JSON value for key, caller frees */
+static char *json_get_raw(const char *json, const char *key) {
+    Buf tmp = {0};
+    if (json_copy_raw(json, key, &tmp) != 0)
+        return NULL;
+    return tmp.b ? tmp.b : strdup("");
+}
+
 /* returns unquoted string value for key, caller frees */
 static char *json_get_string(const char *json, const char *key) {
     char *raw = json_get_raw(json, key);
@@ -205,15 +422,26 @@ static char *json_get_string(const char *json, const char *key) {
 /* dynamo unmarshal                                                     */
 /* ================================================================== */
 
-static int is_dynamo_type(const char *k) {
+static int is_dynamo_type(const char *k, size_t n) {
     static const char *types[] = {"S",  "N",  "B", "BOOL", "NULL", "SS",
                                   "NS", "BS", "M", "L",    NULL};
     for (int i = 0; types[i]; i++)
-        if (strcmp(k, types[i]) == 0)
+        if (span_is(k, n, types[i]))
             return 1;
     return 0;
 }
 
+/* emits the string at c quoted, straight from the source */
+static void emit_str(Cur *c, Buf *out) {
+    const char *s;
+    size_t n;
+    if (!str_span(c, &s, &n))
+        return;
+    b_chr(out, '"');
+    b_write(out, s, n);
+    b_chr(out, '"');
+}
+
 static void unmarshal_value(Cur *c, Buf *out);
 
 static void unmarshal_array(Cur *c, Buf *out) {
@@ -257,9 +485,10 @@ static void unmarshal_number_set(Cur *c, Buf *out) {
         if (!first)
             b_chr(out, ',');
         first = 0;
-        char *s = read_str(c);
-        b_str(out, s);
-        free(s);
+        const char *s;
+        size_t n;
+        if (str_span(c, &s, &n))
+            b_write(out, s, n);
         ws(c);
         if (c->s[c->i] == ',')
             c->i++;
@@ -272,9 +501,11 @@ static void unmarshal_number_set(Cur *c, Buf *out) {
 
 static void copy_scalar(Cur *c, Buf *out) {
     ws(c);
+    size_t start = c->i;
     while (c->s[c->i] && !isspace((unsigned char)c->s[c->i]) &&
            c->s[c->i] != ',' && c->s[c->i] != '}' && c->s[c->i] != ']')
-        b_chr(out, c->s[c->i++]);
+        c->i++;
+    b_write(out, c->s + start, c->i - start);
 }
 
 static void unmarshal_object(Cur *c, Buf *out) {
@@ -292,11 +523,10 @@ static void unmarshal_object(Cur *c, Buf *out) {
         if (!first)
             b_chr(out, ',');
         first = 0;
-        char *key = read_str(c);
-        b_chr(out, '"');
-        b_str(out, key);
-        b_chr(out, '"');
-        free(key);
+        if (c->s[c->i] == '"')
+            emit_str(c, out);
+        else
+            b_str(out, "\"\"");
         ws(c);
         if (c->s[c->i] == ':')
             c->i++;
@@ -319,11 +549,7 @@ static void unmarshal_value(Cur *c, Buf *out) {
         return;
     }
     if (c->s[c->i] == '"') {
-        char *s = read_str(c);
-        b_chr(out, '"');
-        b_str(out, s);
-        b_chr(out, '"');
-        free(s);
+        emit_str(c, out);
         return;
     }
     if (c->s[c->i] != '{') {
@@ -340,9 +566,9 @@ static void unmarshal_value(Cur *c, Buf *out) {
         return;
     }
 
-    char *first_key = read_str(c);
-    if (!first_key || !is_dynamo_type(first_key)) {
-        free(first_key);
+    const char *t;
+    size_t tn;
+    if (!str_span(c, &t, &tn) || !is_dynamo_type(t, tn)) {
         c->i = saved;
         unmarshal_object(c, out);
         return;
@@ -352,38 +578,28 @@ static void unmarshal_value(Cur *c, Buf *out) {
     if (c->s[c->i] == ':')
         c->i++;
 
-    if (strcmp(first_key, "S") == 0) {
-        char *s = read_str(c);
-        b_chr(out, '"');
-        b_str(out, s);
-        b_chr(out, '"');
-        free(s);
-    } else if (strcmp(first_key, "N") == 0) {
-        char *s = read_str(c);
-        b_str(out, s);
-        free(s);
-    } else if (strcmp(first_key, "BOOL") == 0) {
+    if (span_is(t, tn, "S") || span_is(t, tn, "B")) {
+        emit_str(c, out);
+    } else if (span_is(t, tn, "N")) {
+        const char *s;
+        size_t n;
+        if (str_span(c, &s, &n))
+            b_write(out, s, n);
+    } else if (span_is(t, tn, "BOOL")) {
         copy_scalar(c, out);
-    } else if (strcmp(first_key, "NULL") == 0) {
+    } else if (span_is(t, tn, "NULL")) {
         skip_value(c);
         b_str(out, "null");
-    } else if (strcmp(first_key, "B") == 0) {
-        char *s = read_str(c);
-        b_chr(out, '"');
-        b_str(out, s);
-        b_chr(out, '"');
-        free(s);
-    } else if (strcmp(first_key, "SS") == 0 || strcmp(first_key, "BS") == 0) {
+    } else if (span_is(t, tn, "SS") || span_is(t, tn, "BS")) {
         unmarshal_array(c, out);
-    } else if (strcmp(first_key, "NS") == 0) {
+    } else if (span_is(t, tn, "NS")) {
         unmarshal_number_set(c, out);
-    } else if (strcmp(first_key, "M") == 0) {
+    } else if (span_is(t, tn, "M")) {
         unmarshal_object(c, out);
-    } else if (strcmp(first_key, "L") == 0) {
+    } else if (span_is(t, tn, "L")) {
         unmarshal_array(c, out);
     }
 
-    free(first_key);
     ws(c);
     if (c->s[c->i] == '}')
         c->i++;
@@ -500,181 +716,838 @@ static char *dynamo_marshal(const char *json) {
 }
 
 /* ================================================================== */
-/* curl layer                                                           */
+/* item cache                                                           */
 /* ================================================================== */
 
-static size_t write_cb(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    size_t real = size * nmemb;
-    ResponseBuf *buf = userdata;
-    char *tmp = realloc(buf->data, buf->len + real + 1);
-    if (!tmp)
-        return 0;
-    buf->data = tmp;
-    memcpy(buf->data + buf->len, ptr, real);
-    buf->len += real;
-    buf->data[buf->len] = '\0';
-    return real;
-}
-
 /*
- * Thread-local curl handles — one per service endpoint.
- * curl_easy_reset() clears options but preserves the connection cache,
- * so TCP/TLS connections are reused across calls on the same thread.
+ * GetItem results shared by all threads, keyed by (pk, sk) plus the
+ * projection they were read with; a full item also answers projected
+ * reads, since callers ignore extra attributes. Items stay in wire format
+ * so plain and wire readers share entries. Every single-item write sent
+ * through this client drops the keys it touches. Each stripe has its own
+ * lock, LRU list and share of the byte budget.
  */
-static __thread CURL *tl_dynamo_curl = NULL;
-static __thread CURL *tl_lambda_curl = NULL;
-static __thread CURL *tl_http_curl   = NULL;
+#define CACHE_STRIPES 16
+#define CACHE_BUCKETS 1024 /* per stripe */
+#define CACHE_MAX_TTLS 32
+
+typedef struct CacheEntry {
+    struct CacheEntry *next;          /* bucket chain */
+    struct CacheEntry *newer, *older; /* LRU list */
+    uint64_t hash;                    /* of pk and sk only */
+    time_t expires;
+    size_t size;
+    size_t item_key_len; /* of "pk\x1fsk\x1f" */
+    char *key;           /* pk \x1f sk \x1f proj \x1f names */
+    char *item;
+} CacheEntry;
 
-static CURL *get_curl(CURL **handle) {
-    if (!*handle) {
-        *handle = curl_easy_init();
-    } else {
-        curl_easy_reset(*handle);
-    }
-    if (*handle) {
-        curl_easy_setopt(*handle, CURLOPT_TCP_KEEPALIVE, 1L);
-        curl_easy_setopt(*handle, CURLOPT_TCP_KEEPIDLE, 30L);
-        curl_easy_setopt(*handle, CURLOPT_TCP_KEEPINTVL, 10L);
-    }
-    return *handle;
+typedef struct {
+    pthread_mutex_t lock;
+    CacheEntry *buckets[CACHE_BUCKETS];
+    CacheEntry *newest, *oldest;
+    size_t bytes, entries;
+    unsigned long hits, misses, evictions, invalidations;
+    /* bumped by every forget; a read that started under an older value may
+       have fetched the item from before the write and is not stored */
+    unsigned long generation;
+} CacheStripe;
+
+typedef struct {
+    char prefix[32];
+    int ttl;
+} CacheTtl;
+
+typedef struct {
+    char *pk, *sk, *proj, *names;
+} CacheKey;
+
+static CacheStripe g_cache[CACHE_STRIPES];
+static pthread_once_t g_cache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_cache_cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t g_cache_max_bytes = 64u << 20;
+static int g_cache_default_ttl = 0;
+/* items other services rewrite (graded submissions) get short TTLs */
+static CacheTtl g_cache_ttls[CACHE_MAX_TTLS] = {
+    {"USER", 300},  {"ASSIGNMENT", 300}, {"CLASS", 600},
+    {"RUBRIC", 300}, {"SUBMISSION", 30},
+};
+static int g_cache_ttl_count = 5;
+
+static void cache_init_once(void) {
+    for (int i = 0; i < CACHE_STRIPES; i++)
+        pthread_mutex_init(&g_cache[i].lock, NULL);
 }
 
-/* makes a DynamoDB API call; returns raw response body, caller frees */
-static char *dynamo_request(const char *target, const char *body) {
-    const char *key_id = getenv("AWS_ACCESS_KEY_ID");
-    const char *secret = getenv("AWS_SECRET_ACCESS_KEY");
-    const char *region = getenv("AWS_REGION");
+static uint64_t cache_hash(const char *pk, const char *sk) {
+    uint64_t h = 1469598103934665603ull;
+    for (const char *p = pk; *p; p++)
+        h = (h ^ (unsigned char)*p) * 1099511628211ull;
+    h = (h ^ 0x1f) * 1099511628211ull;
+    for (const char *p = sk; *p; p++)
+        h = (h ^ (unsigned char)*p) * 1099511628211ull;
+    return h;
+}
 
-    if (!key_id || !secret || !region) {
-        fprintf(stderr, "AWS credentials/region missing\n");
-        return NULL;
+static CacheStripe *cache_stripe(uint64_t h) {
+    pthread_once(&g_cache_once, cache_init_once);
+    return &g_cache[h % CACHE_STRIPES];
+}
+
+static CacheEntry **cache_bucket(CacheStripe *st, uint64_t h) {
+    return &st->buckets[(h / CACHE_STRIPES) % CACHE_BUCKETS];
+}
+
+/* seconds to keep items whose pk starts with "PREFIX#"; 0 = do not cache */
+static int cache_ttl(const char *pk) {
+    const char *hash = strchr(pk, '#');
+    size_t n = hash ? (size_t)(hash - pk) : strlen(pk);
+    int ttl;
+    pthread_mutex_lock(&g_cache_cfg_lock);
+    ttl = g_cache_default_ttl;
+    for (int i = 0; i < g_cache_ttl_count; i++) {
+        if (strlen(g_cache_ttls[i].prefix) == n &&
+            strncmp(g_cache_ttls[i].prefix, pk, n) == 0) {
+            ttl = g_cache_ttls[i].ttl;
+            break;
+        }
     }
+    pthread_mutex_unlock(&g_cache_cfg_lock);
+    return ttl;
+}
 
-    char url[128], userpwd[256], sigv4[128], target_hdr[128];
-    snprintf(url, sizeof(url), "https://dynamodb.%s.amazonaws.com/", region);
-    snprintf(userpwd, sizeof(userpwd), "%s:%s", key_id, secret);
-    snprintf(sigv4, sizeof(sigv4), "aws:amz:%s:dynamodb", region);
-    snprintf(target_hdr, sizeof(target_hdr), "X-Amz-Target: %s", target);
+static void cache_lru_unlink(CacheStripe *st, CacheEntry *e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        st->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        st->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
 
-    CURL *curl = get_curl(&tl_dynamo_curl);
-    if (!curl)
-        return NULL;
+static void cache_lru_push(CacheStripe *st, CacheEntry *e) {
+    e->older = st->newest;
+    e->newer = NULL;
+    if (st->newest)
+        st->newest->newer = e;
+    st->newest = e;
+    if (!st->oldest)
+        st->oldest = e;
+}
 
-    struct curl_slist *headers = NULL;
-    headers =
-        curl_slist_append(headers, "Content-Type: application/x-amz-json-1.0");
-    headers = curl_slist_append(headers, target_hdr);
+/* unlinks e, found at *link in its bucket chain, and frees it */
+static void cache_drop(CacheStripe *st, CacheEntry **link, CacheEntry *e) {
+    *link = e->next;
+    cache_lru_unlink(st, e);
+    st->bytes -= e->size;
+    st->entries--;
+    free(e);
+}
 
-    ResponseBuf resp = {0};
+static void cache_drop_entry(CacheStripe *st, CacheEntry *e) {
+    for (CacheEntry **link = cache_bucket(st, e->hash); *link;
+         link = &(*link)->next) {
+        if (*link == e) {
+            cache_drop(st, link, e);
+            return;
+        }
+    }
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
-    curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
+static void cache_key_free(CacheKey *k) {
+    free(k->pk);
+    free(k->sk);
+    free(k->proj);
+    free(k->names);
+    *k = (CacheKey){0};
+}
 
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
+/* the S value of a top-level attribute of an item or key map, caller frees */
+static char *cache_attr(const char *map, const char *name) {
+    const char *attr = json_find(map, name);
+    return attr ? json_get_string(attr, "S") : NULL;
+}
 
-    if (res != CURLE_OK) {
-        fprintf(stderr, "curl error: %s\n", curl_easy_strerror(res));
-        free(resp.data);
-        return NULL;
+/*
+ * Reads the item key of a request body from its Key or Item, and with
+ * want_proj its ProjectionExpression and ExpressionAttributeNames.
+ */
+static int cache_key_of(const char *body, int want_proj, CacheKey *k) {
+    *k = (CacheKey){0};
+    const char *map = json_find(body, "Key");
+    if (!map)
+        map = json_find(body, "Item");
+    if (!map)
+        return -1;
+    k->pk = cache_attr(map, "pk");
+    k->sk = cache_attr(map, "sk");
+    if (!k->pk || !k->sk) {
+        cache_key_free(k);
+        return -1;
     }
-
-    return resp.data;
+    if (want_proj) {
+        k->proj = json_get_string(body, "ProjectionExpression");
+        k->names = json_get_raw(body, "ExpressionAttributeNames");
+    }
+    return 0;
 }
 
-/* ================================================================== */
-/* query response parsing                                               */
-/* ================================================================== */
+/* writes "pk\x1fsk\x1fproj\x1fnames" to out; returns the item part length */
+static size_t cache_key_text(const CacheKey *k, Buf *out) {
+    b_str(out, k->pk);
+    b_chr(out, '\x1f');
+    b_str(out, k->sk);
+    b_chr(out, '\x1f');
+    size_t item_len = out->n;
+    if (k->proj)
+        b_str(out, k->proj);
+    b_chr(out, '\x1f');
+    if (k->names)
+        b_str(out, k->names);
+    b_chr(out, '\0');
+    return item_len;
+}
 
-void item_list_free(ItemList *l) {
-    for (size_t i = 0; i < l->count; i++)
-        free(l->items[i]);
-    free(l->items);
-    l->items = NULL;
-    l->count = 0;
+/*
+ * Returns a copy of the cached wire item a GetItem body would read. On a
+ * miss *gen receives the stripe generation to pass to cache_store_body.
+ */
+static char *cache_lookup_body(const char *body, unsigned long *gen) {
+    *gen = 0;
+    if (!g_cache_max_bytes)
+        return NULL;
+    CacheKey k;
+    if (cache_key_of(body, 1, &k) != 0)
+        return NULL;
+    Buf key = {0};
+    size_t item_len = cache_key_text(&k, &key);
+    uint64_t h = cache_hash(k.pk, k.sk);
+    cache_key_free(&k);
+
+    CacheStripe *st = cache_stripe(h);
+    time_t now = time(NULL);
+    char *item = NULL;
+    pthread_mutex_lock(&st->lock);
+    CacheEntry **link = cache_bucket(st, h);
+    CacheEntry *exact = NULL, *full = NULL;
+    while (*link) {
+        CacheEntry *e = *link;
+        if (e->hash == h && e->item_key_len == item_len &&
+            memcmp(e->key, key.b, item_len) == 0) {
+            if (e->expires <= now) {
+                cache_drop(st, link, e);
+                continue;
+            }
+            if (strcmp(e->key, key.b) == 0)
+                exact = e;
+            else if (strcmp(e->key + item_len, "\x1f") == 0)
+                full = e;
+        }
+        link = &e->next;
+    }
+    CacheEntry *hit = exact ? exact : full;
+    if (hit) {
+        cache_lru_unlink(st, hit);
+        cache_lru_push(st, hit);
+        item = strdup(hit->item);
+        st->hits++;
+    } else {
+        st->misses++;
+        *gen = st->generation;
+    }
+    pthread_mutex_unlock(&st->lock);
+    free(key.b);
+    return item;
 }
 
 /*
- * Parses the Items array from a Query response.
- * Each item is unmarshalled before storage.
- * *out_last_key is set to a heap-allocated raw JSON string of LastEvaluatedKey,
- * or NULL if there are no more pages. Caller frees.
+ * Caches the wire item a GetItem body returned, unless the item's stripe
+ * saw a forget since the lookup that handed out gen.
  */
-static ItemList parse_query_items(const char *response, char **out_last_key) {
-    ItemList list = {0};
-    if (out_last_key)
-        *out_last_key = NULL;
+static void cache_store_body(const char *body, const char *item,
+                             unsigned long gen) {
+    size_t max_bytes = g_cache_max_bytes;
+    if (!max_bytes)
+        return;
+    CacheKey k;
+    if (cache_key_of(body, 1, &k) != 0)
+        return;
+    int ttl = cache_ttl(k.pk);
+    if (ttl <= 0) {
+        cache_key_free(&k);
+        return;
+    }
+    Buf key = {0};
+    size_t item_len = cache_key_text(&k, &key);
+    uint64_t h = cache_hash(k.pk, k.sk);
+    cache_key_free(&k);
+
+    size_t n = strlen(item) + 1;
+    size_t size = sizeof(CacheEntry) + key.n + n;
+    size_t budget = max_bytes / CACHE_STRIPES;
+    if (size > budget) {
+        free(key.b);
+        return;
+    }
+    CacheEntry *e = malloc(size);
+    if (!e) {
+        free(key.b);
+        return;
+    }
+    *e = (CacheEntry){.hash = h, .expires = time(NULL) + ttl, .size = size,
+                      .item_key_len = item_len};
+    e->key = (char *)(e + 1);
+    memcpy(e->key, key.b, key.n);
+    e->item = e->key + key.n;
+    memcpy(e->item, item, n);
+    free(key.b);
+
+    CacheStripe *st = cache_stripe(h);
+    pthread_mutex_lock(&st->lock);
+    if (st->generation != gen) {
+        pthread_mutex_unlock(&st->lock);
+        free(e);
+        return;
+    }
+    for (CacheEntry **link = cache_bucket(st, h); *link;
+         link = &(*link)->next) {
+        if (strcmp((*link)->key, e->key) == 0) {
+            cache_drop(st, link, *link);
+            break;
+        }
+    }
+    while (st->bytes + size > budget && st->oldest) {
+        cache_drop_entry(st, st->oldest);
+        st->evictions++;
+    }
+    CacheEntry **bucket = cache_bucket(st, h);
+    e->next = *bucket;
+    *bucket = e;
+    cache_lru_push(st, e);
+    st->bytes += size;
+    st->entries++;
+    pthread_mutex_unlock(&st->lock);
+}
 
-    char *items_raw = json_get_raw(response, "Items");
-    if (!items_raw)
-        return list;
+/* drops every cached read of the item (pk, sk) */
+static void cache_forget(const char *pk, const char *sk) {
+    uint64_t h = cache_hash(pk, sk);
+    size_t pn = strlen(pk), sn = strlen(sk);
+    CacheStripe *st = cache_stripe(h);
+    pthread_mutex_lock(&st->lock);
+    st->generation++;
+    CacheEntry **link = cache_bucket(st, h);
+    while (*link) {
+        CacheEntry *e = *link;
+        if (e->hash == h && e->item_key_len == pn + sn + 2 &&
+            memcmp(e->key, pk, pn) == 0 && memcmp(e->key + pn + 1, sk, sn) == 0) {
+            cache_drop(st, link, e);
+            st->invalidations++;
+            continue;
+        }
+        link = &e->next;
+    }
+    pthread_mutex_unlock(&st->lock);
+}
 
-    Cur c = {items_raw, 0};
-    ws(&c);
-    if (c.s[c.i] != '[') {
-        free(items_raw);
-        return list;
+/* drops every cached item under pk, for writes that span a partition */
+static void cache_forget_pk(const char *pk) {
+    size_t pn = strlen(pk);
+    for (int i = 0; i < CACHE_STRIPES; i++) {
+        CacheStripe *st = cache_stripe((uint64_t)i);
+        pthread_mutex_lock(&st->lock);
+        st->generation++;
+        CacheEntry *e = st->oldest;
+        while (e) {
+            CacheEntry *newer = e->newer;
+            if (memcmp(e->key, pk, pn) == 0 && e->key[pn] == '\x1f') {
+                cache_drop_entry(st, e);
+                st->invalidations++;
+            }
+            e = newer;
+        }
+        pthread_mutex_unlock(&st->lock);
     }
-    c.i++;
-    ws(&c);
+}
 
-    while (c.s[c.i] && c.s[c.i] != ']') {
-        Buf raw = {0};
-        copy_raw_value(&c, &raw);
+/* drops the item a PutItem, UpdateItem or DeleteItem body writes */
+static void cache_forget_body(const char *body) {
+    CacheKey k;
+    if (cache_key_of(body, 0, &k) != 0)
+        return;
+    cache_forget(k.pk, k.sk);
+    cache_key_free(&k);
+}
 
-        list.items = realloc(list.items, (list.count + 1) * sizeof(char *));
-        list.items[list.count++] = dynamo_unmarshal(raw.b);
-        free(raw.b);
+static int is_item_write(const char *target) {
+    return strcmp(target, "DynamoDB_20120810.PutItem") == 0 ||
+           strcmp(target, "DynamoDB_20120810.UpdateItem") == 0 ||
+           strcmp(target, "DynamoDB_20120810.DeleteItem") == 0;
+}
 
-        ws(&c);
-        if (c.s[c.i] == ',')
-            c.i++;
-        ws(&c);
+void dynamo_cache_configure(size_t max_bytes) {
+    pthread_mutex_lock(&g_cache_cfg_lock);
+    g_cache_max_bytes = max_bytes;
+    pthread_mutex_unlock(&g_cache_cfg_lock);
+    for (int i = 0; i < CACHE_STRIPES; i++) {
+        CacheStripe *st = cache_stripe((uint64_t)i);
+        pthread_mutex_lock(&st->lock);
+        while (st->bytes > max_bytes / CACHE_STRIPES && st->oldest) {
+            cache_drop_entry(st, st->oldest);
+            st->evictions++;
+        }
+        pthread_mutex_unlock(&st->lock);
     }
+}
 
-    free(items_raw);
-
-    if (out_last_key)
-        *out_last_key = json_get_raw(response, "LastEvaluatedKey");
+int dynamo_cache_set_ttl(const char *prefix, int seconds) {
+    int rc = 0;
+    pthread_mutex_lock(&g_cache_cfg_lock);
+    if (strcmp(prefix, "*") == 0) {
+        g_cache_default_ttl = seconds;
+    } else {
+        int i = 0;
+        while (i < g_cache_ttl_count && strcmp(g_cache_ttls[i].prefix, prefix))
+            i++;
+        if (i == CACHE_MAX_TTLS ||
+            strlen(prefix) >= sizeof(g_cache_ttls[i].prefix)) {
+            rc = -1;
+        } else {
+            if (i == g_cache_ttl_count) {
+                strcpy(g_cache_ttls[i].prefix, prefix);
+                g_cache_ttl_count++;
+            }
+            g_cache_ttls[i].ttl = seconds;
+        }
+    }
+    pthread_mutex_unlock(&g_cache_cfg_lock);
+    return rc;
+}
 
-    return list;
+void dynamo_cache_stats(DynamoCacheStats *out) {
+    *out = (DynamoCacheStats){0};
+    for (int i = 0; i < CACHE_STRIPES; i++) {
+        CacheStripe *st = cache_stripe((uint64_t)i);
+        pthread_mutex_lock(&st->lock);
+        out->hits += st->hits;
+        out->misses += st->misses;
+        out->evictions += st->evictions;
+        out->invalidations += st->invalidations;
+        out->entries += st->entries;
+        out->bytes += st->bytes;
+        pthread_mutex_unlock(&st->lock);
+    }
+    out->max_bytes = g_cache_max_bytes;
 }
 
 /* ================================================================== */
-/* helpers                                                              */
+/* curl layer                                                           */
 /* ================================================================== */
 
-static void str_upper(const char *src, char *dst) {
-    while (*src)
-        *dst++ = toupper((unsigned char)*src++);
-    *dst = '\0';
+static size_t write_cb(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    size_t real = size * nmemb;
+    ResponseBuf *buf = userdata;
+    char *tmp = realloc(buf->data, buf->len + real + 1);
+    if (!tmp)
+        return 0;
+    buf->data = tmp;
+    memcpy(buf->data + buf->len, ptr, real);
+    buf->len += real;
+    buf->data[buf->len] = '\0';
+    return real;
 }
 
-/* replace with your actual stemming logic */
-static const char *string_stem(const char *s) {
-    return s;
-}
+/* ================================================================== */
+/* client context                                                       */
+/* ================================================================== */
 
 /*
- * Returns 0 if owner check passes, -1 if forbidden.
- * item_json must be already unmarshalled (plain JSON).
+ * Credentials, endpoints and header lists are read from the environment
+ * once per process. The CURLSH gives every thread's handles one DNS cache
+ * and TLS session cache, so a new worker thread resolves nothing and resumes
+ * its first handshake. Connections are not shared: curl's connection cache
+ * is not safe to use from several threads at once, so each thread keeps its
+ * own through its persistent easy handles and tl_multi.
  */
-int check_owner(const char *item_json, const char *owner) {
-    if (!owner)
-        return 0;
 
-    char *item_owner = json_get_string(item_json, "OWNER");
-    if (!item_owner)
-        return 0; /* no OWNER field — pass */
+static const char *dynamo_targets[] = {
+    "DynamoDB_20120810.GetItem",        "DynamoDB_20120810.PutItem",
+    "DynamoDB_20120810.UpdateItem",     "DynamoDB_20120810.DeleteItem",
+    "DynamoDB_20120810.Query",          "DynamoDB_20120810.BatchGetItem",
+    "DynamoDB_20120810.BatchWriteItem", "DynamoDB_20120810.DescribeEndpoints",
+};
+#define DYNAMO_TARGET_COUNT (sizeof(dynamo_targets) / sizeof(*dynamo_targets))
 
-    if (strcmp(item_owner, owner) == 0) {
-        free(item_owner);
-        return 0;
+typedef struct {
+    int aws; /* credentials and region are present */
+    const char *table;
+    char userpwd[512];
+    char dynamo_url[128];
+    char dynamo_sigv4[128];
+    char lambda_url[192]; /* up to and including "functions/" */
+    char lambda_sigv4[128];
+    struct curl_slist *dynamo_hdrs[DYNAMO_TARGET_COUNT];
+    struct curl_slist *json_hdrs;
+    struct curl_slist *event_hdrs;
+    CURLSH *share;
+} ClientCtx;
+
+static ClientCtx g_client;
+static pthread_once_t g_client_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_share_locks[CURL_LOCK_DATA_LAST];
+
+static void share_lock(CURL *h, curl_lock_data data, curl_lock_access access,
+                       void *userptr) {
+    (void)h;
+    (void)access;
+    (void)userptr;
+    pthread_mutex_lock(&g_share_locks[data]);
+}
+
+static void share_unlock(CURL *h, curl_lock_data data, void *userptr) {
+    (void)h;
+    (void)userptr;
+    pthread_mutex_unlock(&g_share_locks[data]);
+}
+
+static void client_init_once(void) {
+    ClientCtx *ctx = &g_client;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&g_share_locks[i], NULL);
+    ctx->share = curl_share_init();
+    if (ctx->share) {
+        curl_share_setopt(ctx->share, CURLSHOPT_LOCKFUNC, share_lock);
+        curl_share_setopt(ctx->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+        curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(ctx->share, CURLSHOPT_SHARE,
+                          CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    ctx->json_hdrs =
+        curl_slist_append(NULL, "Content-Type: application/json");
+    ctx->event_hdrs =
+        curl_slist_append(NULL, "Content-Type: application/json");
+    ctx->event_hdrs =
+        curl_slist_append(ctx->event_hdrs, "X-Amz-Invocation-Type: Event");
+    for (size_t i = 0; i < DYNAMO_TARGET_COUNT; i++) {
+        char target_hdr[128];
+        snprintf(target_hdr, sizeof(target_hdr), "X-Amz-Target: %s",
+                 dynamo_targets[i]);
+        ctx->dynamo_hdrs[i] = curl_slist_append(
+            NULL, "Content-Type: application/x-amz-json-1.0");
+        ctx->dynamo_hdrs[i] =
+            curl_slist_append(ctx->dynamo_hdrs[i], target_hdr);
+    }
+
+    ctx->table = getenv("DYNAMO_TABLE_NAME");
+
+    const char *key_id = getenv("AWS_ACCESS_KEY_ID");
+    const char *secret = getenv("AWS_SECRET_ACCESS_KEY");
+    const char *region = getenv("AWS_REGION");
+    if (!key_id || !secret || !region)
+        return;
+
+    snprintf(ctx->userpwd, sizeof(ctx->userpwd), "%s:%s", key_id, secret);
+    snprintf(ctx->dynamo_url, sizeof(ctx->dynamo_url),
+             "https://dynamodb.%s.amazonaws.com/", region);
+    snprintf(ctx->dynamo_sigv4, sizeof(ctx->dynamo_sigv4),
+             "aws:amz:%s:dynamodb", region);
+    snprintf(ctx->lambda_url, sizeof(ctx->lambda_url),
+             "https://lambda.%s.amazonaws.com/2015-03-31/functions/", region);
+    snprintf(ctx->lambda_sigv4, sizeof(ctx->lambda_sigv4),
+             "aws:amz:%s:lambda", region);
+    ctx->aws = 1;
+}
+
+static const ClientCtx *client(void) {
+    pthread_once(&g_client_once, client_init_once);
+    return &g_client;
+}
+
+int dynamo_client_init(void) {
+    if (!client()->aws) {
+        fprintf(stderr, "AWS credentials/region missing\n");
+        return -1;
+    }
+    return 0;
+}
+
+const char *dynamo_table_name(void) { return client()->table; }
+
+/* returns the prebuilt header list for a DynamoDB target, or NULL */
+static struct curl_slist *dynamo_headers(const char *target) {
+    for (size_t i = 0; i < DYNAMO_TARGET_COUNT; i++) {
+        if (strcmp(dynamo_targets[i], target) == 0)
+            return client()->dynamo_hdrs[i];
+    }
+    return NULL;
+}
+
+/* ================================================================== */
+/* curl handles                                                         */
+/* ================================================================== */
+
+/*
+ * Creates a handle with the options every request on it shares. sigv4 is
+ * the signing scope for AWS services, or NULL for plain HTTP. Callers set
+ * only URL, body, headers and write target per request.
+ */
+static CURL *new_curl(const char *sigv4) {
+    const ClientCtx *ctx = client();
+    CURL *curl = curl_easy_init();
+    if (!curl)
+        return NULL;
+    if (ctx->share)
+        curl_easy_setopt(curl, CURLOPT_SHARE, ctx->share);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 10L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    if (sigv4) {
+        curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
+        curl_easy_setopt(curl, CURLOPT_USERPWD, ctx->userpwd);
+    }
+    return curl;
+}
+
+/* Thread-local curl handles — one per service endpoint, created once. */
+static __thread CURL *tl_dynamo_curl = NULL;
+static __thread CURL *tl_lambda_curl = NULL;
+static __thread CURL *tl_http_curl   = NULL;
+
+static CURL *get_curl(CURL **handle, const char *sigv4) {
+    if (!*handle)
+        *handle = new_curl(sigv4);
+    return *handle;
+}
+
+/*
+ * Points curl at a DynamoDB call. *headers is set to a one-off list for
+ * targets without a prebuilt one (else NULL) and must be freed by the
+ * caller once the transfer is done. Returns 0 on success, -1 on failure.
+ */
+static int dynamo_prepare(CURL *curl, const char *target, const char *body,
+                          struct curl_slist **headers, ResponseBuf *resp) {
+    const ClientCtx *ctx = client();
+    *headers = NULL;
+    if (!ctx->aws) {
+        fprintf(stderr, "AWS credentials/region missing\n");
+        return -1;
+    }
+
+    struct curl_slist *hdrs = dynamo_headers(target);
+    if (!hdrs) {
+        char target_hdr[128];
+        snprintf(target_hdr, sizeof(target_hdr), "X-Amz-Target: %s", target);
+        *headers = curl_slist_append(
+            NULL, "Content-Type: application/x-amz-json-1.0");
+        *headers = curl_slist_append(*headers, target_hdr);
+        hdrs = *headers;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, ctx->dynamo_url);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+    return 0;
+}
+
+/* makes a DynamoDB API call; returns raw response body, caller frees */
+static char *dynamo_request(const char *target, const char *body) {
+    CURL *curl = get_curl(&tl_dynamo_curl, client()->dynamo_sigv4);
+    if (!curl)
+        return NULL;
+
+    struct curl_slist *headers = NULL;
+    ResponseBuf resp = {0};
+    if (dynamo_prepare(curl, target, body, &headers, &resp) != 0)
+        return NULL;
+
+    CURLcode res = curl_easy_perform(curl);
+    curl_slist_free_all(headers);
+    /* even a failed write may have landed */
+    if (is_item_write(target))
+        cache_forget_body(body);
+
+    if (res != CURLE_OK) {
+        fprintf(stderr, "curl error: %s\n", curl_easy_strerror(res));
+        free(resp.data);
+        return NULL;
+    }
+
+    return resp.data;
+}
+
+/* ================================================================== */
+/* query response parsing                                               */
+/* ================================================================== */
+
+void item_list_free(ItemList *l) {
+    if (!l->external) { /* else released by the allocator's owner */
+        if (l->block) {
+            free(l->block);
+        } else {
+            for (size_t i = 0; i < l->count; i++)
+                free(l->items[i]);
+        }
+        free(l->items);
+    }
+    l->items = NULL;
+    l->count = 0;
+    l->block = NULL;
+    l->external = 0;
+}
+
+/*
+ * Unmarshalled items of one or more Query pages packed into one block.
+ * Each item is NUL-terminated; offs[i] is where item i starts. Offsets,
+ * not pointers, because the block moves as it grows. With data.a set the
+ * block grows in the caller's allocator, so the finished list needs no
+ * copy; offs is scratch and always malloc'd.
+ */
+typedef struct {
+    Buf data;
+    size_t *offs;
+    size_t count, cap;
+    int wire; /* copy items as-is instead of unmarshalling */
+} ItemSink;
+
+static ItemSink item_sink_new(const DynamoAlloc *a) {
+    ItemSink sink = {0};
+    sink.data.a = a;
+    sink.wire = a && a->wire;
+    return sink;
+}
+
+static void item_sink_free(ItemSink *sink) {
+    if (!sink->data.a)
+        free(sink->data.b);
+    free(sink->offs);
+    *sink = (ItemSink){0};
+}
+
+/* hands the block to an ItemList; the sink is left empty */
+static ItemList item_sink_finish(ItemSink *sink) {
+    ItemList list = {0};
+    const DynamoAlloc *a = sink->data.a;
+    if (!sink->count) {
+        item_sink_free(sink);
+        return list;
+    }
+    size_t size = sink->count * sizeof(char *);
+    list.items = a ? a->grow(a->ctx, NULL, 0, size) : malloc(size);
+    for (size_t i = 0; i < sink->count; i++)
+        list.items[i] = sink->data.b + sink->offs[i];
+    list.count = sink->count;
+    list.block = sink->data.b;
+    list.external = a != NULL;
+    free(sink->offs);
+    *sink = (ItemSink){0};
+    return list;
+}
+
+/*
+ * Decodes a Query response in one walk over its top-level object. Items
+ * are unmarshalled straight from the response into sink, without first
+ * copying each raw item out. *out_last_key is set to a heap-allocated raw
+ * JSON string of LastEvaluatedKey, or NULL if there are no more pages.
+ * Caller frees. Other keys (Count, ScannedCount, ...) are skipped in place.
+ */
+static void decode_query_page(const char *response, ItemSink *sink,
+                              char **out_last_key) {
+    if (out_last_key)
+        *out_last_key = NULL;
+    if (!response)
+        return;
+
+    Cur c = {response, 0};
+    ws(&c);
+    if (c.s[c.i] != '{')
+        return;
+    c.i++;
+    while (1) {
+        ws(&c);
+        const char *k;
+        size_t kn;
+        if (!str_span(&c, &k, &kn))
+            break;
+        ws(&c);
+        if (c.s[c.i] == ':')
+            c.i++;
+        ws(&c);
+
+        if (span_is(k, kn, "Items") && c.s[c.i] == '[') {
+            c.i++;
+            ws(&c);
+            while (c.s[c.i] && c.s[c.i] != ']') {
+                if (sink->count == sink->cap) {
+                    sink->cap = sink->cap ? sink->cap * 2 : 16;
+                    sink->offs =
+                        realloc(sink->offs, sink->cap * sizeof(size_t));
+                }
+                sink->offs[sink->count++] = sink->data.n;
+                if (sink->wire)
+                    copy_raw_value(&c, &sink->data);
+                else
+                    unmarshal_value(&c, &sink->data);
+                b_chr(&sink->data, '\0');
+
+                ws(&c);
+                if (c.s[c.i] == ',')
+                    c.i++;
+                ws(&c);
+            }
+            if (c.s[c.i] == ']')
+                c.i++;
+        } else if (span_is(k, kn, "LastEvaluatedKey") && out_last_key) {
+            Buf key = {0};
+            copy_raw_value(&c, &key);
+            *out_last_key = key.b;
+        } else {
+            skip_value(&c);
+        }
+
+        ws(&c);
+        if (c.s[c.i] == ',')
+            c.i++;
+    }
+}
+
+/* ================================================================== */
+/* helpers                                                              */
+/* ================================================================== */
+
+static void str_upper(const char *src, char *dst) {
+    while (*src)
+        *dst++ = toupper((unsigned char)*src++);
+    *dst = '\0';
+}
+
+/* replace with your actual stemming logic */
+static const char *string_stem(const char *s) {
+    return s;
+}
+
+/*
+ * Returns 0 if owner check passes, -1 if forbidden.
+ * item_json must be already unmarshalled (plain JSON).
+ */
+int check_owner(const char *item_json, const char *owner) {
+    if (!owner)
+        return 0;
+
+    char *item_owner = json_get_string(item_json, "OWNER");
+    if (!item_owner)
+        return 0; /* no OWNER field — pass */
+
+    if (strcmp(item_owner, owner) == 0) {
+        free(item_owner);
+        return 0;
     }
 
     /* check sharedWith array */
@@ -717,47 +1590,260 @@ static void append_exclusive_start_key(Buf *body, const char *last_key) {
 }
 
 /* ================================================================== */
-/* dynamo operations                                                    */
+/* request bodies                                                       */
 /* ================================================================== */
 
 /*
- * Returns heap-allocated unmarshalled JSON of the Item, or NULL if not found.
- * Caller frees.
+ * Builders shared by the blocking calls and the async batch API.
+ * Each returns a heap-allocated request body, or NULL on failure.
  */
-char *get_item_pk_sk(const char *prefix, const char *pk, const char *sk) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+
+/* writes the stored pk/sk attribute values for a (prefix, pk, sk) key */
+static void item_key_values(const char *prefix, const char *pk,
+                            const char *sk, char pk_val[512],
+                            char sk_val[512]) {
+    char upper[64];
+    str_upper(prefix, upper);
+    snprintf(pk_val, 512, "%s#%s", upper, string_stem(pk));
+    snprintf(sk_val, 512, "%s#%s", upper, string_stem(sk));
+}
+
+/*
+ * GetItem body; proj (a ProjectionExpression) and names (its
+ * ExpressionAttributeNames entries as a JSON fragment) may be NULL.
+ */
+static char *get_item_proj_body(const char *prefix, const char *pk,
+                                const char *sk, const char *proj,
+                                const char *names) {
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return NULL;
     }
 
-    char upper[64];
-    str_upper(prefix, upper);
     char pk_val[512], sk_val[512];
-    snprintf(pk_val, sizeof(pk_val), "%s#%s", upper, string_stem(pk));
-    snprintf(sk_val, sizeof(sk_val), "%s#%s", upper, string_stem(sk));
+    item_key_values(prefix, pk, sk, pk_val, sk_val);
 
     Buf body = {0};
     b_fmt(&body,
           "{\"TableName\":\"%s\","
-          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}}}",
+          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}}",
           table, pk_val, sk_val);
+    if (proj && proj[0])
+        b_fmt(&body, ",\"ProjectionExpression\":\"%s\"", proj);
+    if (names && names[0])
+        b_fmt(&body, ",\"ExpressionAttributeNames\":{%s}", names);
+    b_chr(&body, '}');
+    return body.b;
+}
 
-    char *resp = dynamo_request("DynamoDB_20120810.GetItem", body.b);
-    free(body.b);
-    if (!resp)
+static char *get_item_body(const char *prefix, const char *pk,
+                           const char *sk) {
+    return get_item_proj_body(prefix, pk, sk, NULL, NULL);
+}
+
+/* runs the owner check on plain JSON, then marshals it into a PutItem body */
+static char *put_item_plain_body(const char *plain_json, const char *owner) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return NULL;
+    }
 
-    char *item_raw = json_get_raw(resp, "Item");
-    free(resp);
-    if (!item_raw)
+    if (owner && check_owner(plain_json, owner) != 0) {
+        fprintf(stderr, "403\n");
         return NULL;
+    }
+
+    char *wire = dynamo_marshal(plain_json);
+    if (!wire)
+        return NULL;
+
+    Buf body = {0};
+    b_str(&body, "{\"TableName\":\"");
+    b_str(&body, table);
+    b_str(&body, "\",\"Item\":");
+    b_str(&body, wire);
+    b_chr(&body, '}');
+    free(wire);
+    return body.b;
+}
+
+static char *update_approvals_body(const char *email) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "update_approvals: DYNAMO_TABLE_NAME not defined\n");
+        return NULL;
+    }
+
+    char pk_val[512];
+    snprintf(pk_val, sizeof(pk_val), "USER#%s", email);
+
+    Buf body = {0};
+    b_fmt(&body,
+          "{\"TableName\":\"%s\","
+          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
+          "\"UpdateExpression\":\"SET #sub.#ap = if_not_exists(#sub.#ap, :zero) + :one\","
+          "\"ExpressionAttributeNames\":{\"#sub\":\"subscriptionInfo\",\"#ap\":\"approvals\"},"
+          "\"ExpressionAttributeValues\":{\":one\":{\"N\":\"1\"},\":zero\":{\"N\":\"0\"}}}",
+          table, pk_val, pk_val);
+    return body.b;
+}
+
+/*
+ * upsert_append_list is two UpdateItems: *ensure creates the hourly map,
+ * *append adds the value to it. Both must be sent in that order.
+ * Returns 0 on success, -1 on failure.
+ */
+static int upsert_append_list_bodies(const char *list_key, const char *value,
+                                     const char *prefix, char **ensure,
+                                     char **append) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "upsert_append_list: DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
 
-    char *result = dynamo_unmarshal(item_raw);
-    free(item_raw);
+    /* Mountain Time = UTC-7 (MST; close enough without DST detection) */
+    time_t now = time(NULL) - 7 * 3600;
+    struct tm t;
+    gmtime_r(&now, &t);
+    char date_str[12];
+    strftime(date_str, sizeof(date_str), "%Y-%m-%d", &t);
+    char attr_name[32];
+    snprintf(attr_name, sizeof(attr_name), "lists_%d", t.tm_hour);
+
+    char pk_val[640];
+    snprintf(pk_val, sizeof(pk_val), "%sLOG#%s", prefix, date_str);
+
+    /* JSON-escape value into a buffer */
+    Buf esc = {0};
+    for (const char *p = value; *p; p++) {
+        if (*p == '"')       { b_chr(&esc, '\\'); b_chr(&esc, '"'); }
+        else if (*p == '\\') { b_chr(&esc, '\\'); b_chr(&esc, '\\'); }
+        else                   b_chr(&esc, *p);
+    }
+    if (!esc.b) esc.b = strdup("");
+
+    /* Step 1: ensure the outer map attribute exists */
+    Buf body1 = {0};
+    b_fmt(&body1,
+          "{\"TableName\":\"%s\","
+          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
+          "\"UpdateExpression\":\"SET #lists = if_not_exists(#lists, :empty)\","
+          "\"ExpressionAttributeNames\":{\"#lists\":\"%s\"},"
+          "\"ExpressionAttributeValues\":{\":empty\":{\"M\":{}}}}",
+          table, pk_val, pk_val, attr_name);
+
+    /* Step 2: append value to the list */
+    Buf body2 = {0};
+    b_fmt(&body2,
+          "{\"TableName\":\"%s\","
+          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
+          "\"UpdateExpression\":\"SET #lists.#k = list_append(if_not_exists(#lists.#k, :empty), :val)\","
+          "\"ExpressionAttributeNames\":{\"#lists\":\"%s\",\"#k\":\"%s\"},"
+          "\"ExpressionAttributeValues\":{"
+          "\":empty\":{\"L\":[]},"
+          "\":val\":{\"L\":[{\"S\":\"%s\"}]}"
+          "}}",
+          table, pk_val, pk_val, attr_name, list_key, esc.b);
+    free(esc.b);
+
+    *ensure = body1.b;
+    *append = body2.b;
+    return 0;
+}
+
+/* returns the wire Item a GetItem body reads, through the cache; caller frees */
+static char *get_item_cached(const char *body) {
+    unsigned long gen;
+    char *item = cache_lookup_body(body, &gen);
+    if (item)
+        return item;
+
+    char *resp = dynamo_request("DynamoDB_20120810.GetItem", body);
+    if (!resp)
+        return NULL;
+    item = json_get_raw(resp, "Item");
+    free(resp);
+    if (item)
+        cache_store_body(body, item, gen);
+    return item;
+}
+
+/* unmarshals and frees a wire item */
+static char *unmarshal_owned(char *item) {
+    if (!item)
+        return NULL;
+    char *result = dynamo_unmarshal(item);
+    free(item);
     return result;
 }
 
+/* ================================================================== */
+/* dynamo operations                                                    */
+/* ================================================================== */
+
+/*
+ * Returns heap-allocated unmarshalled JSON of the Item, or NULL if not found.
+ * Caller frees. Served from the item cache when possible.
+ */
+char *get_item_pk_sk(const char *prefix, const char *pk, const char *sk) {
+    char *body = get_item_body(prefix, pk, sk);
+    if (!body)
+        return NULL;
+    char *item = get_item_cached(body);
+    free(body);
+    return unmarshal_owned(item);
+}
+
+/*
+ * Like get_item_pk_sk, but reads only the attributes in proj, so existence
+ * and ACL checks do not pay for large items. names holds the
+ * ExpressionAttributeNames entries proj refers to, e.g. "\"#o\":\"OWNER\"",
+ * or NULL. A cached full item may answer it with extra attributes.
+ */
+char *get_item_pk_sk_proj(const char *prefix, const char *pk, const char *sk,
+                          const char *proj, const char *names) {
+    char *body = get_item_proj_body(prefix, pk, sk, proj, names);
+    if (!body)
+        return NULL;
+    char *item = get_item_cached(body);
+    free(body);
+    return unmarshal_owned(item);
+}
+
+/*
+ * Like get_item_pk_sk, but returns the Item still in DynamoDB wire format,
+ * allocated through alloc (malloc when NULL). NULL if not found.
+ */
+char *get_item_pk_sk_wire(const char *prefix, const char *pk, const char *sk,
+                          const DynamoAlloc *alloc) {
+    char *body = get_item_body(prefix, pk, sk);
+    if (!body)
+        return NULL;
+    char *item = get_item_cached(body);
+    free(body);
+    if (!item || !alloc)
+        return item;
+
+    Buf out = {.a = alloc};
+    b_str(&out, item);
+    b_chr(&out, '\0');
+    free(item);
+    return out.b;
+}
+
+/*
+ * Drops every cached read of (prefix, pk, sk), for items another service
+ * just rewrote.
+ */
+void dynamo_cache_forget(const char *prefix, const char *pk, const char *sk) {
+    char pk_val[512], sk_val[512];
+    item_key_values(prefix, pk, sk, pk_val, sk_val);
+    cache_forget(pk_val, sk_val);
+}
+
 /*
  * Returns 0 on success, -1 on failure.
  * Verifies the item exists before deleting.
@@ -765,7 +1851,7 @@ char *get_item_pk_sk(const char *prefix, const char *pk, const char *sk) {
  */
 int delete_item_pk_sk(const char *prefix, const char *pk, const char *sk,
                       const char *owner) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return -1;
@@ -812,42 +1898,36 @@ void iso_timestamp(char *buf, size_t len) {
 }
 
 int save_item_plain(const char *plain_json, const char *owner) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
-    if (!table) {
-        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
-        return -1;
-    }
-
-    if (owner && check_owner(plain_json, owner) != 0) {
-        fprintf(stderr, "403\n");
-        return -1;
-    }
+    char *body = put_item_plain_body(plain_json, owner);
+    if (!body) return -1;
 
-    char *wire = dynamo_marshal(plain_json);
-    if (!wire) return -1;
-
-    Buf body = {0};
-    b_str(&body, "{\"TableName\":\"");
-    b_str(&body, table);
-    b_str(&body, "\",\"Item\":");
-    b_str(&body, wire);
-    b_chr(&body, '}');
-    free(wire);
-
-    char *resp = dynamo_request("DynamoDB_20120810.PutItem", body.b);
-    free(body.b);
+    char *resp = dynamo_request("DynamoDB_20120810.PutItem", body);
+    free(body);
     if (!resp) return -1;
     free(resp);
     return 0;
 }
 
+/*
+ * Sends a complete PutItem body built by the caller, e.g. by a typed
+ * encoder that already ran the owner check. Returns 0 on success, -1 on
+ * failure.
+ */
+int put_item_encoded(const char *body) {
+    char *resp = dynamo_request("DynamoDB_20120810.PutItem", body);
+    if (!resp)
+        return -1;
+    free(resp);
+    return 0;
+}
+
 /*
  * Deletes all items with the given pk, in batches of 25.
  * Returns the number of deleted items, or -1 on error.
  * Pass owner=NULL to skip ownership check.
  */
 int delete_items_pk(const char *prefix, const char *pk, const char *owner) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return -1;
@@ -859,7 +1939,7 @@ int delete_items_pk(const char *prefix, const char *pk, const char *owner) {
     snprintf(pk_val, sizeof(pk_val), "%s#%s", upper, string_stem(pk));
 
     /* query all items with this pk, paginating */
-    ItemList all = {0};
+    ItemSink sink = {0};
     char *last_key = NULL;
 
     do {
@@ -876,28 +1956,17 @@ int delete_items_pk(const char *prefix, const char *pk, const char *owner) {
         char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
         free(body.b);
         if (!resp) {
-            item_list_free(&all);
+            item_sink_free(&sink);
             return -1;
         }
 
-        ItemList page = parse_query_items(resp, &last_key);
+        decode_query_page(resp, &sink, &last_key);
         free(resp);
-
-        /* merge page into all */
-        if (page.count) {
-            all.items =
-                realloc(all.items, (all.count + page.count) * sizeof(char *));
-            memcpy(all.items + all.count, page.items,
-                   page.count * sizeof(char *));
-            all.count += page.count;
-            free(page.items);
-        }
     } while (last_key);
 
-    if (all.count == 0) {
-        free(all.items);
+    ItemList all = item_sink_finish(&sink);
+    if (all.count == 0)
         return 0;
-    }
 
     /* ownership check */
     if (owner) {
@@ -947,36 +2016,351 @@ int delete_items_pk(const char *prefix, const char *pk, const char *owner) {
         deleted += (int)(end - i);
     }
 
+    cache_forget_pk(pk_val);
     item_list_free(&all);
     return deleted;
 }
 
+/* ================================================================== */
+/* batch get                                                            */
+/* ================================================================== */
+
+#define BATCH_GET_MAX 100
+#define BATCH_GET_ATTEMPTS 8
+#define BATCH_GET_BACKOFF_MS 50
+
+typedef struct {
+    char pk[512];
+    char sk[512];
+} KeyVals;
+
+/* sleeps for base * 2^attempt ms, capped at 2s, with up to 50% jitter */
+static void backoff_sleep(int attempt) {
+    long ms = (long)BATCH_GET_BACKOFF_MS << attempt;
+    if (ms > 2000)
+        ms = 2000;
+    ms = ms / 2 + rand() % (ms / 2 + 1);
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
 /*
- * Queries GSI "OWNER-DATATYPE-index".
- * Returns ItemList of unmarshalled items; caller must call item_list_free().
+ * Builds a BatchGetItem body for every key not yet in have. Repeated keys
+ * are sent once, DynamoDB rejects a request that names the same key twice.
+ */
+static char *batch_get_body(const char *table, const KeyVals *vals, size_t n,
+                            const ItemList *have) {
+    Buf body = {0};
+    b_fmt(&body, "{\"RequestItems\":{\"%s\":{\"Keys\":[", table);
+    int first = 1;
+    for (size_t i = 0; i < n; i++) {
+        if (have->items[i])
+            continue;
+        int dup = 0;
+        for (size_t j = 0; j < i && !dup; j++)
+            dup = strcmp(vals[i].pk, vals[j].pk) == 0 &&
+                  strcmp(vals[i].sk, vals[j].sk) == 0;
+        if (dup)
+            continue;
+        b_fmt(&body, "%s{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}}",
+              first ? "" : ",", vals[i].pk, vals[i].sk);
+        first = 0;
+    }
+    b_str(&body, "]}}}");
+    return body.b;
+}
+
+/* stores each item of a Responses array under every key it matches */
+static void batch_get_collect(const char *items_raw, const KeyVals *vals,
+                              size_t n, ItemList *out) {
+    Cur c = {items_raw, 0};
+    ws(&c);
+    if (c.s[c.i] != '[')
+        return;
+    c.i++;
+    ws(&c);
+
+    while (c.s[c.i] && c.s[c.i] != ']') {
+        Buf raw = {0};
+        copy_raw_value(&c, &raw);
+        char *item = dynamo_unmarshal(raw.b);
+        free(raw.b);
+
+        char *pk = item ? json_get_string(item, "pk") : NULL;
+        char *sk = item ? json_get_string(item, "sk") : NULL;
+        for (size_t i = 0; pk && sk && i < n; i++) {
+            if (out->items[i] || strcmp(vals[i].pk, pk) != 0 ||
+                strcmp(vals[i].sk, sk) != 0)
+                continue;
+            out->items[i] = item;
+            item = strdup(item); /* repeated keys each get their own copy */
+        }
+        free(pk);
+        free(sk);
+        free(item);
+
+        ws(&c);
+        if (c.s[c.i] == ',')
+            c.i++;
+        ws(&c);
+    }
+}
+
+/*
+ * BatchGetItem for up to 100 keys. UnprocessedKeys and throttled requests
+ * are resent with exponential backoff. On success the list has exactly n
+ * entries aligned with keys; items[i] is NULL when keys[i] does not exist.
+ * On failure an empty list is returned. Caller must call item_list_free().
  */
-ItemList get_items_owner_dt(const char *user_id, const char *datatype) {
+ItemList batch_get_items(const ItemKey *keys, size_t n) {
     ItemList result = {0};
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    if (n == 0)
+        return result;
+    if (n > BATCH_GET_MAX) {
+        fprintf(stderr, "batch_get_items: %zu keys, max is %d\n", n,
+                BATCH_GET_MAX);
+        return result;
+    }
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return result;
     }
 
+    KeyVals *vals = malloc(n * sizeof(KeyVals));
+    for (size_t i = 0; i < n; i++)
+        item_key_values(keys[i].prefix, keys[i].pk, keys[i].sk, vals[i].pk,
+                        vals[i].sk);
+
+    result.items = calloc(n, sizeof(char *));
+    result.count = n;
+
+    char *body = batch_get_body(table, vals, n, &result);
+    for (int attempt = 0;; attempt++) {
+        char *resp = dynamo_request("DynamoDB_20120810.BatchGetItem", body);
+        free(body);
+        body = NULL;
+        if (!resp)
+            goto fail;
+
+        char *responses = json_get_raw(resp, "Responses");
+        if (!responses) {
+            /* a throttled request is retried whole, other errors fail */
+            char *type = json_get_string(resp, "__type");
+            int throttled = type && (strstr(type, "ProvisionedThroughput") ||
+                                     strstr(type, "Throttling"));
+            if (!throttled)
+                fprintf(stderr, "batch_get_items: %s\n", type ? type : resp);
+            free(type);
+            free(resp);
+            if (!throttled || attempt + 1 >= BATCH_GET_ATTEMPTS)
+                goto fail;
+            backoff_sleep(attempt);
+            body = batch_get_body(table, vals, n, &result);
+            continue;
+        }
+
+        char *items_raw = json_get_raw(responses, table);
+        free(responses);
+        if (items_raw) {
+            batch_get_collect(items_raw, vals, n, &result);
+            free(items_raw);
+        }
+
+        /* UnprocessedKeys is {} when done, else {table: {"Keys": [...]}} */
+        char *unprocessed = json_get_raw(resp, "UnprocessedKeys");
+        char *pending = unprocessed ? json_get_raw(unprocessed, table) : NULL;
+        free(unprocessed);
+        free(resp);
+        if (!pending)
+            break;
+
+        if (attempt + 1 >= BATCH_GET_ATTEMPTS) {
+            fprintf(stderr,
+                    "batch_get_items: keys unprocessed after %d attempts\n",
+                    attempt + 1);
+            free(pending);
+            goto fail;
+        }
+        backoff_sleep(attempt);
+        Buf next = {0};
+        b_fmt(&next, "{\"RequestItems\":{\"%s\":", table);
+        b_str(&next, pending);
+        b_str(&next, "}}");
+        free(pending);
+        body = next.b;
+    }
+
+    free(vals);
+    return result;
+
+fail:
+    free(vals);
+    item_list_free(&result);
+    return result;
+}
+
+/*
+ * Request bodies of the list queries below, up to but excluding Limit,
+ * ExclusiveStartKey and the closing brace; see append_exclusive_start_key.
+ */
+static Buf datatype_pk_query(const char *table, const char *datatype,
+                             const char *pk) {
+    char pk_val[512];
+    snprintf(pk_val, sizeof(pk_val), "%s#%s", datatype, string_stem(pk));
+
+    Buf body = {0};
+    b_fmt(&body,
+          "{\"TableName\":\"%s\","
+          "\"IndexName\":\"DATATYPE-pk-index\","
+          "\"KeyConditionExpression\":\"DATATYPE = :datatype and pk = :pk\","
+          "\"ExpressionAttributeValues\":{"
+          "\":datatype\":{\"S\":\"%s\"},"
+          "\":pk\":{\"S\":\"%s\"}"
+          "}",
+          table, datatype, pk_val);
+    return body;
+}
+
+static Buf owner_dt_query(const char *table, const char *user_id,
+                          const char *datatype) {
+    Buf body = {0};
+    b_fmt(&body,
+          "{\"TableName\":\"%s\","
+          "\"IndexName\":\"OWNER-DATATYPE-index\","
+          "\"KeyConditionExpression\":\"#owner = :owner and DATATYPE = "
+          ":datatype\","
+          "\"ExpressionAttributeNames\":{\"#owner\":\"OWNER\"},"
+          "\"ExpressionAttributeValues\":{"
+          "\":owner\":{\"S\":\"%s\"},"
+          "\":datatype\":{\"S\":\"%s\"}"
+          "}",
+          table, user_id, datatype);
+    return body;
+}
+
+static Buf owner_dt_proj_query(const char *table, const char *user_id,
+                               const char *datatype, const char *proj_expr,
+                               const char *extra_names) {
+    Buf body = {0};
+    b_fmt(&body,
+          "{\"TableName\":\"%s\","
+          "\"IndexName\":\"OWNER-DATATYPE-index\","
+          "\"KeyConditionExpression\":\"#owner = :owner and DATATYPE = :datatype\","
+          "\"ProjectionExpression\":\"%s\","
+          "\"ExpressionAttributeNames\":{\"#owner\":\"OWNER\"",
+          table, proj_expr);
+    if (extra_names && extra_names[0]) {
+        b_str(&body, ",");
+        b_str(&body, extra_names);
+    }
+    b_fmt(&body,
+          "},"
+          "\"ExpressionAttributeValues\":{"
+          "\":owner\":{\"S\":\"%s\"},"
+          "\":datatype\":{\"S\":\"%s\"}"
+          "}",
+          user_id, datatype);
+    return body;
+}
+
+/*
+ * Runs the Query in base page by page, handing each page's unmarshalled
+ * items to fn before the next page is requested. One page buffer is
+ * reused throughout, so memory stays at the largest page rather than the
+ * whole result. Takes ownership of base.
+ */
+static int query_pages(Buf base, ItemPageFn fn, void *ctx) {
+    ItemSink sink = item_sink_new(NULL);
+    const char **ptrs = NULL;
+    size_t ptrs_cap = 0;
     char *last_key = NULL;
+    int rc = 0;
     do {
         Buf body = {0};
-        b_fmt(&body,
-              "{\"TableName\":\"%s\","
-              "\"IndexName\":\"OWNER-DATATYPE-index\","
-              "\"KeyConditionExpression\":\"#owner = :owner and DATATYPE = "
-              ":datatype\","
-              "\"ExpressionAttributeNames\":{\"#owner\":\"OWNER\"},"
-              "\"ExpressionAttributeValues\":{"
-              "\":owner\":{\"S\":\"%s\"},"
-              "\":datatype\":{\"S\":\"%s\"}"
-              "}",
-              table, user_id, datatype);
+        b_write(&body, base.b, base.n);
+        append_exclusive_start_key(&body, last_key);
+        free(last_key);
+        last_key = NULL;
+
+        char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
+        free(body.b);
+        if (!resp) {
+            rc = -1;
+            break;
+        }
+
+        sink.data.n = 0;
+        sink.count = 0;
+        decode_query_page(resp, &sink, &last_key);
+        free(resp);
+        if (!sink.count)
+            continue;
+
+        /* the block may have moved while the page was decoded */
+        if (sink.count > ptrs_cap) {
+            ptrs_cap = sink.cap;
+            ptrs = realloc(ptrs, ptrs_cap * sizeof(char *));
+        }
+        for (size_t i = 0; i < sink.count; i++)
+            ptrs[i] = sink.data.b + sink.offs[i];
+        if (fn(ctx, ptrs, sink.count) != 0)
+            break;
+    } while (last_key);
+
+    free(last_key);
+    free(ptrs);
+    free(base.b);
+    item_sink_free(&sink);
+    return rc;
+}
+
+/*
+ * Runs a single page of the Query in base. limit > 0 is sent as Limit and
+ * start_key, a LastEvaluatedKey from an earlier page, as ExclusiveStartKey.
+ * Takes ownership of base.
+ */
+static int query_one_page(Buf base, int limit, const char *start_key,
+                          const DynamoAlloc *alloc, ItemList *out,
+                          char **next_key) {
+    *out = (ItemList){0};
+    *next_key = NULL;
+    if (limit > 0)
+        b_fmt(&base, ",\"Limit\":%d", limit);
+    append_exclusive_start_key(&base, start_key);
+
+    char *resp = dynamo_request("DynamoDB_20120810.Query", base.b);
+    free(base.b);
+    if (!resp)
+        return -1;
+
+    ItemSink sink = item_sink_new(alloc);
+    decode_query_page(resp, &sink, next_key);
+    free(resp);
+    *out = item_sink_finish(&sink);
+    return 0;
+}
+
+/*
+ * Queries GSI "OWNER-DATATYPE-index".
+ * Returns ItemList of unmarshalled items, allocated through alloc (NULL for
+ * malloc); caller must call item_list_free().
+ */
+ItemList get_items_owner_dt(const char *user_id, const char *datatype,
+                            const DynamoAlloc *alloc) {
+    ItemList result = {0};
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return result;
+    }
+
+    Buf base = owner_dt_query(table, user_id, datatype);
+    ItemSink sink = item_sink_new(alloc);
+    char *last_key = NULL;
+    do {
+        Buf body = {0};
+        b_write(&body, base.b, base.n);
         append_exclusive_start_key(&body, last_key);
         free(last_key);
         last_key = NULL;
@@ -984,53 +2368,51 @@ ItemList get_items_owner_dt(const char *user_id, const char *datatype) {
         char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
         free(body.b);
         if (!resp) {
-            item_list_free(&result);
+            free(base.b);
+            item_sink_free(&sink);
             return (ItemList){0};
         }
 
-        ItemList page = parse_query_items(resp, &last_key);
+        decode_query_page(resp, &sink, &last_key);
         free(resp);
-
-        if (page.count) {
-            result.items = realloc(result.items, (result.count + page.count) *
-                                                     sizeof(char *));
-            memcpy(result.items + result.count, page.items,
-                   page.count * sizeof(char *));
-            result.count += page.count;
-            free(page.items);
-        }
     } while (last_key);
 
-    return result;
+    free(base.b);
+    return item_sink_finish(&sink);
+}
+int get_items_owner_dt_page(const char *user_id, const char *datatype,
+                            int limit, const char *start_key,
+                            const DynamoAlloc *alloc, ItemList *out,
+                            char **next_key) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
+    return query_one_page(owner_dt_query(table, user_id, datatype), limit,
+                          start_key, alloc, out, next_key);
 }
+
 /*
  * Queries GSI "DATATYPE-pk-index" with pagination.
- * Returns ItemList of unmarshalled items; caller must call item_list_free().
+ * Returns ItemList of unmarshalled items, allocated through alloc (NULL for
+ * malloc); caller must call item_list_free().
  */
-ItemList get_items_datatype_pk(const char *datatype, const char *pk) {
+ItemList get_items_datatype_pk(const char *datatype, const char *pk,
+                               const DynamoAlloc *alloc) {
     ItemList result = {0};
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return result;
     }
 
-    char pk_val[512];
-    snprintf(pk_val, sizeof(pk_val), "%s#%s", datatype, string_stem(pk));
-
+    Buf base = datatype_pk_query(table, datatype, pk);
+    ItemSink sink = item_sink_new(alloc);
     char *last_key = NULL;
     do {
         Buf body = {0};
-        b_fmt(
-            &body,
-            "{\"TableName\":\"%s\","
-            "\"IndexName\":\"DATATYPE-pk-index\","
-            "\"KeyConditionExpression\":\"DATATYPE = :datatype and pk = :pk\","
-            "\"ExpressionAttributeValues\":{"
-            "\":datatype\":{\"S\":\"%s\"},"
-            "\":pk\":{\"S\":\"%s\"}"
-            "}",
-            table, datatype, pk_val);
+        b_write(&body, base.b, base.n);
         append_exclusive_start_key(&body, last_key);
         free(last_key);
         last_key = NULL;
@@ -1038,34 +2420,51 @@ ItemList get_items_datatype_pk(const char *datatype, const char *pk) {
         char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
         free(body.b);
         if (!resp) {
-            item_list_free(&result);
+            free(base.b);
+            item_sink_free(&sink);
             return (ItemList){0};
         }
 
-        ItemList page = parse_query_items(resp, &last_key);
+        decode_query_page(resp, &sink, &last_key);
         free(resp);
-
-        if (page.count) {
-            result.items = realloc(result.items, (result.count + page.count) *
-                                                     sizeof(char *));
-            memcpy(result.items + result.count, page.items,
-                   page.count * sizeof(char *));
-            result.count += page.count;
-            free(page.items);
-        }
     } while (last_key);
 
-    return result;
+    free(base.b);
+    return item_sink_finish(&sink);
+}
+
+int get_items_datatype_pk_page(const char *datatype, const char *pk,
+                               int limit, const char *start_key,
+                               const DynamoAlloc *alloc, ItemList *out,
+                               char **next_key) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
+    return query_one_page(datatype_pk_query(table, datatype, pk), limit,
+                          start_key, alloc, out, next_key);
+}
+
+int get_items_datatype_pk_pages(const char *datatype, const char *pk,
+                                ItemPageFn fn, void *ctx) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
+    return query_pages(datatype_pk_query(table, datatype, pk), fn, ctx);
 }
 
 /*
  * Queries GSI "OWNER-pk-index" with pagination.
- * Returns ItemList of unmarshalled items; caller must call item_list_free().
+ * Returns ItemList of unmarshalled items, allocated through alloc (NULL for
+ * malloc); caller must call item_list_free().
  */
 ItemList get_items_owner_pk(const char *prefix, const char *user_id,
-                            const char *aid) {
+                            const char *aid, const DynamoAlloc *alloc) {
     ItemList result = {0};
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return result;
@@ -1074,6 +2473,7 @@ ItemList get_items_owner_pk(const char *prefix, const char *user_id,
     char pk_val[512];
     snprintf(pk_val, sizeof(pk_val), "%s#%s", prefix, string_stem(aid));
     int pages = 0;
+    ItemSink sink = item_sink_new(alloc);
     char *last_key = NULL;
     do {
         Buf body = {0};
@@ -1095,56 +2495,35 @@ ItemList get_items_owner_pk(const char *prefix, const char *user_id,
         char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
         free(body.b);
         if (!resp) {
-            item_list_free(&result);
+            item_sink_free(&sink);
             return (ItemList){0};
         }
 
-        ItemList page = parse_query_items(resp, &last_key);
+        decode_query_page(resp, &sink, &last_key);
         free(resp);
         printf("pages: %d", pages++);
-        if (page.count) {
-            result.items = realloc(result.items, (result.count + page.count) *
-                                                     sizeof(char *));
-            memcpy(result.items + result.count, page.items,
-                   page.count * sizeof(char *));
-            result.count += page.count;
-            free(page.items);
-        }
     } while (last_key);
 
-    return result;
+    return item_sink_finish(&sink);
 }
 
 ItemList get_items_owner_dt_proj(const char *user_id, const char *datatype,
-                                  const char *proj_expr, const char *extra_names) {
+                                  const char *proj_expr, const char *extra_names,
+                                  const DynamoAlloc *alloc) {
     ItemList result = {0};
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return result;
     }
 
+    Buf base =
+        owner_dt_proj_query(table, user_id, datatype, proj_expr, extra_names);
+    ItemSink sink = item_sink_new(alloc);
     char *last_key = NULL;
     do {
         Buf body = {0};
-        b_fmt(&body,
-              "{\"TableName\":\"%s\","
-              "\"IndexName\":\"OWNER-DATATYPE-index\","
-              "\"KeyConditionExpression\":\"#owner = :owner and DATATYPE = :datatype\","
-              "\"ProjectionExpression\":\"%s\","
-              "\"ExpressionAttributeNames\":{\"#owner\":\"OWNER\"",
-              table, proj_expr);
-        if (extra_names && extra_names[0]) {
-            b_str(&body, ",");
-            b_str(&body, extra_names);
-        }
-        b_fmt(&body,
-              "},"
-              "\"ExpressionAttributeValues\":{"
-              "\":owner\":{\"S\":\"%s\"},"
-              "\":datatype\":{\"S\":\"%s\"}"
-              "}",
-              user_id, datatype);
+        b_write(&body, base.b, base.n);
         append_exclusive_start_key(&body, last_key);
         free(last_key);
         last_key = NULL;
@@ -1152,106 +2531,105 @@ ItemList get_items_owner_dt_proj(const char *user_id, const char *datatype,
         char *resp = dynamo_request("DynamoDB_20120810.Query", body.b);
         free(body.b);
         if (!resp) {
-            item_list_free(&result);
+            free(base.b);
+            item_sink_free(&sink);
             return (ItemList){0};
         }
 
-        ItemList page = parse_query_items(resp, &last_key);
+        decode_query_page(resp, &sink, &last_key);
         free(resp);
-
-        if (page.count) {
-            result.items = realloc(result.items, (result.count + page.count) *
-                                                     sizeof(char *));
-            memcpy(result.items + result.count, page.items,
-                   page.count * sizeof(char *));
-            result.count += page.count;
-            free(page.items);
-        }
     } while (last_key);
 
-    return result;
+    free(base.b);
+    return item_sink_finish(&sink);
+}
+
+int get_items_owner_dt_proj_page(const char *user_id, const char *datatype,
+                                 const char *proj_expr,
+                                 const char *extra_names, int limit,
+                                 const char *start_key,
+                                 const DynamoAlloc *alloc, ItemList *out,
+                                 char **next_key) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
+    return query_one_page(
+        owner_dt_proj_query(table, user_id, datatype, proj_expr, extra_names),
+        limit, start_key, alloc, out, next_key);
+}
+
+int get_items_owner_dt_proj_pages(const char *user_id, const char *datatype,
+                                  const char *proj_expr,
+                                  const char *extra_names, ItemPageFn fn,
+                                  void *ctx) {
+    const char *table = client()->table;
+    if (!table) {
+        fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
+        return -1;
+    }
+    return query_pages(
+        owner_dt_proj_query(table, user_id, datatype, proj_expr, extra_names),
+        fn, ctx);
 }
 
 int http_post(const char *url, const char *payload) {
-    CURL *curl = get_curl(&tl_http_curl);
+    CURL *curl = get_curl(&tl_http_curl, NULL);
     if (!curl)
         return -1;
 
-    struct curl_slist *hdrs = NULL;
-    hdrs = curl_slist_append(hdrs, "Content-Type: application/json");
-
     ResponseBuf resp = {0};
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client()->json_hdrs);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(hdrs);
     free(resp.data);
 
     return (res == CURLE_OK) ? 0 : -1;
 }
 
 int invoke_lambda(const char *function_name, const char *payload) {
-    const char *key_id = getenv("AWS_ACCESS_KEY_ID");
-    const char *secret = getenv("AWS_SECRET_ACCESS_KEY");
-    const char *region = getenv("AWS_REGION");
-
-    if (!key_id || !secret || !region) {
+    const ClientCtx *ctx = client();
+    if (!ctx->aws) {
         fprintf(stderr, "AWS credentials/region missing\n");
         return -1;
     }
 
-    char url[512], userpwd[256], sigv4[128];
-    snprintf(url, sizeof(url),
-             "https://lambda.%s.amazonaws.com/2015-03-31/functions/%s/invocations",
-             region, function_name);
-    snprintf(userpwd, sizeof(userpwd), "%s:%s", key_id, secret);
-    snprintf(sigv4, sizeof(sigv4), "aws:amz:%s:lambda", region);
+    char url[512];
+    snprintf(url, sizeof(url), "%s%s/invocations", ctx->lambda_url,
+             function_name);
 
-    CURL *curl = get_curl(&tl_lambda_curl);
+    CURL *curl = get_curl(&tl_lambda_curl, ctx->lambda_sigv4);
     if (!curl)
         return -1;
 
-    struct curl_slist *hdrs = NULL;
-    hdrs = curl_slist_append(hdrs, "Content-Type: application/json");
-    hdrs = curl_slist_append(hdrs, "X-Amz-Invocation-Type: Event");
-
     ResponseBuf resp = {0};
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
-    curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, ctx->event_hdrs);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(hdrs);
     free(resp.data);
 
     return (res == CURLE_OK) ? 0 : -1;
 }
 
 char *http_post_sync(const char *url, const char *payload) {
-    CURL *curl = get_curl(&tl_http_curl);
+    CURL *curl = get_curl(&tl_http_curl, NULL);
     if (!curl)
         return NULL;
 
-    struct curl_slist *hdrs = NULL;
-    hdrs = curl_slist_append(hdrs, "Content-Type: application/json");
-
     ResponseBuf resp = {0};
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, client()->json_hdrs);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(hdrs);
 
     if (res != CURLE_OK) {
         free(resp.data);
@@ -1261,40 +2639,27 @@ char *http_post_sync(const char *url, const char *payload) {
 }
 
 char *invoke_lambda_sync(const char *function_name, const char *payload) {
-    const char *key_id = getenv("AWS_ACCESS_KEY_ID");
-    const char *secret = getenv("AWS_SECRET_ACCESS_KEY");
-    const char *region = getenv("AWS_REGION");
-
-    if (!key_id || !secret || !region) {
+    const ClientCtx *ctx = client();
+    if (!ctx->aws) {
         fprintf(stderr, "AWS credentials/region missing\n");
         return NULL;
     }
 
-    char url[512], userpwd[256], sigv4[128];
-    snprintf(url, sizeof(url),
-             "https://lambda.%s.amazonaws.com/2015-03-31/functions/%s/invocations",
-             region, function_name);
-    snprintf(userpwd, sizeof(userpwd), "%s:%s", key_id, secret);
-    snprintf(sigv4, sizeof(sigv4), "aws:amz:%s:lambda", region);
+    char url[512];
+    snprintf(url, sizeof(url), "%s%s/invocations", ctx->lambda_url,
+             function_name);
 
-    CURL *curl = get_curl(&tl_lambda_curl);
+    CURL *curl = get_curl(&tl_lambda_curl, ctx->lambda_sigv4);
     if (!curl)
         return NULL;
 
-    struct curl_slist *hdrs = NULL;
-    hdrs = curl_slist_append(hdrs, "Content-Type: application/json");
-
     ResponseBuf resp = {0};
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
-    curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, ctx->json_hdrs);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(hdrs);
 
     if (res != CURLE_OK) {
         free(resp.data);
@@ -1303,8 +2668,47 @@ char *invoke_lambda_sync(const char *function_name, const char *payload) {
     return resp.data;
 }
 
+/*
+ * Reaches DynamoDB and Lambda once so the first requests after a start skip
+ * DNS and a full TLS handshake. Both endpoints only need to answer; the
+ * addresses and TLS sessions land in the shared caches, and every thread
+ * resumes from them on its own connections.
+ * Returns 0 if both were reached, -1 otherwise.
+ */
+int dynamo_client_warmup(void) {
+    const ClientCtx *ctx = client();
+    if (!ctx->aws) {
+        fprintf(stderr, "AWS credentials/region missing\n");
+        return -1;
+    }
+
+    int rc = 0;
+    char *resp = dynamo_request("DynamoDB_20120810.DescribeEndpoints", "{}");
+    if (!resp)
+        rc = -1;
+    free(resp);
+
+    CURL *curl = new_curl(ctx->lambda_sigv4);
+    if (!curl)
+        return -1;
+    char url[512];
+    snprintf(url, sizeof(url), "%s?MaxItems=1", ctx->lambda_url);
+    ResponseBuf lresp = {0};
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &lresp);
+    CURLcode res = curl_easy_perform(curl);
+    if (res != CURLE_OK) {
+        fprintf(stderr, "curl error: %s\n", curl_easy_strerror(res));
+        rc = -1;
+    }
+    free(lresp.data);
+    curl_easy_cleanup(curl);
+    return rc;
+}
+
 int save_item(const char *item_json, const char *owner) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return -1;
@@ -1337,7 +2741,7 @@ int save_item(const char *item_json, const char *owner) {
 }
 
 int update_credits_used(const char *email) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
+    const char *table = client()->table;
     if (!table) {
         fprintf(stderr, "DYNAMO_TABLE_NAME not defined\n");
         return -1;
@@ -1426,26 +2830,12 @@ int update_credits_used(const char *email) {
 }
 
 int update_approvals(const char *email) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
-    if (!table) {
-        fprintf(stderr, "update_approvals: DYNAMO_TABLE_NAME not defined\n");
+    char *body = update_approvals_body(email);
+    if (!body)
         return -1;
-    }
-
-    char pk_val[512];
-    snprintf(pk_val, sizeof(pk_val), "USER#%s", email);
-
-    Buf body = {0};
-    b_fmt(&body,
-          "{\"TableName\":\"%s\","
-          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
-          "\"UpdateExpression\":\"SET #sub.#ap = if_not_exists(#sub.#ap, :zero) + :one\","
-          "\"ExpressionAttributeNames\":{\"#sub\":\"subscriptionInfo\",\"#ap\":\"approvals\"},"
-          "\"ExpressionAttributeValues\":{\":one\":{\"N\":\"1\"},\":zero\":{\"N\":\"0\"}}}",
-          table, pk_val, pk_val);
 
-    char *resp = dynamo_request("DynamoDB_20120810.UpdateItem", body.b);
-    free(body.b);
+    char *resp = dynamo_request("DynamoDB_20120810.UpdateItem", body);
+    free(body);
     if (!resp) {
         fprintf(stderr, "update_approvals: UpdateItem request failed\n");
         return -1;
@@ -1459,68 +2849,352 @@ int update_approvals(const char *email) {
  * pk/sk = "{prefix}LOG#{YYYY-MM-DD}" in Mountain Time (UTC-7). */
 int upsert_append_list(const char *list_key, const char *value,
                        const char *prefix) {
-    const char *table = getenv("DYNAMO_TABLE_NAME");
-    if (!table) {
-        fprintf(stderr, "upsert_append_list: DYNAMO_TABLE_NAME not defined\n");
+    char *body1 = NULL, *body2 = NULL;
+    if (upsert_append_list_bodies(list_key, value, prefix, &body1, &body2) != 0)
+        return -1;
+
+    char *resp1 = dynamo_request("DynamoDB_20120810.UpdateItem", body1);
+    free(body1);
+    if (resp1) free(resp1);
+
+    char *resp2 = dynamo_request("DynamoDB_20120810.UpdateItem", body2);
+    free(body2);
+    if (!resp2) {
+        fprintf(stderr, "upsert_append_list: append failed\n");
         return -1;
     }
+    fprintf(stderr, "upsert_append_list: done key=%s\n", list_key);
+    free(resp2);
+    return 0;
+}
 
-    /* Mountain Time = UTC-7 (MST; close enough without DST detection) */
-    time_t now = time(NULL) - 7 * 3600;
-    struct tm t;
-    gmtime_r(&now, &t);
-    char date_str[12];
-    strftime(date_str, sizeof(date_str), "%Y-%m-%d", &t);
-    char attr_name[32];
-    snprintf(attr_name, sizeof(attr_name), "lists_%d", t.tm_hour);
+/* ================================================================== */
+/* async batches (curl multi)                                           */
+/* ================================================================== */
 
-    char pk_val[640];
-    snprintf(pk_val, sizeof(pk_val), "%sLOG#%s", prefix, date_str);
+typedef enum { OP_GET_ITEM, OP_WRITE, OP_POST } BatchOpKind;
 
-    /* JSON-escape value into a buffer */
-    Buf esc = {0};
-    for (const char *p = value; *p; p++) {
-        if (*p == '"')       { b_chr(&esc, '\\'); b_chr(&esc, '"'); }
-        else if (*p == '\\') { b_chr(&esc, '\\'); b_chr(&esc, '\\'); }
-        else                   b_chr(&esc, *p);
+typedef struct {
+    BatchOpKind kind;
+    const char *target;
+    char *url;   /* OP_POST only */
+    int lambda;  /* OP_POST: an async Lambda invocation, signed */
+    char *body;
+    char *next_body; /* sent on the same handle once body completes */
+    CURL *curl;
+    struct curl_slist *headers;
+    ResponseBuf resp;
+    char *result;
+    unsigned long cache_gen; /* OP_GET_ITEM: from the item cache lookup */
+    int status; /* 1 pending, 0 ok, -1 failed */
+} BatchOp;
+
+typedef struct DynamoBatch {
+    BatchOp *ops;
+    size_t count, cap;
+    long post_timeout; /* seconds a POST may take, 0 for no limit */
+    int started;
+} DynamoBatch;
+
+/* a POST gets this long to connect, within its overall timeout */
+#define BATCH_POST_CONNECT_TIMEOUT 10L
+
+/*
+ * One multi handle per thread; its connection cache keeps DynamoDB
+ * connections warm across batches the same way tl_dynamo_curl does.
+ */
+static __thread CURLM *tl_multi = NULL;
+
+DynamoBatch *dynamo_batch_new(void) {
+    return calloc(1, sizeof(DynamoBatch));
+}
+
+void dynamo_batch_free(DynamoBatch *b) {
+    if (!b)
+        return;
+    for (size_t i = 0; i < b->count; i++) {
+        BatchOp *op = &b->ops[i];
+        if (op->curl) {
+            if (tl_multi)
+                curl_multi_remove_handle(tl_multi, op->curl);
+            curl_easy_cleanup(op->curl);
+        }
+        curl_slist_free_all(op->headers);
+        free(op->url);
+        free(op->body);
+        free(op->next_body);
+        free(op->resp.data);
+        free(op->result);
     }
-    if (!esc.b) esc.b = strdup("");
+    free(b->ops);
+    free(b);
+}
 
-    /* Step 1: ensure the outer map attribute exists */
-    Buf body1 = {0};
-    b_fmt(&body1,
-          "{\"TableName\":\"%s\","
-          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
-          "\"UpdateExpression\":\"SET #lists = if_not_exists(#lists, :empty)\","
-          "\"ExpressionAttributeNames\":{\"#lists\":\"%s\"},"
-          "\"ExpressionAttributeValues\":{\":empty\":{\"M\":{}}}}",
-          table, pk_val, pk_val, attr_name);
+/* takes ownership of body and next_body; returns the op index or -1 */
+static int batch_add(DynamoBatch *b, BatchOpKind kind, const char *target,
+                     char *body, char *next_body) {
+    if (!b || !body) {
+        free(body);
+        free(next_body);
+        return -1;
+    }
+    if (b->count == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 8;
+        b->ops = realloc(b->ops, b->cap * sizeof(BatchOp));
+    }
+    BatchOp *op = &b->ops[b->count];
+    memset(op, 0, sizeof(*op));
+    op->kind = kind;
+    op->target = target;
+    op->body = body;
+    op->next_body = next_body;
+    op->status = 1;
+    return (int)b->count++;
+}
 
-    char *resp1 = dynamo_request("DynamoDB_20120810.UpdateItem", body1.b);
-    free(body1.b);
-    if (resp1) free(resp1);
+/* queues a GetItem, or records it as done when the item cache has it */
+static int batch_add_get(DynamoBatch *b, char *body) {
+    unsigned long gen = 0;
+    char *item = body ? cache_lookup_body(body, &gen) : NULL;
+    int idx = batch_add(b, OP_GET_ITEM, "DynamoDB_20120810.GetItem", body,
+                        NULL);
+    if (idx >= 0 && item) {
+        b->ops[idx].result = unmarshal_owned(item);
+        b->ops[idx].status = 0;
+    } else {
+        if (idx >= 0)
+            b->ops[idx].cache_gen = gen;
+        free(item);
+    }
+    return idx;
+}
 
-    /* Step 2: append value to the list */
-    Buf body2 = {0};
-    b_fmt(&body2,
-          "{\"TableName\":\"%s\","
-          "\"Key\":{\"pk\":{\"S\":\"%s\"},\"sk\":{\"S\":\"%s\"}},"
-          "\"UpdateExpression\":\"SET #lists.#k = list_append(if_not_exists(#lists.#k, :empty), :val)\","
-          "\"ExpressionAttributeNames\":{\"#lists\":\"%s\",\"#k\":\"%s\"},"
-          "\"ExpressionAttributeValues\":{"
-          "\":empty\":{\"L\":[]},"
-          "\":val\":{\"L\":[{\"S\":\"%s\"}]}"
-          "}}",
-          table, pk_val, pk_val, attr_name, list_key, esc.b);
-    free(esc.b);
+int dynamo_batch_get_item_pk_sk(DynamoBatch *b, const char *prefix,
+                                const char *pk, const char *sk) {
+    return batch_add_get(b, get_item_body(prefix, pk, sk));
+}
 
-    char *resp2 = dynamo_request("DynamoDB_20120810.UpdateItem", body2.b);
-    free(body2.b);
-    if (!resp2) {
-        fprintf(stderr, "upsert_append_list: append failed\n");
+int dynamo_batch_get_item_pk_sk_proj(DynamoBatch *b, const char *prefix,
+                                     const char *pk, const char *sk,
+                                     const char *proj, const char *names) {
+    return batch_add_get(b, get_item_proj_body(prefix, pk, sk, proj, names));
+}
+
+int dynamo_batch_save_item_plain(DynamoBatch *b, const char *plain_json,
+                                 const char *owner) {
+    return batch_add(b, OP_WRITE, "DynamoDB_20120810.PutItem",
+                     put_item_plain_body(plain_json, owner), NULL);
+}
+
+int dynamo_batch_put_item_encoded(DynamoBatch *b, char *body) {
+    return batch_add(b, OP_WRITE, "DynamoDB_20120810.PutItem", body, NULL);
+}
+
+int dynamo_batch_update_approvals(DynamoBatch *b, const char *email) {
+    return batch_add(b, OP_WRITE, "DynamoDB_20120810.UpdateItem",
+                     update_approvals_body(email), NULL);
+}
+
+int dynamo_batch_upsert_append_list(DynamoBatch *b, const char *list_key,
+                                    const char *value, const char *prefix) {
+    char *body1 = NULL, *body2 = NULL;
+    if (upsert_append_list_bodies(list_key, value, prefix, &body1, &body2) != 0)
+        return -1;
+    return batch_add(b, OP_WRITE, "DynamoDB_20120810.UpdateItem", body1,
+                     body2);
+}
+
+/* queues a POST of a copy of payload to url, like http_post/invoke_lambda */
+static int batch_add_post(DynamoBatch *b, char *url, int lambda,
+                          const char *payload) {
+    if (!url || !payload) {
+        free(url);
         return -1;
     }
-    fprintf(stderr, "upsert_append_list: done key=%s\n", list_key);
-    free(resp2);
+    int idx = batch_add(b, OP_POST, NULL, strdup(payload), NULL);
+    if (idx < 0) {
+        free(url);
+        return -1;
+    }
+    b->ops[idx].url = url;
+    b->ops[idx].lambda = lambda;
+    return idx;
+}
+
+int dynamo_batch_http_post(DynamoBatch *b, const char *url,
+                           const char *payload) {
+    return batch_add_post(b, url ? strdup(url) : NULL, 0, payload);
+}
+
+int dynamo_batch_invoke_lambda(DynamoBatch *b, const char *function_name,
+                               const char *payload) {
+    const ClientCtx *ctx = client();
+    if (!ctx->aws) {
+        fprintf(stderr, "AWS credentials/region missing\n");
+        return -1;
+    }
+    Buf url = {0};
+    b_fmt(&url, "%s%s/invocations", ctx->lambda_url, function_name);
+    return batch_add_post(b, url.b, 1, payload);
+}
+
+void dynamo_batch_set_post_timeout(DynamoBatch *b, long seconds) {
+    if (b)
+        b->post_timeout = seconds;
+}
+
+/* (re)configures op->curl for op->body and adds it to the multi handle */
+static int batch_start(const DynamoBatch *b, BatchOp *op) {
+    const ClientCtx *ctx = client();
+    curl_slist_free_all(op->headers);
+    op->headers = NULL;
+    free(op->resp.data);
+    op->resp = (ResponseBuf){0};
+
+    if (!op->curl) {
+        const char *sigv4 = op->kind != OP_POST ? ctx->dynamo_sigv4
+                            : op->lambda        ? ctx->lambda_sigv4
+                                                : NULL;
+        op->curl = new_curl(sigv4);
+        if (!op->curl)
+            return -1;
+        curl_easy_setopt(op->curl, CURLOPT_PRIVATE, op);
+    }
+    if (op->kind == OP_POST) {
+        curl_easy_setopt(op->curl, CURLOPT_URL, op->url);
+        curl_easy_setopt(op->curl, CURLOPT_POSTFIELDS, op->body);
+        curl_easy_setopt(op->curl, CURLOPT_HTTPHEADER,
+                         op->lambda ? ctx->event_hdrs : ctx->json_hdrs);
+        curl_easy_setopt(op->curl, CURLOPT_WRITEDATA, &op->resp);
+        if (b->post_timeout > 0) {
+            curl_easy_setopt(op->curl, CURLOPT_TIMEOUT, b->post_timeout);
+            curl_easy_setopt(op->curl, CURLOPT_CONNECTTIMEOUT,
+                             b->post_timeout < BATCH_POST_CONNECT_TIMEOUT
+                                 ? b->post_timeout
+                                 : BATCH_POST_CONNECT_TIMEOUT);
+        }
+    } else if (dynamo_prepare(op->curl, op->target, op->body, &op->headers,
+                              &op->resp) != 0) {
+        return -1;
+    }
+    if (curl_multi_add_handle(tl_multi, op->curl) != CURLM_OK)
+        return -1;
+    return 0;
+}
+
+/* called when op's current request finished with res */
+static void batch_finish(const DynamoBatch *b, BatchOp *op, CURLcode res) {
+    curl_multi_remove_handle(tl_multi, op->curl);
+    if (op->kind == OP_WRITE && is_item_write(op->target))
+        cache_forget_body(op->body);
+    if (res != CURLE_OK)
+        fprintf(stderr, "curl error: %s\n", curl_easy_strerror(res));
+    /* like upsert_append_list, a failed first step still sends the second */
+    if (op->next_body) {
+        free(op->body);
+        op->body = op->next_body;
+        op->next_body = NULL;
+        if (batch_start(b, op) != 0)
+            op->status = -1;
+        return;
+    }
+    if (res != CURLE_OK) {
+        op->status = -1;
+        return;
+    }
+    if (op->kind == OP_POST) {
+        long code = 0;
+        curl_easy_getinfo(op->curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code >= 300) {
+            fprintf(stderr, "POST %s: HTTP %ld\n", op->url, code);
+            op->status = -1;
+            return;
+        }
+    }
+    if (op->kind == OP_GET_ITEM && op->resp.data) {
+        char *item = json_get_raw(op->resp.data, "Item");
+        if (item)
+            cache_store_body(op->body, item, op->cache_gen);
+        op->result = unmarshal_owned(item);
+    }
+    op->status = 0;
+}
+
+/* fails every op still pending, e.g. when the multi handle broke */
+static void batch_abandon(DynamoBatch *b) {
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->ops[i].status == 1) {
+            if (b->ops[i].curl)
+                curl_multi_remove_handle(tl_multi, b->ops[i].curl);
+            b->ops[i].status = -1;
+        }
+    }
+}
+
+int dynamo_batch_step(DynamoBatch *b, int wait_ms) {
+    if (!b)
+        return 0;
+    if (!tl_multi) {
+        tl_multi = curl_multi_init();
+        if (!tl_multi) {
+            batch_abandon(b);
+            return 0;
+        }
+    }
+    if (!b->started) {
+        b->started = 1;
+        for (size_t i = 0; i < b->count; i++) {
+            if (b->ops[i].status == 1 && batch_start(b, &b->ops[i]) != 0)
+                b->ops[i].status = -1;
+        }
+    }
+
+    int running = 0;
+    if (curl_multi_perform(tl_multi, &running) != CURLM_OK) {
+        batch_abandon(b);
+        return 0;
+    }
+
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(tl_multi, &left))) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        BatchOp *op = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &op);
+        if (op)
+            batch_finish(b, op, msg->data.result);
+    }
+
+    int pending = 0;
+    for (size_t i = 0; i < b->count; i++)
+        pending += b->ops[i].status == 1;
+    if (pending > 0 && wait_ms > 0)
+        curl_multi_poll(tl_multi, NULL, 0, wait_ms, NULL);
+    return pending;
+}
+
+int dynamo_batch_perform(DynamoBatch *b) {
+    if (!b)
+        return -1;
+    while (dynamo_batch_step(b, 1000) > 0) {
+    }
+
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->ops[i].status != 0)
+            return -1;
+    }
     return 0;
 }
+
+int dynamo_batch_status(const DynamoBatch *b, int idx) {
+    if (!b || idx < 0 || (size_t)idx >= b->count)
+        return -1;
+    return b->ops[idx].status;
+}
+
+const char *dynamo_batch_result(const DynamoBatch *b, int idx) {
+    if (!b || idx < 0 || (size_t)idx >= b->count)
+        return NULL;
+    return b->ops[idx].result;
+}
@@ -10,8 +10,79 @@
 typedef struct {
     char  **items;
     size_t  count;
+    char   *block;    /* when set, items point into this single allocation */
+    int     external; /* memory belongs to a caller DynamoAlloc */
 } ItemList;
 
+/*
+ * Caller-supplied allocator for list results, normally a request arena.
+ * grow returns new_cap bytes holding the first old_cap bytes of old (old
+ * is NULL for a fresh block). Capacities double, and the client never frees
+ * through it: the owner releases everything at once. For lists allocated
+ * this way, item_list_free only clears the struct.
+ * With wire set, list items keep their DynamoDB type annotations for
+ * callers that decode the wire format themselves.
+ */
+typedef struct {
+    void *(*grow)(void *ctx, void *old, size_t old_cap, size_t new_cap);
+    void  *ctx;
+    int    wire;
+} DynamoAlloc;
+
+/* item cache counters, summed over all stripes */
+typedef struct {
+    unsigned long hits, misses, evictions, invalidations;
+    size_t        entries, bytes, max_bytes;
+} DynamoCacheStats;
+
+/* a (prefix, pk, sk) key as accepted by get_item_pk_sk */
+typedef struct {
+    const char *prefix;
+    const char *pk;
+    const char *sk;
+} ItemKey;
+
+/* ================================================================== */
+/* client                                                               */
+/* ================================================================== */
+
+/*
+ * Reads credentials, region and table from the environment once and sets
+ * up the DNS and TLS session caches shared by all threads. Every call
+ * initializes lazily, calling this at startup just moves the cost there.
+ * Returns 0 if AWS credentials and region are present, -1 otherwise.
+ */
+int dynamo_client_init(void);
+
+/* primes DNS and TLS sessions for DynamoDB and Lambda; 0 if both answered */
+int dynamo_client_warmup(void);
+
+/* table from DYNAMO_TABLE_NAME, or NULL when unset */
+const char *dynamo_table_name(void);
+
+/* ================================================================== */
+/* item cache                                                           */
+/* ================================================================== */
+
+/*
+ * get_item_pk_sk and its projected, wire and batch variants read through
+ * an in-process cache shared by all threads. Single-item writes made by
+ * this client (PutItem, UpdateItem, DeleteItem, delete_items_pk) drop the
+ * keys they touch.
+ */
+
+/* byte budget for cached items, 64 MB by default; 0 disables the cache */
+void dynamo_cache_configure(size_t max_bytes);
+
+/* TTL in seconds for items whose pk starts with "PREFIX#"; "*" sets the
+   default for other prefixes, 0 disables caching; -1 if the table is full */
+int dynamo_cache_set_ttl(const char *prefix, int seconds);
+
+void dynamo_cache_stats(DynamoCacheStats *out);
+
+/* drops the cached reads of one item, e.g. after a Lambda rewrote it */
+void dynamo_cache_forget(const char *prefix, const char *pk, const char *sk);
+
 /* ================================================================== */
 /* item list                                                            */
 /* ================================================================== */
@@ -39,6 +110,27 @@ int check_owner(const char *item_json, const char *owner);
 /* returns heap-allocated unmarshalled JSON of Item, or NULL; caller frees */
 char *get_item_pk_sk(const char *prefix, const char *pk, const char *sk);
 
+/*
+ * like get_item_pk_sk but reads only the attributes in the ProjectionExpression
+ * proj; names holds its ExpressionAttributeNames entries as a JSON fragment
+ * (e.g. "\"#o\":\"OWNER\""), or NULL
+ */
+char *get_item_pk_sk_proj(const char *prefix, const char *pk, const char *sk,
+                          const char *proj, const char *names);
+
+/* like get_item_pk_sk but keeps the wire format; allocated through alloc
+   (malloc when NULL) */
+char *get_item_pk_sk_wire(const char *prefix, const char *pk, const char *sk,
+                          const DynamoAlloc *alloc);
+
+/*
+ * BatchGetItem for up to 100 keys, retrying UnprocessedKeys with backoff.
+ * On success count == n and items[i] is the unmarshalled item for keys[i],
+ * or NULL if it does not exist. On failure count == 0.
+ * Caller must call item_list_free().
+ */
+ItemList batch_get_items(const ItemKey *keys, size_t n);
+
 /* returns 0 on success, -1 on failure */
 int delete_item_pk_sk(const char *prefix, const char *pk, const char *sk,
                       const char *owner);
@@ -46,15 +138,22 @@ int delete_item_pk_sk(const char *prefix, const char *pk, const char *sk,
 /* returns number of deleted items, or -1 on failure */
 int delete_items_pk(const char *prefix, const char *pk, const char *owner);
 
+/*
+ * List queries below page through all results. alloc may be NULL to use
+ * malloc.
+ */
+
 /* queries OWNER-DATATYPE-index */
-ItemList get_items_owner_dt(const char *user_id, const char *datatype);
+ItemList get_items_owner_dt(const char *user_id, const char *datatype,
+                            const DynamoAlloc *alloc);
 
 /* queries DATATYPE-pk-index, paginated */
-ItemList get_items_datatype_pk(const char *datatype, const char *pk);
+ItemList get_items_datatype_pk(const char *datatype, const char *pk,
+                               const DynamoAlloc *alloc);
 
 /* queries OWNER-pk-index, paginated */
 ItemList get_items_owner_pk(const char *prefix, const char *user_id,
-                            const char *aid);
+                            const char *aid, const DynamoAlloc *alloc);
 
 /*
  * item_json must be in DynamoDB wire format (with type annotations).
@@ -65,13 +164,62 @@ int save_item(const char *item_json, const char *owner);
 /* accepts plain JSON (no DynamoDB type annotations); marshals internally */
 int save_item_plain(const char *plain_json, const char *owner);
 
+/* sends a complete PutItem request body (owner already checked);
+   returns 0 on success, -1 on failure */
+int put_item_encoded(const char *body);
+
 /* writes current UTC time as ISO 8601 into buf (e.g. "2024-01-15T10:30:00.000Z") */
 void iso_timestamp(char *buf, size_t len);
 
 /* like get_items_owner_dt but with a ProjectionExpression; extra_names is a JSON
    fragment of additional ExpressionAttributeNames entries (may be NULL or "") */
 ItemList get_items_owner_dt_proj(const char *user_id, const char *datatype,
-                                  const char *proj_expr, const char *extra_names);
+                                  const char *proj_expr, const char *extra_names,
+                                  const DynamoAlloc *alloc);
+
+/*
+ * Single-page variants of the list queries for cursor pagination. limit > 0
+ * caps the page (0 leaves it to DynamoDB); start_key is the raw
+ * LastEvaluatedKey JSON of the previous page, or NULL for the first.
+ * On success returns 0, *out holds the page's items (allocated through
+ * alloc, caller calls item_list_free) and *next_key the page's
+ * LastEvaluatedKey, or NULL after the last page; caller frees it. start_key
+ * goes into the request verbatim, so it must come from a trusted source.
+ * Returns -1 on failure.
+ */
+int get_items_owner_dt_page(const char *user_id, const char *datatype,
+                            int limit, const char *start_key,
+                            const DynamoAlloc *alloc, ItemList *out,
+                            char **next_key);
+
+int get_items_datatype_pk_page(const char *datatype, const char *pk,
+                               int limit, const char *start_key,
+                               const DynamoAlloc *alloc, ItemList *out,
+                               char **next_key);
+
+int get_items_owner_dt_proj_page(const char *user_id, const char *datatype,
+                                 const char *proj_expr,
+                                 const char *extra_names, int limit,
+                                 const char *start_key,
+                                 const DynamoAlloc *alloc, ItemList *out,
+                                 char **next_key);
+
+/*
+ * Page-at-a-time variants of the list queries for callers that stream
+ * results. fn gets each page's unmarshalled items as soon as the page
+ * arrives; they are freed when it returns. A nonzero return from fn stops
+ * paging. Returns 0 on success, -1 if a request failed part way (pages
+ * already delivered stay delivered).
+ */
+typedef int (*ItemPageFn)(void *ctx, const char *const *items, size_t count);
+
+int get_items_datatype_pk_pages(const char *datatype, const char *pk,
+                                ItemPageFn fn, void *ctx);
+
+int get_items_owner_dt_proj_pages(const char *user_id, const char *datatype,
+                                  const char *proj_expr,
+                                  const char *extra_names, ItemPageFn fn,
+                                  void *ctx);
 
 /* simple HTTP POST with JSON content-type; returns 0 on success, -1 on failure */
 int http_post(const char *url, const char *payload);
@@ -102,4 +250,60 @@ int update_approvals(const char *email);
 int upsert_append_list(const char *list_key, const char *value,
                        const char *prefix);
 
+/* ================================================================== */
+/* async batches                                                        */
+/* ================================================================== */
+
+/*
+ * A batch collects independent operations and sends them concurrently over
+ * one curl multi handle, so the total latency is that of the slowest call
+ * instead of the sum. Request bodies are built when an op is added, so the
+ * arguments need not outlive the add call.
+ */
+typedef struct DynamoBatch DynamoBatch;
+
+DynamoBatch *dynamo_batch_new(void);
+void dynamo_batch_free(DynamoBatch *b);
+
+/* each add returns the op index, or -1 if the request could not be built */
+int dynamo_batch_get_item_pk_sk(DynamoBatch *b, const char *prefix,
+                                const char *pk, const char *sk);
+int dynamo_batch_get_item_pk_sk_proj(DynamoBatch *b, const char *prefix,
+                                     const char *pk, const char *sk,
+                                     const char *proj, const char *names);
+int dynamo_batch_save_item_plain(DynamoBatch *b, const char *plain_json,
+                                 const char *owner);
+/* takes ownership of body, a complete malloc'd PutItem request body */
+int dynamo_batch_put_item_encoded(DynamoBatch *b, char *body);
+int dynamo_batch_update_approvals(DynamoBatch *b, const char *email);
+int dynamo_batch_upsert_append_list(DynamoBatch *b, const char *list_key,
+                                    const char *value, const char *prefix);
+/* like http_post and invoke_lambda; a 3xx-5xx reply counts as failure */
+int dynamo_batch_http_post(DynamoBatch *b, const char *url,
+                           const char *payload);
+int dynamo_batch_invoke_lambda(DynamoBatch *b, const char *function_name,
+                               const char *payload);
+
+/*
+ * Bounds each POST to seconds in total, connecting included; 0, the
+ * default, leaves POSTs unbounded. Set it before the batch is performed.
+ */
+void dynamo_batch_set_post_timeout(DynamoBatch *b, long seconds);
+
+/* runs every pending op; returns 0 if all succeeded, -1 otherwise */
+int dynamo_batch_perform(DynamoBatch *b);
+
+/*
+ * Drives the batch for at most about wait_ms and returns how many ops are
+ * still pending, so a caller can act on each op as it finishes. Calling it
+ * until it returns 0 is dynamo_batch_perform.
+ */
+int dynamo_batch_step(DynamoBatch *b, int wait_ms);
+
+/* 0 on success, -1 on failure, 1 if not performed yet */
+int dynamo_batch_status(const DynamoBatch *b, int idx);
+
+/* unmarshalled Item of a get op, or NULL; owned by the batch */
+const char *dynamo_batch_result(const DynamoBatch *b, int idx);
+
 #endif /* DYNAMO_H */
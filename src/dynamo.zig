@@ -1,6 +1,7 @@
 const std = @import("std");
 const server = @import("server.zig");
 const Context = server.Context;
+const Config = @import("config.zig");
 
 pub const c = @cImport({
     @cInclude("dynamo.h");
@@ -15,16 +16,375 @@ pub inline fn stringStem(s: []const u8) []const u8 {
     return if (std.mem.indexOf(u8, s, "#")) |idx| s[idx + 1 ..] else s;
 }
 
+/// Loads the client context and pre-connects to DynamoDB and Lambda so the
+/// first requests after a start do not pay for DNS and TLS handshakes.
+pub fn initClient() !void {
+    if (dynamo.dynamo_client_init() != 0) return error.MissingCredentials;
+    if (dynamo.dynamo_client_warmup() != 0) server.debugPrint("dynamo warm-up failed\n", .{});
+}
+
+/// Sizes the item cache behind getItemPkSk and friends and applies
+/// per-prefix TTLs; see dynamo_cache_set_ttl.
+pub fn configureCache(allocator: std.mem.Allocator, max_bytes: usize, ttls: []const Config.ItemCacheTtl) !void {
+    dynamo.dynamo_cache_configure(max_bytes);
+    for (ttls) |ttl| {
+        const prefix = try allocator.dupeZ(u8, ttl.prefix);
+        defer allocator.free(prefix);
+        if (dynamo.dynamo_cache_set_ttl(prefix, ttl.seconds) != 0) return error.TooManyCacheTtls;
+    }
+}
+
+pub const CacheStats = struct {
+    hits: u64,
+    misses: u64,
+    evictions: u64,
+    invalidations: u64,
+    entries: usize,
+    bytes: usize,
+    maxBytes: usize,
+};
+
+pub fn cacheStats() CacheStats {
+    var raw: dynamo.DynamoCacheStats = undefined;
+    dynamo.dynamo_cache_stats(&raw);
+    return .{
+        .hits = raw.hits,
+        .misses = raw.misses,
+        .evictions = raw.evictions,
+        .invalidations = raw.invalidations,
+        .entries = raw.entries,
+        .bytes = raw.bytes,
+        .maxBytes = raw.max_bytes,
+    };
+}
+
+/// Drops the cached reads of one item, e.g. after a Lambda rewrote it.
+pub fn forgetCached(allocator: std.mem.Allocator, prefix: []const u8, pk: []const u8, sk: []const u8) !void {
+    const cpx = try allocator.dupeZ(u8, prefix);
+    defer allocator.free(cpx);
+    const cpk = try allocator.dupeZ(u8, pk);
+    defer allocator.free(cpk);
+    const csk = try allocator.dupeZ(u8, sk);
+    defer allocator.free(csk);
+    dynamo.dynamo_cache_forget(cpx, cpk, csk);
+}
+
+/// Items of a list query. They live in the arena the query was given, so
+/// there is nothing to free separately.
 pub const ItemList = struct {
     items: [][]const u8,
-    allocator: std.mem.Allocator,
+};
+
+const list_alignment: std.mem.Alignment = .@"16";
 
-    pub fn deinit(self: *ItemList) void {
-        for (self.items) |item| self.allocator.free(item);
-        self.allocator.free(self.items);
+/// DynamoAlloc callback backed by a Zig allocator. Blocks grow in place when
+/// they are the arena's newest allocation, else move; old blocks are left
+/// to the arena.
+fn arenaGrow(ctx: ?*anyopaque, old: ?*anyopaque, old_cap: usize, new_cap: usize) callconv(.c) ?*anyopaque {
+    const allocator: *const std.mem.Allocator = @ptrCast(@alignCast(ctx.?));
+    const old_ptr: ?[*]u8 = @ptrCast(old);
+    if (old_ptr) |p| {
+        if (allocator.rawRemap(p[0..old_cap], list_alignment, new_cap, @returnAddress())) |np| return np;
+    }
+    const np = allocator.rawAlloc(new_cap, list_alignment, @returnAddress()) orelse return null;
+    if (old_ptr) |p| @memcpy(np[0..old_cap], p[0..old_cap]);
+    return np;
+}
+
+/// Lets a C query place its results directly in `allocator`, which must be
+/// an arena (the request allocator): nothing is freed through it. With
+/// `wire`, items keep their DynamoDB type annotations for decodeItem.
+fn arenaAlloc(allocator: *const std.mem.Allocator, wire: bool) dynamo.DynamoAlloc {
+    return .{ .grow = &arenaGrow, .ctx = @constCast(allocator), .wire = @intFromBool(wire) };
+}
+
+/// Views the items of an arena-backed C list as slices, without copying.
+fn itemSlices(allocator: std.mem.Allocator, raw: dynamo.ItemList) ![][]const u8 {
+    const items = try allocator.alloc([]const u8, raw.count);
+    for (items, 0..) |*item, i| item.* = std.mem.span(raw.items[i]);
+    return items;
+}
+
+/// Decodes the items of an arena-backed C list fetched in wire format.
+fn decodeItems(comptime T: type, allocator: std.mem.Allocator, raw: dynamo.ItemList) ![]T {
+    const result = try allocator.alloc(T, raw.count);
+    for (result, 0..) |*item, i| item.* = try decodeItem(T, allocator, std.mem.span(raw.items[i]));
+    return result;
+}
+
+// ------------------------------------------------------------------
+// wire format decoding
+// ------------------------------------------------------------------
+
+pub const WireError = error{
+    SyntaxError,
+    UnexpectedEndOfInput,
+    UnexpectedType,
+    MissingField,
+    InvalidNumber,
+    InvalidEnumTag,
+    LengthMismatch,
+} || std.mem.Allocator.Error;
+
+const WireScanner = struct {
+    src: []const u8,
+    i: usize = 0,
+
+    fn peek(self: *WireScanner) WireError!u8 {
+        while (self.i < self.src.len) : (self.i += 1) switch (self.src[self.i]) {
+            ' ', '\t', '\r', '\n' => {},
+            else => return self.src[self.i],
+        };
+        return error.UnexpectedEndOfInput;
+    }
+
+    fn expect(self: *WireScanner, ch: u8) WireError!void {
+        if (try self.peek() != ch) return error.SyntaxError;
+        self.i += 1;
+    }
+
+    /// Consumes the separator after a member: true if another follows.
+    fn more(self: *WireScanner, close: u8) WireError!bool {
+        const ch = try self.peek();
+        self.i += 1;
+        if (ch == ',') return true;
+        if (ch == close) return false;
+        return error.SyntaxError;
+    }
+
+    /// Bounds of the string at the cursor, quotes excluded, escapes intact.
+    fn span(self: *WireScanner) WireError!struct { start: usize, end: usize, escaped: bool } {
+        try self.expect('"');
+        const start = self.i;
+        var escaped = false;
+        while (std.mem.indexOfAnyPos(u8, self.src, self.i, "\"\\")) |j| {
+            if (self.src[j] == '"') {
+                self.i = j + 1;
+                return .{ .start = start, .end = j, .escaped = escaped };
+            }
+            escaped = true;
+            self.i = j + 2;
+        }
+        return error.UnexpectedEndOfInput;
+    }
+
+    /// Key of an object member; attribute names never need unescaping.
+    fn key(self: *WireScanner) WireError![]const u8 {
+        const sp = try self.span();
+        try self.expect(':');
+        return self.src[sp.start..sp.end];
+    }
+
+    /// Borrowed from the source unless the string has escapes.
+    fn string(self: *WireScanner, allocator: std.mem.Allocator) WireError![]const u8 {
+        const sp = try self.span();
+        if (!sp.escaped) return self.src[sp.start..sp.end];
+        return std.json.parseFromSliceLeaky([]const u8, allocator, self.src[sp.start - 1 .. sp.end + 1], .{
+            .allocate = .alloc_always,
+        }) catch |err| switch (err) {
+            error.OutOfMemory => error.OutOfMemory,
+            else => error.SyntaxError,
+        };
+    }
+
+    fn literal(self: *WireScanner) WireError![]const u8 {
+        _ = try self.peek();
+        const start = self.i;
+        while (self.i < self.src.len) : (self.i += 1) switch (self.src[self.i]) {
+            ',', '}', ']', ' ', '\t', '\r', '\n' => break,
+            else => {},
+        };
+        if (self.i == start) return error.SyntaxError;
+        return self.src[start..self.i];
+    }
+
+    /// Steps over a value without materializing anything.
+    fn skip(self: *WireScanner) WireError!void {
+        switch (try self.peek()) {
+            '"' => _ = try self.span(),
+            '{', '[' => {
+                var depth: usize = 0;
+                while (self.i < self.src.len) {
+                    switch (self.src[self.i]) {
+                        '"' => {
+                            _ = try self.span();
+                            continue;
+                        },
+                        '{', '[' => depth += 1,
+                        '}', ']' => {
+                            depth -= 1;
+                            if (depth == 0) {
+                                self.i += 1;
+                                return;
+                            }
+                        },
+                        else => {},
+                    }
+                    self.i += 1;
+                }
+                return error.UnexpectedEndOfInput;
+            },
+            else => _ = try self.literal(),
+        }
     }
 };
 
+/// Decodes one item in DynamoDB wire format into T in a single pass.
+/// Attributes T does not declare are skipped, and strings without escapes
+/// are sliced from `wire`, which must therefore outlive the result.
+pub fn decodeItem(comptime T: type, allocator: std.mem.Allocator, wire: []const u8) WireError!T {
+    var s: WireScanner = .{ .src = wire };
+    return decodeMap(T, allocator, &s);
+}
+
+fn decodeMap(comptime T: type, allocator: std.mem.Allocator, s: *WireScanner) WireError!T {
+    const fields = @typeInfo(T).@"struct".fields;
+    var out: T = undefined;
+    var seen = [_]bool{false} ** fields.len;
+    try s.expect('{');
+    if (try s.peek() == '}') {
+        s.i += 1;
+    } else while (true) {
+        const name = try s.key();
+        matched: {
+            inline for (fields, 0..) |f, idx| {
+                if (std.mem.eql(u8, name, f.name)) {
+                    @field(out, f.name) = try decodeAttr(f.type, allocator, s);
+                    seen[idx] = true;
+                    break :matched;
+                }
+            }
+            try s.skip();
+        }
+        if (!try s.more('}')) break;
+    }
+    inline for (fields, 0..) |f, idx| {
+        if (!seen[idx]) {
+            if (f.defaultValue()) |d| {
+                @field(out, f.name) = d;
+            } else if (@typeInfo(f.type) == .optional) {
+                @field(out, f.name) = null;
+            } else return error.MissingField;
+        }
+    }
+    return out;
+}
+
+/// One attribute value: {"<type>": payload}.
+fn decodeAttr(comptime T: type, allocator: std.mem.Allocator, s: *WireScanner) WireError!T {
+    try s.expect('{');
+    const tag = try s.key();
+    const value = try decodePayload(T, allocator, s, tag);
+    try s.expect('}');
+    return value;
+}
+
+fn decodePayload(comptime T: type, allocator: std.mem.Allocator, s: *WireScanner, tag: []const u8) WireError!T {
+    if (T == std.json.Value) return wireValue(allocator, s, tag);
+    switch (@typeInfo(T)) {
+        .optional => |o| {
+            if (std.mem.eql(u8, tag, "NULL")) {
+                try s.skip();
+                return null;
+            }
+            return try decodePayload(o.child, allocator, s, tag);
+        },
+        .bool => {
+            if (!std.mem.eql(u8, tag, "BOOL")) return error.UnexpectedType;
+            const lit = try s.literal();
+            if (std.mem.eql(u8, lit, "true")) return true;
+            if (std.mem.eql(u8, lit, "false")) return false;
+            return error.SyntaxError;
+        },
+        .float => {
+            if (!std.mem.eql(u8, tag, "N")) return error.UnexpectedType;
+            return std.fmt.parseFloat(T, try s.string(allocator)) catch error.InvalidNumber;
+        },
+        .int => {
+            if (!std.mem.eql(u8, tag, "N")) return error.UnexpectedType;
+            return std.fmt.parseInt(T, try s.string(allocator), 10) catch error.InvalidNumber;
+        },
+        .@"enum" => {
+            if (!std.mem.eql(u8, tag, "S")) return error.UnexpectedType;
+            return std.meta.stringToEnum(T, try s.string(allocator)) orelse error.InvalidEnumTag;
+        },
+        .pointer => |p| {
+            if (p.size != .slice) @compileError("cannot decode DynamoDB attribute into " ++ @typeName(T));
+            if (p.child == u8) {
+                if (tag.len != 1 or std.mem.indexOfScalar(u8, "SNB", tag[0]) == null) return error.UnexpectedType;
+                return try s.string(allocator);
+            }
+            return decodeList(p.child, allocator, s, tag);
+        },
+        .array => |a| {
+            const items = try decodeList(a.child, allocator, s, tag);
+            if (items.len != a.len) return error.LengthMismatch;
+            return items[0..a.len].*;
+        },
+        .@"struct" => {
+            if (!std.mem.eql(u8, tag, "M")) return error.UnexpectedType;
+            return decodeMap(T, allocator, s);
+        },
+        else => @compileError("cannot decode DynamoDB attribute into " ++ @typeName(T)),
+    }
+}
+
+/// L holds typed values; SS, NS and BS hold bare payloads.
+fn decodeList(comptime T: type, allocator: std.mem.Allocator, s: *WireScanner, tag: []const u8) WireError![]T {
+    const elem_tag: ?[]const u8 = if (std.mem.eql(u8, tag, "L"))
+        null
+    else if (tag.len == 2 and tag[1] == 'S' and std.mem.indexOfScalar(u8, "SNB", tag[0]) != null)
+        tag[0..1]
+    else
+        return error.UnexpectedType;
+
+    var list: std.ArrayList(T) = .empty;
+    try s.expect('[');
+    if (try s.peek() == ']') {
+        s.i += 1;
+        return list.toOwnedSlice(allocator);
+    }
+    while (true) {
+        const value = if (elem_tag) |t| try decodePayload(T, allocator, s, t) else try decodeAttr(T, allocator, s);
+        try list.append(allocator, value);
+        if (!try s.more(']')) break;
+    }
+    return list.toOwnedSlice(allocator);
+}
+
+/// Untyped fields (metaData, settings) take the plain JSON shape.
+fn wireValue(allocator: std.mem.Allocator, s: *WireScanner, tag: []const u8) WireError!std.json.Value {
+    if (std.mem.eql(u8, tag, "S") or std.mem.eql(u8, tag, "B")) return .{ .string = try s.string(allocator) };
+    if (std.mem.eql(u8, tag, "N")) {
+        const text = try s.string(allocator);
+        if (std.fmt.parseInt(i64, text, 10)) |n| return .{ .integer = n } else |_| {}
+        if (std.fmt.parseFloat(f64, text)) |f| return .{ .float = f } else |_| {}
+        return .{ .number_string = text };
+    }
+    if (std.mem.eql(u8, tag, "BOOL")) return .{ .bool = try decodePayload(bool, allocator, s, tag) };
+    if (std.mem.eql(u8, tag, "NULL")) {
+        try s.skip();
+        return .null;
+    }
+    if (std.mem.eql(u8, tag, "M")) {
+        var obj = std.json.ObjectMap.init(allocator);
+        try s.expect('{');
+        if (try s.peek() == '}') {
+            s.i += 1;
+            return .{ .object = obj };
+        }
+        while (true) {
+            const name = try s.key();
+            try obj.put(name, try decodeAttr(std.json.Value, allocator, s));
+            if (!try s.more('}')) break;
+        }
+        return .{ .object = obj };
+    }
+    return .{ .array = std.json.Array.fromOwnedSlice(allocator, try decodeList(std.json.Value, allocator, s, tag)) };
+}
+
+/// Fetches one item. `allocator` must be an arena: the item's strings are
+/// borrowed from the response, which is placed there.
 pub fn getItemPkSk(comptime T: type, allocator: std.mem.Allocator, prefix: []const u8, pk: []const u8, sk: []const u8) !?T {
     const cpx = try allocator.dupeZ(u8, prefix);
     defer allocator.free(cpx);
@@ -32,7 +392,27 @@ pub fn getItemPkSk(comptime T: type, allocator: std.mem.Allocator, prefix: []con
     defer allocator.free(cpk);
     const csk = try allocator.dupeZ(u8, sk);
     defer allocator.free(csk);
-    const result = dynamo.get_item_pk_sk(cpx, cpk, csk) orelse return null;
+    const alloc = arenaAlloc(&allocator, true);
+    const wire = dynamo.get_item_pk_sk_wire(cpx, cpk, csk, &alloc) orelse return null;
+    return try decodeItem(T, allocator, std.mem.span(wire));
+}
+
+/// Fetches only the attributes named by the ProjectionExpression `proj`;
+/// `names` holds its ExpressionAttributeNames entries as a JSON fragment
+/// (e.g. `"#o":"OWNER"`), or "". Meant for existence and ACL checks, where
+/// the full item would be mostly wasted read capacity.
+pub fn getItemPkSkProj(comptime T: type, allocator: std.mem.Allocator, prefix: []const u8, pk: []const u8, sk: []const u8, proj: []const u8, names: []const u8) !?T {
+    const cpx = try allocator.dupeZ(u8, prefix);
+    defer allocator.free(cpx);
+    const cpk = try allocator.dupeZ(u8, pk);
+    defer allocator.free(cpk);
+    const csk = try allocator.dupeZ(u8, sk);
+    defer allocator.free(csk);
+    const cproj = try allocator.dupeZ(u8, proj);
+    defer allocator.free(cproj);
+    const cnames = try allocator.dupeZ(u8, names);
+    defer allocator.free(cnames);
+    const result = dynamo.get_item_pk_sk_proj(cpx, cpk, csk, cproj, cnames) orelse return null;
     defer std.c.free(result);
     return try std.json.parseFromSliceLeaky(T, allocator, std.mem.span(result), .{
         .ignore_unknown_fields = true,
@@ -40,6 +420,46 @@ pub fn getItemPkSk(comptime T: type, allocator: std.mem.Allocator, prefix: []con
     });
 }
 
+/// Whether an item exists, reading only its key.
+pub fn itemExists(allocator: std.mem.Allocator, prefix: []const u8, pk: []const u8, sk: []const u8) !bool {
+    const KeyOnly = struct { pk: []const u8 = "" };
+    return try getItemPkSkProj(KeyOnly, allocator, prefix, pk, sk, "pk", "") != null;
+}
+
+pub const Key = struct {
+    prefix: []const u8,
+    pk: []const u8,
+    sk: []const u8,
+};
+
+/// Fetches up to 100 items with one BatchGetItem. result[i] is the item for
+/// keys[i], or null if it does not exist.
+pub fn batchGetItems(comptime T: type, allocator: std.mem.Allocator, keys: []const Key) ![]?T {
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const ckeys = try arena.allocator().alloc(dynamo.ItemKey, keys.len);
+    for (keys, ckeys) |k, *ck| {
+        ck.* = .{
+            .prefix = try arena.allocator().dupeZ(u8, k.prefix),
+            .pk = try arena.allocator().dupeZ(u8, k.pk),
+            .sk = try arena.allocator().dupeZ(u8, k.sk),
+        };
+    }
+    var raw = dynamo.batch_get_items(ckeys.ptr, ckeys.len);
+    defer dynamo.item_list_free(&raw);
+    if (raw.count != keys.len) return error.DynamoError;
+
+    const result = try allocator.alloc(?T, keys.len);
+    for (0..raw.count) |i| {
+        const item = raw.items[i] orelse {
+            result[i] = null;
+            continue;
+        };
+        result[i] = try std.json.parseFromSliceLeaky(T, allocator, std.mem.span(item), .{ .ignore_unknown_fields = true, .allocate = .alloc_always });
+    }
+    return result;
+}
+
 pub fn deleteItemPkSk(allocator: std.mem.Allocator, prefix: []const u8, pk: []const u8, sk: []const u8, owner: ?[]const u8) !void {
     const cpx = try allocator.dupeZ(u8, prefix);
     defer allocator.free(cpx);
@@ -71,14 +491,6 @@ pub fn deleteItemsPk(allocator: std.mem.Allocator, prefix: []const u8, pk: []con
     return @intCast(n);
 }
 
-fn dupeItemList(allocator: std.mem.Allocator, raw: dynamo.ItemList) !ItemList {
-    const items = try allocator.alloc([]const u8, raw.count);
-    for (0..raw.count) |i| {
-        items[i] = try allocator.dupe(u8, std.mem.span(raw.items[i]));
-    }
-    return .{ .items = items, .allocator = allocator };
-}
-
 pub const SubmissionList = struct {
     pk: []const u8,
     sk: []const u8,
@@ -94,6 +506,24 @@ pub const SubmissionList = struct {
     isStarred: bool = false,
     status: []const u8,
     externalId: []const u8,
+
+    /// ProjectionExpression reading just these attributes on the
+    /// OWNER-DATATYPE query, which names #owner itself
+    pub const projection = "pk, sk, severity, DATATYPE, #n, studentName, assignmentId, rubricId, simpleHash, classId, #owner, isStarred, #s, externalId";
+    pub const names = "\"#n\":\"name\",\"#s\":\"status\"";
+
+    /// Cuts a full submission down to the attributes the list returns.
+    pub fn fields(allocator: std.mem.Allocator, item: std.json.Value) !std.json.Value {
+        const obj = switch (item) {
+            .object => |o| o,
+            else => return item,
+        };
+        var out: std.json.ObjectMap = .init(allocator);
+        inline for (std.meta.fields(SubmissionList)) |f| {
+            if (obj.get(f.name)) |v| try out.put(f.name, v);
+        }
+        return .{ .object = out };
+    }
 };
 
 pub fn getItemsOwnerDtProj(comptime T: type, allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8, proj_expr: []const u8, extra_names: []const u8) ![]T {
@@ -105,13 +535,9 @@ pub fn getItemsOwnerDtProj(comptime T: type, allocator: std.mem.Allocator, user_
     defer allocator.free(cproj);
     const cnames = try allocator.dupeZ(u8, extra_names);
     defer allocator.free(cnames);
-    var raw = dynamo.get_items_owner_dt_proj(cuid, cdt, cproj, cnames);
-    defer dynamo.item_list_free(&raw);
-    const result = try allocator.alloc(T, raw.count);
-    for (0..raw.count) |i| {
-        result[i] = try std.json.parseFromSliceLeaky(T, allocator, std.mem.span(raw.items[i]), .{ .ignore_unknown_fields = true, .allocate = .alloc_always });
-    }
-    return result;
+    const alloc = arenaAlloc(&allocator, true);
+    const raw = dynamo.get_items_owner_dt_proj(cuid, cdt, cproj, cnames, &alloc);
+    return decodeItems(T, allocator, raw);
 }
 
 pub fn getItemsOwnerDtProjRaw(allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8, proj_expr: []const u8, extra_names: []const u8) ![][]const u8 {
@@ -123,13 +549,9 @@ pub fn getItemsOwnerDtProjRaw(allocator: std.mem.Allocator, user_id: []const u8,
     defer allocator.free(cproj);
     const cnames = try allocator.dupeZ(u8, extra_names);
     defer allocator.free(cnames);
-    var raw = dynamo.get_items_owner_dt_proj(cuid, cdt, cproj, cnames);
-    defer dynamo.item_list_free(&raw);
-    const result = try allocator.alloc([]const u8, raw.count);
-    for (0..raw.count) |i| {
-        result[i] = try allocator.dupe(u8, std.mem.span(raw.items[i]));
-    }
-    return result;
+    const alloc = arenaAlloc(&allocator, false);
+    const raw = dynamo.get_items_owner_dt_proj(cuid, cdt, cproj, cnames, &alloc);
+    return itemSlices(allocator, raw);
 }
 
 pub fn getItemsOwnerDt(comptime T: type, allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8) ![]T {
@@ -137,13 +559,19 @@ pub fn getItemsOwnerDt(comptime T: type, allocator: std.mem.Allocator, user_id:
     defer allocator.free(cuid);
     const cdt = try allocator.dupeZ(u8, datatype);
     defer allocator.free(cdt);
-    var raw = dynamo.get_items_owner_dt(cuid, cdt);
-    defer dynamo.item_list_free(&raw);
-    const result = try allocator.alloc(T, raw.count);
-    for (0..raw.count) |i| {
-        result[i] = try std.json.parseFromSliceLeaky(T, allocator, std.mem.span(raw.items[i]), .{ .ignore_unknown_fields = true, .allocate = .alloc_always });
-    }
-    return result;
+    const alloc = arenaAlloc(&allocator, true);
+    const raw = dynamo.get_items_owner_dt(cuid, cdt, &alloc);
+    return decodeItems(T, allocator, raw);
+}
+
+pub fn getItemsOwnerDtRaw(allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8) ![][]const u8 {
+    const cuid = try allocator.dupeZ(u8, user_id);
+    defer allocator.free(cuid);
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const alloc = arenaAlloc(&allocator, false);
+    const raw = dynamo.get_items_owner_dt(cuid, cdt, &alloc);
+    return itemSlices(allocator, raw);
 }
 
 pub fn getItemsDatatypePk(allocator: std.mem.Allocator, datatype: []const u8, pk: []const u8) !ItemList {
@@ -151,9 +579,121 @@ pub fn getItemsDatatypePk(allocator: std.mem.Allocator, datatype: []const u8, pk
     defer allocator.free(cdt);
     const cpk = try allocator.dupeZ(u8, pk);
     defer allocator.free(cpk);
-    var raw = dynamo.get_items_datatype_pk(cdt, cpk);
-    defer dynamo.item_list_free(&raw);
-    return dupeItemList(allocator, raw);
+    const alloc = arenaAlloc(&allocator, false);
+    const raw = dynamo.get_items_datatype_pk(cdt, cpk, &alloc);
+    return .{ .items = try itemSlices(allocator, raw) };
+}
+
+/// One page of a list query.
+pub const Page = struct {
+    items: [][]const u8,
+    /// raw LastEvaluatedKey JSON, null after the last page
+    next_key: ?[]const u8,
+};
+
+fn finishPage(allocator: std.mem.Allocator, rc: c_int, raw: dynamo.ItemList, next_key: [*c]u8) !Page {
+    if (rc != 0) return error.DynamoError;
+    defer std.c.free(next_key);
+    return .{
+        .items = try itemSlices(allocator, raw),
+        .next_key = if (next_key != null) try allocator.dupe(u8, std.mem.span(next_key)) else null,
+    };
+}
+
+/// Up to `limit` OWNER-DATATYPE items starting after `start_key`, which
+/// must be a next_key this client handed out; see paging.zig.
+pub fn pageOwnerDt(allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8, limit: u32, start_key: ?[]const u8) !Page {
+    const cuid = try allocator.dupeZ(u8, user_id);
+    defer allocator.free(cuid);
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const ckey: ?[:0]u8 = if (start_key) |k| try allocator.dupeZ(u8, k) else null;
+    defer if (ckey) |k| allocator.free(k);
+    const alloc = arenaAlloc(&allocator, false);
+    var raw: dynamo.ItemList = undefined;
+    var next_key: [*c]u8 = null;
+    const rc = dynamo.get_items_owner_dt_page(cuid, cdt, @intCast(limit), if (ckey) |k| k.ptr else null, &alloc, &raw, &next_key);
+    return finishPage(allocator, rc, raw, next_key);
+}
+
+pub fn pageDatatypePk(allocator: std.mem.Allocator, datatype: []const u8, pk: []const u8, limit: u32, start_key: ?[]const u8) !Page {
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const cpk = try allocator.dupeZ(u8, pk);
+    defer allocator.free(cpk);
+    const ckey: ?[:0]u8 = if (start_key) |k| try allocator.dupeZ(u8, k) else null;
+    defer if (ckey) |k| allocator.free(k);
+    const alloc = arenaAlloc(&allocator, false);
+    var raw: dynamo.ItemList = undefined;
+    var next_key: [*c]u8 = null;
+    const rc = dynamo.get_items_datatype_pk_page(cdt, cpk, @intCast(limit), if (ckey) |k| k.ptr else null, &alloc, &raw, &next_key);
+    return finishPage(allocator, rc, raw, next_key);
+}
+
+pub fn pageOwnerDtProj(allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8, proj_expr: []const u8, extra_names: []const u8, limit: u32, start_key: ?[]const u8) !Page {
+    const cuid = try allocator.dupeZ(u8, user_id);
+    defer allocator.free(cuid);
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const cproj = try allocator.dupeZ(u8, proj_expr);
+    defer allocator.free(cproj);
+    const cnames = try allocator.dupeZ(u8, extra_names);
+    defer allocator.free(cnames);
+    const ckey: ?[:0]u8 = if (start_key) |k| try allocator.dupeZ(u8, k) else null;
+    defer if (ckey) |k| allocator.free(k);
+    const alloc = arenaAlloc(&allocator, false);
+    var raw: dynamo.ItemList = undefined;
+    var next_key: [*c]u8 = null;
+    const rc = dynamo.get_items_owner_dt_proj_page(cuid, cdt, cproj, cnames, @intCast(limit), if (ckey) |k| k.ptr else null, &alloc, &raw, &next_key);
+    return finishPage(allocator, rc, raw, next_key);
+}
+
+/// Adapts a Zig page handler to the C ItemPageFn callback, keeping the
+/// first error it returns.
+fn PageSink(comptime Ctx: type, comptime onPage: anytype) type {
+    return struct {
+        ctx: Ctx,
+        err: ?anyerror = null,
+
+        fn call(raw: ?*anyopaque, items: [*c]const [*c]const u8, count: usize) callconv(.c) c_int {
+            const self: *@This() = @ptrCast(@alignCast(raw.?));
+            onPage(self.ctx, items[0..count]) catch |err| {
+                self.err = err;
+                return 1;
+            };
+            return 0;
+        }
+    };
+}
+
+/// Runs the DATATYPE-pk query a page at a time: `onPage(ctx, items)` gets
+/// each page's unmarshalled items as soon as it arrives. The items are
+/// freed when it returns, and an error from it stops the query.
+pub fn eachPageDatatypePk(allocator: std.mem.Allocator, datatype: []const u8, pk: []const u8, ctx: anytype, comptime onPage: anytype) !void {
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const cpk = try allocator.dupeZ(u8, pk);
+    defer allocator.free(cpk);
+    var sink: PageSink(@TypeOf(ctx), onPage) = .{ .ctx = ctx };
+    const rc = dynamo.get_items_datatype_pk_pages(cdt, cpk, &@TypeOf(sink).call, &sink);
+    if (sink.err) |err| return err;
+    if (rc != 0) return error.DynamoError;
+}
+
+/// Page-at-a-time getItemsOwnerDtProjRaw, see eachPageDatatypePk.
+pub fn eachPageOwnerDtProj(allocator: std.mem.Allocator, user_id: []const u8, datatype: []const u8, proj_expr: []const u8, extra_names: []const u8, ctx: anytype, comptime onPage: anytype) !void {
+    const cuid = try allocator.dupeZ(u8, user_id);
+    defer allocator.free(cuid);
+    const cdt = try allocator.dupeZ(u8, datatype);
+    defer allocator.free(cdt);
+    const cproj = try allocator.dupeZ(u8, proj_expr);
+    defer allocator.free(cproj);
+    const cnames = try allocator.dupeZ(u8, extra_names);
+    defer allocator.free(cnames);
+    var sink: PageSink(@TypeOf(ctx), onPage) = .{ .ctx = ctx };
+    const rc = dynamo.get_items_owner_dt_proj_pages(cuid, cdt, cproj, cnames, &@TypeOf(sink).call, &sink);
+    if (sink.err) |err| return err;
+    if (rc != 0) return error.DynamoError;
 }
 
 pub fn getItemsOwnerPk(comptime T: type, allocator: std.mem.Allocator, prefix: []const u8, user_id: []const u8, aid: []const u8) ![]T {
@@ -163,14 +703,10 @@ pub fn getItemsOwnerPk(comptime T: type, allocator: std.mem.Allocator, prefix: [
     defer allocator.free(cuid);
     const caid = try allocator.dupeZ(u8, aid);
     defer allocator.free(caid);
-    var raw = dynamo.get_items_owner_pk(cpx, cuid, caid);
-    defer dynamo.item_list_free(&raw);
-    const result = try allocator.alloc(T, raw.count);
-    server.debugPrint("result count {d} \n", .{result.len});
-    for (0..raw.count) |i| {
-        result[i] = try std.json.parseFromSliceLeaky(T, allocator, std.mem.span(raw.items[i]), .{ .ignore_unknown_fields = true, .allocate = .alloc_always });
-    }
-    return result;
+    const alloc = arenaAlloc(&allocator, true);
+    const raw = dynamo.get_items_owner_pk(cpx, cuid, caid, &alloc);
+    server.debugPrint("result count {d} \n", .{raw.count});
+    return decodeItems(T, allocator, raw);
 }
 
 pub fn updateApprovals(allocator: std.mem.Allocator, email: []const u8) !void {
@@ -208,12 +744,255 @@ pub fn saveItem(allocator: std.mem.Allocator, item_json: []const u8, owner: ?[]c
     if (rc != 0) return error.DynamoError;
 }
 
+/// Saves a typed item, or a std.json.Value object, with one serialization
+/// pass. Fails with error.Forbidden when `owner` may not write it.
 pub fn saveObj(allocator: std.mem.Allocator, item: anytype, owner: ?[]const u8) !void {
-    const item_json: []const u8 = try std.json.Stringify.valueAlloc(allocator, item, .{ .emit_null_optional_fields = false });
-    defer allocator.free(item_json);
-    return saveItem(allocator, item_json, owner);
+    const body = try putItemBody(allocator, item, owner);
+    defer allocator.free(body);
+    if (dynamo.put_item_encoded(body) != 0) return error.DynamoError;
+}
+
+// ------------------------------------------------------------------
+// wire format encoding
+// ------------------------------------------------------------------
+
+/// Writes the complete PutItem request body for `item` into one buffer.
+/// Null optional fields are left out, as std.json does with
+/// emit_null_optional_fields = false. With `owner` set, the item's OWNER
+/// or sharedWith must match it, the same rule check_owner applies.
+pub fn putItemBody(allocator: std.mem.Allocator, item: anytype, owner: ?[]const u8) ![:0]u8 {
+    if (owner) |o| if (!ownerAllows(item, o)) return error.Forbidden;
+    const table = dynamo.dynamo_table_name() orelse return error.MissingTable;
+
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    errdefer out.deinit();
+    const w = &out.writer;
+    try w.writeAll("{\"TableName\":");
+    try std.json.Stringify.encodeJsonString(std.mem.span(table), .{}, w);
+    try w.writeAll(",\"Item\":");
+    if (@TypeOf(item) == std.json.Value) {
+        switch (item) {
+            .object => |obj| try encodeObject(obj, w),
+            else => return error.NotAnObject,
+        }
+    } else try encodeFields(item, w);
+    try w.writeByte('}');
+    return out.toOwnedSliceSentinel(0);
+}
+
+fn ownerAllows(item: anytype, owner: []const u8) bool {
+    const T = @TypeOf(item);
+    if (T == std.json.Value) {
+        const obj = switch (item) {
+            .object => |o| o,
+            else => return true,
+        };
+        const item_owner = switch (obj.get("OWNER") orelse return true) {
+            .string => |str| str,
+            else => return true,
+        };
+        if (std.mem.eql(u8, item_owner, owner)) return true;
+        const shared = switch (obj.get("sharedWith") orelse return false) {
+            .array => |a| a.items,
+            else => return false,
+        };
+        for (shared) |entry| switch (entry) {
+            .string => |str| if (std.mem.eql(u8, str, owner)) return true,
+            else => {},
+        };
+        return false;
+    }
+
+    if (!@hasField(T, "OWNER")) return true;
+    const item_owner: []const u8 = if (@typeInfo(@TypeOf(item.OWNER)) == .optional) item.OWNER orelse return true else item.OWNER;
+    if (std.mem.eql(u8, item_owner, owner)) return true;
+    if (@hasField(T, "sharedWith")) {
+        for (item.sharedWith) |entry| if (std.mem.eql(u8, entry, owner)) return true;
+    }
+    return false;
+}
+
+fn encodeFields(value: anytype, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    try w.writeByte('{');
+    var first = true;
+    inline for (@typeInfo(@TypeOf(value)).@"struct".fields) |f| {
+        const v = @field(value, f.name);
+        const omit = if (@typeInfo(f.type) == .optional) v == null else false;
+        if (!omit) {
+            if (!first) try w.writeByte(',');
+            first = false;
+            try w.writeAll("\"" ++ f.name ++ "\":");
+            try encodeAttr(v, w);
+        }
+    }
+    try w.writeByte('}');
+}
+
+fn encodeAttr(value: anytype, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    const T = @TypeOf(value);
+    if (T == std.json.Value) return encodeValue(value, w);
+    switch (@typeInfo(T)) {
+        .optional => if (value) |v| try encodeAttr(v, w) else try w.writeAll("{\"NULL\":true}"),
+        .bool => try w.writeAll(if (value) "{\"BOOL\":true}" else "{\"BOOL\":false}"),
+        .int, .comptime_int, .float, .comptime_float => try w.print("{{\"N\":\"{d}\"}}", .{value}),
+        .@"enum" => try encodeString(@tagName(value), w),
+        .pointer => |p| switch (p.size) {
+            .one => try encodeAttr(value.*, w),
+            .slice => if (p.child == u8) try encodeString(value, w) else try encodeList(value, w),
+            else => @compileError("cannot encode " ++ @typeName(T) ++ " as a DynamoDB attribute"),
+        },
+        .array => |a| if (a.child == u8) try encodeString(&value, w) else try encodeList(&value, w),
+        .@"struct" => {
+            try w.writeAll("{\"M\":");
+            try encodeFields(value, w);
+            try w.writeByte('}');
+        },
+        else => @compileError("cannot encode " ++ @typeName(T) ++ " as a DynamoDB attribute"),
+    }
+}
+
+fn encodeString(str: []const u8, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    try w.writeAll("{\"S\":");
+    try std.json.Stringify.encodeJsonString(str, .{}, w);
+    try w.writeByte('}');
+}
+
+fn encodeList(items: anytype, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    try w.writeAll("{\"L\":[");
+    for (items, 0..) |item, i| {
+        if (i > 0) try w.writeByte(',');
+        try encodeAttr(item, w);
+    }
+    try w.writeAll("]}");
+}
+
+fn encodeObject(obj: std.json.ObjectMap, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    try w.writeByte('{');
+    var it = obj.iterator();
+    var first = true;
+    while (it.next()) |entry| {
+        if (!first) try w.writeByte(',');
+        first = false;
+        try std.json.Stringify.encodeJsonString(entry.key_ptr.*, .{}, w);
+        try w.writeByte(':');
+        try encodeValue(entry.value_ptr.*, w);
+    }
+    try w.writeByte('}');
+}
+
+fn encodeValue(value: std.json.Value, w: *std.Io.Writer) std.Io.Writer.Error!void {
+    switch (value) {
+        .null => try w.writeAll("{\"NULL\":true}"),
+        .bool => |b| try encodeAttr(b, w),
+        .integer => |n| try encodeAttr(n, w),
+        .float => |f| try encodeAttr(f, w),
+        .number_string => |n| try w.print("{{\"N\":\"{s}\"}}", .{n}),
+        .string => |str| try encodeString(str, w),
+        .array => |a| try encodeList(a.items, w),
+        .object => |obj| {
+            try w.writeAll("{\"M\":");
+            try encodeObject(obj, w);
+            try w.writeByte('}');
+        },
+    }
 }
 
+/// Independent operations sent concurrently; latency is that of the slowest
+/// call. Add ops, call perform once, then read results by the returned index.
+pub const Batch = struct {
+    raw: *dynamo.DynamoBatch,
+    allocator: std.mem.Allocator,
+
+    pub fn init(allocator: std.mem.Allocator) !Batch {
+        const raw = dynamo.dynamo_batch_new() orelse return error.OutOfMemory;
+        return .{ .raw = raw, .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Batch) void {
+        dynamo.dynamo_batch_free(self.raw);
+    }
+
+    fn index(rc: c_int) !usize {
+        if (rc < 0) return error.DynamoError;
+        return @intCast(rc);
+    }
+
+    pub fn getItemPkSk(self: *Batch, prefix: []const u8, pk: []const u8, sk: []const u8) !usize {
+        const cpx = try self.allocator.dupeZ(u8, prefix);
+        defer self.allocator.free(cpx);
+        const cpk = try self.allocator.dupeZ(u8, pk);
+        defer self.allocator.free(cpk);
+        const csk = try self.allocator.dupeZ(u8, sk);
+        defer self.allocator.free(csk);
+        return index(dynamo.dynamo_batch_get_item_pk_sk(self.raw, cpx, cpk, csk));
+    }
+
+    /// Like getItemPkSk, reading only the attributes in `proj` (see
+    /// dynamo.getItemPkSkProj).
+    pub fn getItemPkSkProj(self: *Batch, prefix: []const u8, pk: []const u8, sk: []const u8, proj: []const u8, names: []const u8) !usize {
+        const cpx = try self.allocator.dupeZ(u8, prefix);
+        defer self.allocator.free(cpx);
+        const cpk = try self.allocator.dupeZ(u8, pk);
+        defer self.allocator.free(cpk);
+        const csk = try self.allocator.dupeZ(u8, sk);
+        defer self.allocator.free(csk);
+        const cproj = try self.allocator.dupeZ(u8, proj);
+        defer self.allocator.free(cproj);
+        const cnames = try self.allocator.dupeZ(u8, names);
+        defer self.allocator.free(cnames);
+        return index(dynamo.dynamo_batch_get_item_pk_sk_proj(self.raw, cpx, cpk, csk, cproj, cnames));
+    }
+
+    pub fn saveItem(self: *Batch, item_json: []const u8, owner: ?[]const u8) !usize {
+        const cjson = try self.allocator.dupeZ(u8, item_json);
+        defer self.allocator.free(cjson);
+        const cow: ?[:0]u8 = if (owner) |o| try self.allocator.dupeZ(u8, o) else null;
+        defer if (cow) |z| self.allocator.free(z);
+        const cow_c: [*c]const u8 = if (cow) |z| z.ptr else null;
+        return index(dynamo.dynamo_batch_save_item_plain(self.raw, cjson, cow_c));
+    }
+
+    pub fn saveObj(self: *Batch, item: anytype, owner: ?[]const u8) !usize {
+        // malloc'd, since the batch frees it with the op
+        const body = try putItemBody(std.heap.c_allocator, item, owner);
+        return index(dynamo.dynamo_batch_put_item_encoded(self.raw, body.ptr));
+    }
+
+    pub fn updateApprovals(self: *Batch, email: []const u8) !usize {
+        const cemail = try self.allocator.dupeZ(u8, email);
+        defer self.allocator.free(cemail);
+        return index(dynamo.dynamo_batch_update_approvals(self.raw, cemail));
+    }
+
+    pub fn upsertAppendList(self: *Batch, list_key: []const u8, value: []const u8, prefix: []const u8) !usize {
+        const ckey = try self.allocator.dupeZ(u8, list_key);
+        defer self.allocator.free(ckey);
+        const cval = try self.allocator.dupeZ(u8, value);
+        defer self.allocator.free(cval);
+        const cpfx = try self.allocator.dupeZ(u8, prefix);
+        defer self.allocator.free(cpfx);
+        return index(dynamo.dynamo_batch_upsert_append_list(self.raw, ckey, cval, cpfx));
+    }
+
+    /// Runs every queued op; per-op outcomes are available through ok/item.
+    pub fn perform(self: *Batch) void {
+        _ = dynamo.dynamo_batch_perform(self.raw);
+    }
+
+    pub fn ok(self: *const Batch, idx: usize) bool {
+        return dynamo.dynamo_batch_status(self.raw, @intCast(idx)) == 0;
+    }
+
+    /// Parses the Item fetched by a getItemPkSk op, null if it does not exist.
+    pub fn item(self: *const Batch, comptime T: type, idx: usize) !?T {
+        const result = dynamo.dynamo_batch_result(self.raw, @intCast(idx)) orelse return null;
+        return try std.json.parseFromSliceLeaky(T, self.allocator, std.mem.span(result), .{
+            .ignore_unknown_fields = true,
+            .allocate = .alloc_always,
+        });
+    }
+};
+
 pub const SubscriptionInfo = struct {
     cancelAt: ?f64 = null,
     credits: ?f64 = 10,
@@ -232,15 +1011,13 @@ pub const SubscriptionInfo = struct {
     stripePid: []const u8,
 };
 
+/// The user the auth middleware attached to the request; no parsing, no I/O.
 pub fn getUser(ctx: *Context) !User {
-    const slice = ctx.get("user") orelse {
-        try ctx.request.respond("", .{ .status = .forbidden, .keep_alive = false });
+    const session = ctx.session orelse {
+        try ctx.request.respond("", .{ .status = .forbidden });
         return error.Unauthorized;
     };
-    const parsed = try std.json.parseFromSlice(User, ctx.allocator, slice, .{
-        .ignore_unknown_fields = true,
-    });
-    return parsed.value;
+    return session.user;
 }
 
 pub const User = struct {
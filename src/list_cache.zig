@@ -0,0 +1,217 @@
+//! Whole-list caches for GET /submissions and GET /assignments, held one row
+//! per item keyed by sk instead of as one JSON blob. A write patches the item
+//! it changed into the cached list in place, so saving a submission no
+//! longer throws away a list that took a full DynamoDB query to build, and a
+//! hit joins the rows back into an array in the order the query returned
+//! them, new items last.
+//!
+//! Every patch bumps the list's version, cached or not. A fill reads the
+//! version before it queries DynamoDB and is dropped if it changed, so a
+//! slow fetch never replaces a write that landed while it ran.
+const std = @import("std");
+const sql = @import("sql.zig");
+const dynamo = @import("dynamo.zig");
+
+pub const List = enum {
+    submissions,
+    assignments,
+
+    /// seconds a filled list is served before DynamoDB is asked again;
+    /// patches keep it current meanwhile, writes made elsewhere do not
+    fn ttl(self: List) i64 {
+        return switch (self) {
+            .submissions => 180,
+            .assignments => 600,
+        };
+    }
+};
+
+pub const Entry = struct {
+    sk: []const u8,
+    /// JSON text as listed
+    item: []const u8,
+};
+
+/// expired lists stay this long before the sweeper deletes them, so a fill
+/// still under way never sees its list's version reset
+const sweep_grace_seconds = 300;
+const sweep_interval_seconds = 600;
+const stale_lists = std.fmt.comptimePrint("SELECT user_email, list FROM list_cache_lists WHERE expires_at < unixepoch() - {d}", .{sweep_grace_seconds});
+
+/// The cached list of `owner` as a JSON array, or null when it is not cached.
+pub fn get(allocator: std.mem.Allocator, owner: []const u8, list: List) !?[]const u8 {
+    // one statement, so a concurrent fill or patch is seen whole or not at all
+    var rows = try sql.query(allocator, "SELECT i.item FROM list_cache_lists l LEFT JOIN list_cache i ON i.user_email = l.user_email AND i.list = l.list WHERE l.user_email = ? AND l.list = ? AND l.expires_at > unixepoch() ORDER BY i.pos", .{ owner, @tagName(list) });
+    defer rows.deinit();
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    try out.writer.writeByte('[');
+    var hit = false;
+    var n: usize = 0;
+    while (try rows.next()) |row| {
+        hit = true;
+        // an empty list joins to one row without an item
+        if (row.isNull(0)) continue;
+        if (n > 0) try out.writer.writeByte(',');
+        try out.writer.writeAll(row.blob(0));
+        n += 1;
+    }
+    if (!hit) return null;
+    try out.writer.writeByte(']');
+    return try out.toOwnedSlice();
+}
+
+/// Whether `sk` is in `owner`'s list, expired or not.
+pub fn contains(allocator: std.mem.Allocator, owner: []const u8, list: List, sk: []const u8) !bool {
+    const Found = struct { found: i64 };
+    return (try sql.one(Found, allocator, "SELECT 1 FROM list_cache WHERE user_email = ? AND list = ? AND sk = ?", .{ owner, @tagName(list), sk })) != null;
+}
+
+/// The version to hand to `fill` once the list has been fetched.
+pub fn version(allocator: std.mem.Allocator, owner: []const u8, list: List) !i64 {
+    const Version = struct { version: i64 };
+    const row = try sql.one(Version, allocator, "SELECT version FROM list_cache_lists WHERE user_email = ? AND list = ?", .{ owner, @tagName(list) });
+    return if (row) |r| r.version else 0;
+}
+
+/// Reads the sk of a listed item, null when it has none to be keyed by.
+pub fn entry(allocator: std.mem.Allocator, item: []const u8) ?Entry {
+    const SkOnly = struct { sk: []const u8 };
+    const key = std.json.parseFromSliceLeaky(SkOnly, allocator, item, .{
+        .ignore_unknown_fields = true,
+        .allocate = .alloc_always,
+    }) catch return null;
+    return .{ .sk = key.sk, .item = item };
+}
+
+/// Caches `items` as the whole list of `owner`, unless it was patched since
+/// `seen` was read. Failures are logged; the list is fetched again next time.
+pub fn fill(allocator: std.mem.Allocator, owner: []const u8, list: List, seen: i64, items: []const Entry) void {
+    replace(allocator, owner, list, seen, items) catch |err| {
+        std.log.err("list cache fill failed: {}\n", .{err});
+    };
+}
+
+fn replace(allocator: std.mem.Allocator, owner: []const u8, list: List, seen: i64, items: []const Entry) !void {
+    const name = @tagName(list);
+    try sql.exec(allocator, "BEGIN IMMEDIATE", .{});
+    errdefer sql.exec(allocator, "ROLLBACK", .{}) catch {};
+    if ((try version(allocator, owner, list)) != seen) return sql.exec(allocator, "ROLLBACK", .{});
+    try sql.exec(allocator, "DELETE FROM list_cache WHERE user_email = ? AND list = ?", .{ owner, name });
+    for (items, 0..) |e, pos| {
+        try sql.exec(allocator, "INSERT OR REPLACE INTO list_cache (user_email, list, sk, pos, item) VALUES (?, ?, ?, ?, ?)", .{ owner, name, e.sk, pos, sql.Blob{ .bytes = e.item } });
+    }
+    try sql.exec(allocator, "INSERT INTO list_cache_lists (user_email, list, expires_at, version) VALUES (?, ?, unixepoch() + ?, ?) ON CONFLICT (user_email, list) DO UPDATE SET expires_at = excluded.expires_at", .{ owner, name, list.ttl(), seen });
+    try sql.exec(allocator, "COMMIT", .{});
+}
+
+/// Puts `item` into `owner`'s cached list in place of the one with the same
+/// sk, or appends it. A list that is not cached stays uncached. If the patch
+/// fails the list is invalidated instead, it must not be served stale.
+pub fn put(allocator: std.mem.Allocator, owner: []const u8, list: List, sk: []const u8, item: []const u8) void {
+    patch(allocator, owner, list, sk, item) catch |err| {
+        std.log.err("list cache patch failed: {}\n", .{err});
+        invalidate(allocator, owner, list);
+    };
+}
+
+fn patch(allocator: std.mem.Allocator, owner: []const u8, list: List, sk: []const u8, item: []const u8) !void {
+    const name = @tagName(list);
+    try sql.exec(allocator, "INSERT INTO list_cache_lists (user_email, list, expires_at, version) VALUES (?, ?, unixepoch(), 1) ON CONFLICT (user_email, list) DO UPDATE SET version = version + 1", .{ owner, name });
+    try sql.exec(allocator, "INSERT INTO list_cache (user_email, list, sk, pos, item) " ++
+        "SELECT ?1, ?2, ?3, coalesce((SELECT max(pos) + 1 FROM list_cache WHERE user_email = ?1 AND list = ?2), 0), ?4 " ++
+        "WHERE EXISTS (SELECT 1 FROM list_cache_lists WHERE user_email = ?1 AND list = ?2 AND expires_at > unixepoch()) " ++
+        "ON CONFLICT (user_email, list, sk) DO UPDATE SET item = excluded.item", .{ owner, name, sk, sql.Blob{ .bytes = item } });
+}
+
+/// Stops serving `owner`'s list and drops any fill under way.
+pub fn invalidate(allocator: std.mem.Allocator, owner: []const u8, list: List) void {
+    sql.exec(allocator, "INSERT INTO list_cache_lists (user_email, list, expires_at, version) VALUES (?, ?, unixepoch(), 1) ON CONFLICT (user_email, list) DO UPDATE SET expires_at = min(expires_at, excluded.expires_at), version = version + 1", .{ owner, @tagName(list) }) catch |err| {
+        std.log.err("list cache invalidate failed: {}\n", .{err});
+    };
+}
+
+/// Patches a submission, full or already cut down, into its owner's list.
+/// Backup copies are not listed.
+pub fn putSubmission(allocator: std.mem.Allocator, item: std.json.Value) void {
+    const owner = stringField(item, "OWNER") orelse return;
+    const sk = stringField(item, "sk") orelse return;
+    const fields = dynamo.SubmissionList.fields(allocator, item) catch return invalidateSubmissions(allocator, owner);
+    const text = std.json.Stringify.valueAlloc(allocator, fields, .{}) catch return invalidateSubmissions(allocator, owner);
+    putListed(allocator, owner, sk, text);
+}
+
+/// `putSubmission` for a decoded submission.
+pub fn putSubmissionTyped(allocator: std.mem.Allocator, sub: dynamo.Submission) void {
+    var listed: dynamo.SubmissionList = undefined;
+    inline for (std.meta.fields(dynamo.SubmissionList)) |f| @field(listed, f.name) = @field(sub, f.name);
+    const text = std.json.Stringify.valueAlloc(allocator, listed, .{}) catch return invalidateSubmissions(allocator, sub.OWNER);
+    putListed(allocator, sub.OWNER, sub.sk, text);
+}
+
+fn putListed(allocator: std.mem.Allocator, owner: []const u8, sk: []const u8, text: []const u8) void {
+    dropUnapproved(allocator, owner);
+    if (std.mem.containsAtLeast(u8, text, 1, "BACKUP")) return;
+    put(allocator, owner, .submissions, sk, text);
+}
+
+/// Stops serving both submission lists of `owner`.
+fn invalidateSubmissions(allocator: std.mem.Allocator, owner: []const u8) void {
+    invalidate(allocator, owner, .submissions);
+    dropUnapproved(allocator, owner);
+}
+
+/// The unapproved list is a fetch_cache blob of full items, so it is rebuilt
+/// rather than patched.
+fn dropUnapproved(allocator: std.mem.Allocator, owner: []const u8) void {
+    sql.exec(allocator, "DELETE FROM fetch_cache WHERE data_type = 'submissions_unapproved' AND user_email = ?", .{owner}) catch |err| {
+        std.log.err("cache invalidate failed: {}\n", .{err});
+    };
+}
+
+/// Re-reads a submission another service rewrote and patches it into its
+/// owner's list. The grading Lambda writes DynamoDB itself, all this server
+/// sees is the task callback. Returns the submission as listed, or null if
+/// it could not be read.
+pub fn refreshSubmission(allocator: std.mem.Allocator, pk: []const u8, sk: []const u8) ?std.json.Value {
+    dynamo.forgetCached(allocator, "SUBMISSION", pk, sk) catch {};
+    // the single-item read has to name #owner, the list query does that itself
+    const found = dynamo.getItemPkSkProj(std.json.Value, allocator, "SUBMISSION", pk, sk, dynamo.SubmissionList.projection, dynamo.SubmissionList.names ++ ",\"#owner\":\"OWNER\"") catch |err| {
+        std.log.err("list cache refresh of {s} failed: {}\n", .{ sk, err });
+        return null;
+    };
+    const item = found orelse return null;
+    putSubmission(allocator, item);
+    return item;
+}
+
+/// The string field `name` of a JSON object, null when it is missing or not a string.
+pub fn stringField(item: std.json.Value, name: []const u8) ?[]const u8 {
+    const obj = switch (item) {
+        .object => |o| o,
+        else => return null,
+    };
+    return switch (obj.get(name) orelse return null) {
+        .string => |s| s,
+        else => null,
+    };
+}
+
+/// Deletes lists that expired a while ago, with their items, every ten
+/// minutes. Runs on its own thread.
+pub fn sweep(io: std.Io) void {
+    while (true) {
+        sweepOnce(std.heap.c_allocator) catch |err| {
+            std.log.err("list cache sweep failed: {}\n", .{err});
+        };
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(sweep_interval_seconds * 1000), std.Io.Clock.awake) catch {};
+    }
+}
+
+fn sweepOnce(allocator: std.mem.Allocator) !void {
+    try sql.exec(allocator, "BEGIN IMMEDIATE", .{});
+    errdefer sql.exec(allocator, "ROLLBACK", .{}) catch {};
+    try sql.exec(allocator, "DELETE FROM list_cache WHERE (user_email, list) IN (" ++ stale_lists ++ ")", .{});
+    try sql.exec(allocator, "DELETE FROM list_cache_lists WHERE (user_email, list) IN (" ++ stale_lists ++ ")", .{});
+    try sql.exec(allocator, "COMMIT", .{});
+}
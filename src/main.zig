@@ -4,6 +4,13 @@ const server = @import("server.zig");
 const r = @import("routes.zig");
 const dynamo = @import("dynamo.zig");
 const auth = @import("auth.zig");
+const sql = @import("sql.zig");
+const tasks = @import("tasks.zig");
+const task_stream = @import("task_stream.zig");
+const dispatcher = @import("dispatcher.zig");
+const paging = @import("paging.zig");
+const changes = @import("changes.zig");
+const list_cache = @import("list_cache.zig");
 pub fn main(init: std.process.Init) !void {
   
     // first we set up a logger or else no debug logs will be shown in release mode
@@ -19,12 +26,25 @@ pub fn main(init: std.process.Init) !void {
     var settings = try Config.init(init.io, "config.json", allocator);
     defer settings.deinit(allocator);
     r.secret = std.mem.span(dynamo.c.getenv("JWT_SECRET"));   
+    paging.secret = r.secret.?;
+    dynamo.initClient() catch |err| std.debug.print("dynamo client: {}\n", .{err});
+    try dynamo.configureCache(allocator, settings.itemCacheBytes, settings.itemCacheTtl);
+    const sweeper = try std.Thread.spawn(.{}, sql.sweepFetchCache, .{io});
+    sweeper.detach();
+    const archiver = try std.Thread.spawn(.{}, tasks.archiveFinished, .{io});
+    archiver.detach();
+    const pinger = try std.Thread.spawn(.{}, task_stream.heartbeat, .{io});
+    pinger.detach();
+    const pruner = try std.Thread.spawn(.{}, changes.prune, .{io});
+    pruner.detach();
+    const list_sweeper = try std.Thread.spawn(.{}, list_cache.sweep, .{io});
+    list_sweeper.detach();
+    try dispatcher.start(io, settings.dispatchWorkers, settings.dispatchInFlight);
     // initialize
-    var routes = std.ArrayList(server.Route){};
-    try routes.appendSlice(allocator, r.routes);
-    defer routes.deinit(allocator);
+    var router = try server.Router.init(allocator, r.routes);
+    defer router.deinit();
     var s = try server.Server.init(init.gpa, init.io, &settings);
 
     // run actual exit
-    try s.runServer(.{ .routes = routes });
+    try s.runServer(router);
 }
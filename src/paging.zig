@@ -0,0 +1,99 @@
+//! Cursor pagination for the list routes. `?limit=N` returns one DynamoDB
+//! page as `{"items":[...],"nextCursor":"..."}` and `?cursor=` continues
+//! after it; without either the route answers with the whole list as
+//! before. A cursor is the page's LastEvaluatedKey, base64url encoded and
+//! signed together with the list it belongs to, so clients can neither
+//! forge a start key nor reuse one on another user's list.
+const std = @import("std");
+const server = @import("server.zig");
+
+const HmacSha256 = std.crypto.auth.hmac.sha2.HmacSha256;
+const b64 = std.base64.url_safe_no_pad;
+
+/// page size when only a cursor is given
+pub const default_limit = 100;
+/// largest page a client may ask for
+pub const max_limit = 1000;
+
+/// signing key, the JWT secret; set once at startup
+pub var secret: []const u8 = "";
+
+pub const Request = struct {
+    limit: u32,
+    /// LastEvaluatedKey to continue from, verified; null for the first page
+    start_key: ?[]const u8,
+};
+
+/// Reads `limit` and `cursor` from the query string. Returns null when
+/// neither is present, error.BadPageRequest when either is malformed or the
+/// cursor was not issued for `scope`.
+pub fn parse(allocator: std.mem.Allocator, request: *std.http.Server.Request, scope: []const u8) !?Request {
+    const limit = server.Parser.queryValue(request, "limit");
+    const cursor = server.Parser.queryValue(request, "cursor");
+    if (limit == null and cursor == null) return null;
+    const n = if (limit) |l| std.fmt.parseInt(u32, l, 10) catch return error.BadPageRequest else default_limit;
+    if (n == 0 or n > max_limit) return error.BadPageRequest;
+    return .{
+        .limit = n,
+        .start_key = if (cursor) |c| try decodeCursor(allocator, scope, c) else null,
+    };
+}
+
+fn sign(scope: []const u8, key: []const u8) [HmacSha256.mac_length]u8 {
+    var mac: [HmacSha256.mac_length]u8 = undefined;
+    var h = HmacSha256.init(secret);
+    h.update("cursor\x00");
+    h.update(scope);
+    h.update("\x00");
+    h.update(key);
+    h.final(&mac);
+    return mac;
+}
+
+/// `<base64url key>.<base64url mac>`
+pub fn encodeCursor(allocator: std.mem.Allocator, scope: []const u8, key: []const u8) ![]const u8 {
+    const mac = sign(scope, key);
+    const key_len = b64.Encoder.calcSize(key.len);
+    const out = try allocator.alloc(u8, key_len + 1 + b64.Encoder.calcSize(mac.len));
+    _ = b64.Encoder.encode(out[0..key_len], key);
+    out[key_len] = '.';
+    _ = b64.Encoder.encode(out[key_len + 1 ..], &mac);
+    return out;
+}
+
+fn decodeCursor(allocator: std.mem.Allocator, scope: []const u8, cursor: []const u8) ![]const u8 {
+    const dot = std.mem.lastIndexOfScalar(u8, cursor, '.') orelse return error.BadPageRequest;
+    const key_b64 = cursor[0..dot];
+    const mac_b64 = cursor[dot + 1 ..];
+
+    var mac: [HmacSha256.mac_length]u8 = undefined;
+    const mac_len = b64.Decoder.calcSizeForSlice(mac_b64) catch return error.BadPageRequest;
+    if (mac_len != mac.len) return error.BadPageRequest;
+    b64.Decoder.decode(&mac, mac_b64) catch return error.BadPageRequest;
+
+    const key_len = b64.Decoder.calcSizeForSlice(key_b64) catch return error.BadPageRequest;
+    const key = try allocator.alloc(u8, key_len);
+    b64.Decoder.decode(key, key_b64) catch return error.BadPageRequest;
+
+    const expected = sign(scope, key);
+    if (!std.crypto.timing_safe.eql([HmacSha256.mac_length]u8, mac, expected)) return error.BadPageRequest;
+    return key;
+}
+
+/// Sends `items` (JSON texts) with the cursor of the page after them.
+pub fn respond(allocator: std.mem.Allocator, request: *std.http.Server.Request, headers: []const std.http.Header, scope: []const u8, items: []const []const u8, next_key: ?[]const u8) !void {
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    const w = &out.writer;
+    try w.writeAll("{\"items\":[");
+    for (items, 0..) |item, i| {
+        if (i > 0) try w.writeByte(',');
+        try w.writeAll(item);
+    }
+    try w.writeByte(']');
+    if (next_key) |key| {
+        // base64url needs no JSON escaping
+        try w.print(",\"nextCursor\":\"{s}\"", .{try encodeCursor(allocator, scope, key)});
+    }
+    try w.writeByte('}');
+    try request.respond(out.written(), .{ .extra_headers = headers });
+}
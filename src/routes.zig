@@ -13,7 +13,7 @@ const assignment_routes = @import("routes/assignment_routes.zig");
 const report_routes = @import("routes/report_routes.zig");
 const grade_routes = @import("routes/grade_routes.zig");
 const task_routes = @import("routes/task_routes.zig");
-const sql = @import("sql.zig");
+const session = @import("session.zig");
 pub var secret: ?[]const u8 = null; 
 
 /// primary route registration
@@ -56,6 +56,9 @@ pub const routes = &[_]server.Route{
     // task routes
     .{ .path = "/tasks/update", .method = .POST, .callback = task_routes.updateTask },
     .{ .path = "/tasks/optimize", .method = .POST, .callback = task_routes.updateOptimizeTask },
+    .{ .path = "/tasks/stream", .middleware = &[_]Callback{
+        authMiddleware,
+    }, .callback = task_routes.streamTasks },
     .{ .path = "/tasks/grading-status", .middleware = &[_]Callback{
         authMiddleware,
     }, .callback = task_routes.getGradingStatus },
@@ -70,54 +73,49 @@ pub const routes = &[_]server.Route{
     .{ .path = "/grade", .method = .POST, .middleware = &[_]Callback{
         authMiddleware,
     }, .callback = grade_routes.grade },
-    .{ .path = "/grade/criterion", .method = .POST, .middleware = &[_]Callback{
+    // waits on the parser's reply, so it runs on the slow pool
+    .{ .path = "/grade/criterion", .method = .POST, .class = .slow, .middleware = &[_]Callback{
         authMiddleware,
     }, .callback = grade_routes.gradeCriterion },
     .{ .path = "/grade/optimize", .method = .POST, .middleware = &[_]Callback{
         authMiddleware,
     }, .callback = grade_routes.optimize },
+
+    // item cache counters, admins only
+    .{ .path = "/cache/stats", .middleware = &[_]Callback{
+        authMiddleware,
+    }, .callback = cacheStats },
 };
 
 pub fn index(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const body = try fmt.renderTemplate(c.io, "./static/index.html", .{ .value = user.pk }, c.allocator);
     defer c.allocator.free(body);
-    try c.request.respond(body, .{ .status = .ok, .keep_alive = false });
+    try c.request.respond(body, .{ .status = .ok });
 }
 
-fn authMiddleware(c: *Context) !void {
-    const cookies = try server.Parser.parseCookies(c.allocator, c.request);
-    const token = cookies.get("userToken");
-    if (token == null) {
-        try c.request.respond("", .{ .status = .forbidden, .keep_alive = false });
-        return error.Client;
-    }
-    const decoded = try auth.decodeAuth(auth.AuthBody, c.allocator, token.?, secret);
-
-    const cached = sql.getAll(c.allocator, "SELECT data FROM fetch_cache WHERE data_type = 'user' AND name = ? AND updated_at > datetime('now', '-5 minutes') LIMIT 1", .{decoded.user}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            try c.put("user", data);
-            return;
-        }
-    }
-
-    const c_str = try std.heap.c_allocator.dupeZ(u8, decoded.user);
-    defer std.heap.c_allocator.free(c_str);
-    const result = dynamo.c.get_item_pk_sk("USER", c_str, c_str);
-    if (result == null) {
-        try c.request.respond("", .{ .status = .forbidden, .keep_alive = false });
+fn cacheStats(c: *Context) !void {
+    const user = try dynamo.getUser(c);
+    if (!user.isAdmin) {
+        try c.request.respond("", .{ .status = .forbidden });
         return;
     }
-    defer std.c.free(result);
-    const slice = std.mem.span(result);
+    try server.sendJson(c.allocator, c.request, dynamo.cacheStats(), .{});
+}
 
-    sql.exec(c.allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data) VALUES ('user', ?, ?,?)", .{ decoded.user, decoded.user, slice }) catch |err| {
-        try c.request.respond("", .{ .status = .internal_server_error, .keep_alive = false });
-        return err;
+fn authMiddleware(c: *Context) !void {
+    const token = server.Parser.cookie(c.request, "userToken") orelse {
+        try c.request.respond("", .{ .status = .forbidden });
+        return error.Client;
     };
-
-    const owned = try c.allocator.dupe(u8, slice);
-    try c.put("user", owned);
+    const entry = (session.lookup(c.io, token) catch null) orelse
+        (session.load(c.io, token, secret) catch |err| {
+            try c.request.respond("", .{ .status = .forbidden });
+            return err;
+        }) orelse {
+        try c.request.respond("", .{ .status = .forbidden });
+        return error.Client;
+    };
+    c.session = entry;
+    try c.put("user", entry.user_json);
 }
@@ -9,6 +9,8 @@ const auth = @import("../auth.zig");
 const sql = @import("../sql.zig");
 const utils = @import("../utils.zig");
 const types = @import("../schema.zig");
+const paging = @import("../paging.zig");
+const list_cache = @import("../list_cache.zig");
 
 const AssignmentParams = struct {
     cid: []const u8,
@@ -47,6 +49,16 @@ pub fn getAssignment(c: *Context) !void {
     return;
 }
 
+/// assignments shared with the user's group are listed separately
+fn isShared(allocator: std.mem.Allocator, item: []const u8) bool {
+    const PkOnly = struct { pk: []const u8 };
+    const pk_check = std.json.parseFromSliceLeaky(PkOnly, allocator, item, .{
+        .ignore_unknown_fields = true,
+        .allocate = .alloc_always,
+    }) catch return true;
+    return std.ascii.indexOfIgnoreCase(pk_check.pk, "shared") != null;
+}
+
 pub fn getAllAssignments(c: *Context) !void {
     const headers = try server.makeHeaders(c.allocator, c.request);
     const user = dynamo.getUser(c) catch {
@@ -54,44 +66,49 @@ pub fn getAllAssignments(c: *Context) !void {
         return;
     };
 
-    const cached = sql.getAll(c.allocator, "SELECT data FROM fetch_cache WHERE data_type = 'assignments' AND name = ? AND updated_at > datetime('now', '-10 minutes') LIMIT 1", .{user.email}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            try c.request.respond(data, .{ .extra_headers = headers });
-            return;
+    // pages skip list_cache, which only holds the whole list
+    const scope = try std.fmt.allocPrint(c.allocator, "assignments:{s}", .{user.email});
+    const page_request = paging.parse(c.allocator, c.request, scope) catch {
+        try c.request.respond("", .{ .status = .bad_request, .extra_headers = headers });
+        return;
+    };
+    if (page_request) |p| {
+        const page = try dynamo.pageOwnerDt(c.allocator, user.email, "ASSIGNMENT", p.limit, p.start_key);
+        var kept: usize = 0;
+        for (page.items) |item| {
+            if (isShared(c.allocator, item)) continue;
+            page.items[kept] = item;
+            kept += 1;
         }
+        try paging.respond(c.allocator, c.request, headers, scope, page.items[0..kept], page.next_key);
+        return;
     }
 
-    const cuid = try c.allocator.dupeZ(u8, user.email);
-    defer c.allocator.free(cuid);
-    const cdt = try c.allocator.dupeZ(u8, "ASSIGNMENT");
-    defer c.allocator.free(cdt);
+    if (list_cache.get(c.allocator, user.email, .assignments) catch null) |body| {
+        try c.request.respond(body, .{ .extra_headers = headers });
+        return;
+    }
 
-    var raw = dynamo.c.get_items_owner_dt(cuid, cdt);
-    defer dynamo.c.item_list_free(&raw);
+    const seen = list_cache.version(c.allocator, user.email, .assignments) catch null;
+    const items = try dynamo.getItemsOwnerDtRaw(c.allocator, user.email, "ASSIGNMENT");
 
     var list: std.ArrayList(u8) = .{};
+    var entries: std.ArrayList(list_cache.Entry) = .empty;
+    var cacheable = seen != null;
     try list.append(c.allocator, '[');
     var first = true;
-    for (0..@intCast(raw.count)) |i| {
-        const item = std.mem.span(raw.items[i]);
-        const PkOnly = struct { pk: []const u8 };
-        const pk_check = std.json.parseFromSliceLeaky(PkOnly, c.allocator, item, .{
-            .ignore_unknown_fields = true,
-            .allocate = .alloc_always,
-        }) catch continue;
-        if (std.ascii.indexOfIgnoreCase(pk_check.pk, "shared") != null) continue;
+    for (items) |item| {
+        if (isShared(c.allocator, item)) continue;
         if (!first) try list.append(c.allocator, ',');
         try list.appendSlice(c.allocator, item);
         first = false;
+        if (!cacheable) continue;
+        if (list_cache.entry(c.allocator, item)) |e| try entries.append(c.allocator, e) else cacheable = false;
     }
     try list.append(c.allocator, ']');
     const json_body = try list.toOwnedSlice(c.allocator);
 
-    sql.exec(c.allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data) VALUES ('assignments', ?, ?, ?)", .{ user.email, user.email, json_body }) catch |err| {
-        server.debugPrint("cache write failed: {}\n", .{err});
-    };
+    if (cacheable) list_cache.fill(c.allocator, user.email, .assignments, seen.?, entries.items);
 
     try c.request.respond(json_body, .{ .extra_headers = headers });
 }
@@ -125,18 +142,20 @@ pub fn saveAssignment(c: *Context) !void {
         return;
     }
 
-    const modified_body = try std.json.Stringify.valueAlloc(c.allocator, parsed, .{ .emit_null_optional_fields = false });
-    dynamo.saveItem(c.allocator, modified_body, user.email) catch {
+    dynamo.saveObj(c.allocator, parsed, user.email) catch {
         try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
     };
 
-    invalidateAssignmentCache(user.email);
+    // shared assignments are not in the owner's list
+    if (std.ascii.indexOfIgnoreCase(parsed.pk, "shared") == null) {
+        if (std.json.Stringify.valueAlloc(c.allocator, parsed, .{ .emit_null_optional_fields = false })) |item| {
+            list_cache.put(c.allocator, parsed.OWNER, .assignments, parsed.sk, item);
+        } else |_| invalidateAssignmentCache(parsed.OWNER);
+    }
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
 
 pub fn invalidateAssignmentCache(user_email: []const u8) void {
-    sql.exec(std.heap.c_allocator, "DELETE FROM fetch_cache WHERE data_type IN ('assignments', 'assignment') AND user_email = ?", .{user_email}) catch |err| {
-        std.debug.print("cache invalidate failed: {}\n", .{err});
-    };
+    list_cache.invalidate(std.heap.c_allocator, user_email, .assignments);
 }
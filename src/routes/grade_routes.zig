@@ -3,15 +3,10 @@ const std = @import("std");
 const server = @import("../server.zig");
 const Context = server.Context;
 const dynamo = @import("../dynamo.zig");
-const sub_routes = @import("submission_routes.zig");
 const tasks = @import("../tasks.zig");
 const sql = @import("../sql.zig");
 const types = @import("../schema.zig");
-
-fn localPost(payload: [*:0]u8) void {
-    _ = dynamo.c.http_post("http://localhost:3002", payload);
-    std.heap.c_allocator.free(std.mem.span(payload));
-}
+const dispatcher = @import("../dispatcher.zig");
 
 const OptimizeBody = struct {
     sk: []const u8,
@@ -63,7 +58,7 @@ pub fn optimize(c: *Context) !void {
     const criteria = rubric.criteria;
     for (0..criteria.len) |i| {
         if (criteria[i].isManuallyGraded) continue;
-        const token = tasks.createTask(c.allocator, "optimize_criterion",  dynamo.stringStem(assignment.sk), user.email, .{ .body = parsed }) catch |err| {
+        const token = tasks.createTask(c.io, c.allocator, "optimize_criterion",  dynamo.stringStem(assignment.sk), user.email, .{ .body = parsed }) catch |err| {
             std.log.err("{}", .{err});
 
             try c.request.respond("not able to create token", .{ .status = .internal_server_error, .extra_headers = headers });
@@ -78,21 +73,11 @@ pub fn optimize(c: *Context) !void {
             .callback_token = token,
         };
         const payload = try std.json.Stringify.valueAlloc(c.allocator, task_obj, .{ .emit_null_optional_fields = false });
-        const cpayload = try std.heap.c_allocator.dupeZ(u8, payload);
-
-        if (dynamo.c.getenv("LOCAL_PARSER") != null) {
-            const t = try std.Thread.spawn(.{}, localPost, .{cpayload});
-            t.detach();
-        } else {
-            defer std.heap.c_allocator.free(cpayload);
-            const fn_env = dynamo.c.getenv("PARSER");
-            const cname: [*c]const u8 = if (fn_env != null) fn_env else "ai-parser-AiParserLambda8BD704BF-vi2FDv4rLltq";
-            const rc = dynamo.c.invoke_lambda(cname, cpayload);
-            if (rc != 0) {
-                try c.request.respond("", .{ .status = .internal_server_error });
-                return;
-            }
-        }
+        dispatcher.enqueue(c.io, c.allocator, token, payload, .{}) catch |err| {
+            std.log.err("{}", .{err});
+            try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
+            return;
+        };
     }
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
@@ -121,7 +106,7 @@ pub fn grade(c: *Context) !void {
     });
     const current_task = sql.getOne(
         c.allocator,
-        "SELECT status, json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue WHERE user_email = ? AND task = 'grade_submission' AND is_complete = 0 AND json_extract(json_extract(meta_data, '$.body'), '$.sk') = ? AND updated_at >= datetime('now', '-1 minutes', 'utc')",
+        "SELECT status, sk, pk, step, 5 steps FROM task_queue WHERE user_email = ? AND task = 'grade_submission' AND is_complete = 0 AND sk = ? AND updated_at >= datetime('now', '-1 minutes', 'utc')",
         .{ user.email, partial.sk },
     ) catch null;
     if (current_task != null) {
@@ -129,7 +114,7 @@ pub fn grade(c: *Context) !void {
         try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
         return;
     }
-    const token = tasks.createTask(c.allocator, "grade_submission", dynamo.stringStem(partial.sk), user.email, .{ .body = body }) catch |err| {
+    const token = tasks.createTask(c.io, c.allocator, "grade_submission", dynamo.stringStem(partial.sk), user.email, .{ .body = body }) catch |err| {
         std.debug.print("error: user-{s} err-{}\n", .{ user.email, err });
         try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
@@ -147,23 +132,12 @@ pub fn grade(c: *Context) !void {
         \\{{"action":"gradeSubmission","pr":true,"req":{{"pr":true,"body":{s},"user":{s},"query":{{}},"params":{{}},"useClaude":{s}}},"revisionModel":{s},"taskToken":"{s}","callback":"{s}/tasks/update"}}
     , .{ body, user_json, use_claude, rev_model, token, task_endpoint });
 
-    const cpayload = try std.heap.c_allocator.dupeZ(u8, payload);
-    defer std.heap.c_allocator.free(cpayload);
-
-    const rc = if (dynamo.c.getenv("LOCAL_PARSER") != null) blk: {
-        break :blk dynamo.c.http_post("http://localhost:3002", cpayload);
-    } else blk: {
-        const fn_env = dynamo.c.getenv("PARSER");
-        const cname: [*c]const u8 = if (fn_env != null) fn_env else "ai-parser-AiParserLambda8BD704BF-vi2FDv4rLltq";
-        break :blk dynamo.c.invoke_lambda(cname, cpayload);
-    };
-
-    if (rc != 0) {
-        try c.request.respond("", .{ .status = .internal_server_error });
+    dispatcher.enqueue(c.io, c.allocator, token, payload, .{}) catch |err| {
+        std.debug.print("error: user-{s} err-{}\n", .{ user.email, err });
+        try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
-    }
+    };
 
-    sub_routes.invalidateSubmissionCache(user.email);
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
 
@@ -201,7 +175,7 @@ pub fn gradeCriterion(c: *Context) !void {
 
     const criterion_json = try std.json.Stringify.valueAlloc(c.allocator, partial.criterion, .{});
     const instructions_json = try std.json.Stringify.valueAlloc(c.allocator, partial.instructions, .{});
-    const token = tasks.createTask(c.allocator, "grade_criterion", dynamo.stringStem(partial.criterion), user.email, .{ .criterion = partial.criterion, .instructions = partial.instructions }) catch |err| {
+    const token = tasks.createTask(c.io, c.allocator, "grade_criterion", dynamo.stringStem(partial.criterion), user.email, .{ .criterion = partial.criterion, .instructions = partial.instructions }) catch |err| {
         std.debug.print("{any}\n", .{err});
         try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
@@ -222,11 +196,11 @@ pub fn gradeCriterion(c: *Context) !void {
 
     if (response == null) {
         try c.request.respond("", .{ .status = .internal_server_error });
-        try tasks.updateTask(c.allocator, token, "error", 0, false, .{ .criterion = criterion_json, .instructions = instructions_json, .response = response });
+        try tasks.updateTask(c.io, c.allocator, token, "error", 0, false, .{ .criterion = criterion_json, .instructions = instructions_json, .response = response });
 
         return;
     }
-    try tasks.updateTask(c.allocator, token, "complete", 0, true, .{ .criterion = partial.criterion, .instructions = partial.instructions, .response = response });
+    try tasks.updateTask(c.io, c.allocator, token, "complete", 0, true, .{ .criterion = partial.criterion, .instructions = partial.instructions, .response = response });
 
     defer std.c.free(response);
 
@@ -265,22 +239,17 @@ pub fn gradeCriterionAsync(c: *Context) !void {
         \\{{"action":"gradeCriterion","pr":true,"req":{{"criterion":{s},"pr":true,"body":{s},"user":{s},"query":{{}},"params":{{}},"useClaude":{s}}},"revisionModel":{s}}}
     , .{ criterion_json, body, user_json, use_claude, rev_model });
 
-    const cpayload = try std.heap.c_allocator.dupeZ(u8, payload);
-    defer std.heap.c_allocator.free(cpayload);
-
-    const rc = if (dynamo.c.getenv("LOCAL_PARSER") != null) blk: {
-        break :blk dynamo.c.http_post("http://localhost:3002", cpayload);
-    } else blk: {
-        const fn_env = dynamo.c.getenv("PARSER");
-        const cname: [*c]const u8 = if (fn_env != null) fn_env else "ai-parser-AiParserLambda8BD704BF-vi2FDv4rLltq";
-        break :blk dynamo.c.invoke_lambda(cname, cpayload);
+    // the parser does not call back for this action, so the task is done once sent
+    const token = tasks.createTask(c.io, c.allocator, "grade_criterion", dynamo.stringStem(partial.criterion), user.email, .{ .criterion = partial.criterion, .instructions = partial.instructions }) catch |err| {
+        std.debug.print("{any}\n", .{err});
+        try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
+        return;
     };
-
-    if (rc != 0) {
-        try c.request.respond("", .{ .status = .internal_server_error });
+    dispatcher.enqueue(c.io, c.allocator, token, payload, .{ .complete_on_send = true }) catch |err| {
+        std.debug.print("{any}\n", .{err});
+        try c.request.respond("", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
-    }
+    };
 
-    sub_routes.invalidateSubmissionCache(user.email);
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
@@ -7,7 +7,10 @@ const Callback = server.Callback;
 const dynamo = @import("../dynamo.zig");
 const auth = @import("../auth.zig");
 const sql = @import("../sql.zig");
+const session = @import("../session.zig");
 const utils = @import("../utils.zig");
+const changes = @import("../changes.zig");
+const list_cache = @import("../list_cache.zig");
 const schema = @import("../schema/assignment.zig");
 
 fn stringStem(s: []const u8) []const u8 {
@@ -144,13 +147,25 @@ const ClassBasic = struct {
     name: []const u8 = "none",
 };
 
-fn createAndSaveReport(
+const SubmissionStatus = struct {
+    status: []const u8 = "",
+};
+
+/// Logs a batched side effect that could not be queued or did not succeed.
+fn logBatchFailure(batch: *const dynamo.Batch, op: anyerror!usize, what: []const u8) void {
+    const idx = op catch |err| {
+        std.debug.print("{s} failed: {}\n", .{ what, err });
+        return;
+    };
+    if (!batch.ok(idx)) std.debug.print("{s} failed\n", .{what});
+}
+
+fn buildReport(
     allocator: std.mem.Allocator,
-    owner: []const u8,
     submission: dynamo.Submission,
     assignment: schema.Assignment,
     class_name: []const u8,
-) !void {
+) !std.json.Value {
     var obj = std.json.ObjectMap.init(allocator);
 
     const pk_stem = stringStem(submission.pk);
@@ -222,12 +237,7 @@ fn createAndSaveReport(
     }
     try obj.put("considerations", .{ .array = cons_arr });
 
-    const report_json = try std.json.Stringify.valueAlloc(
-        allocator,
-        std.json.Value{ .object = obj },
-        .{ .emit_null_optional_fields = false },
-    );
-    try dynamo.saveItem(allocator, report_json, owner);
+    return .{ .object = obj };
 }
 
 pub fn approveSubmission(c: *Context) !void {
@@ -249,16 +259,24 @@ pub fn approveSubmission(c: *Context) !void {
         try c.request.respond("{\"error\":\"You do not have access to this submission\"}", .{ .status = .forbidden, .extra_headers = headers });
         return;
     }
-    const is_new = try utils.isItemNew(c.allocator, user.email, "submission", parsed.pk, parsed.sk);
+
+    // The reads are independent: the existing submission (new-item check and
+    // status transition) plus the assignment and class the report needs.
+    const pk_stem = stringStem(parsed.pk);
+    const sk_stem = stringStem(parsed.sk);
+    var reads = try dynamo.Batch.init(c.allocator);
+    defer reads.deinit();
+    const existing_op = try reads.getItemPkSkProj("SUBMISSION", pk_stem, sk_stem, "#s", "\"#s\":\"status\"");
+    const assignment_op = try reads.getItemPkSk("ASSIGNMENT", parsed.classId, parsed.assignmentId);
+    const class_op = try reads.getItemPkSkProj("CLASS", user.email, parsed.classId, "#n", "\"#n\":\"name\"");
+    reads.perform();
+
+    const existing = try reads.item(SubmissionStatus, existing_op);
+    const is_new = existing == null;
     if (is_new and (if (user.group) |g| g.len == 0 else true) and !user.isAdmin) {
         try c.request.respond("{\"error\":\"Cannot approve new submission\"}", .{ .status = .bad_request, .extra_headers = headers });
         return;
     }
-
-    // Fetch existing to detect status transition
-    const pk_stem = stringStem(parsed.pk);
-    const sk_stem = stringStem(parsed.sk);
-    const existing = try dynamo.getItemPkSk(dynamo.Submission, c.allocator, "SUBMISSION", pk_stem, sk_stem);
     const was_approved = if (existing) |ex| std.mem.eql(u8, ex.status, "approved") else false;
 
     parsed.status = "approved";
@@ -268,13 +286,17 @@ pub fn approveSubmission(c: *Context) !void {
         try c.request.respond("{\"error\":\"Internal Server Error\"}", .{ .status = .internal_server_error, .extra_headers = headers });
         return;
     };
-    // Tracked events and report on first approval
+    changes.record(c.allocator, parsed.OWNER, parsed.pk, parsed.sk, false);
+    list_cache.putSubmissionTyped(c.allocator, parsed);
+    // Tracked events and report on first approval, sent together once the
+    // submission itself is saved
     if (!was_approved or true) {
-        dynamo.updateApprovals(c.allocator, user.email) catch |err| {
-            std.debug.print("updateApprovals failed: {}\n", .{err});
-        };
+        var effects = try dynamo.Batch.init(c.allocator);
+        defer effects.deinit();
+        const approvals_op = effects.updateApprovals(user.email);
 
         const group = if (user.group) |g| if (g.len > 0) g else "INDIVIDUAL" else "INDIVIDUAL";
+        var list_op: ?(anyerror!usize) = null;
         if (parsed.externalId.len > 0) {
             // Rearrange externalId segments: original [0:1:2:3:4] → [email:2:4:1:3:0]
             var parts: [8][]const u8 = undefined;
@@ -287,32 +309,36 @@ pub fn approveSubmission(c: *Context) !void {
             }
             if (part_count >= 5) {
                 const val = try std.fmt.allocPrint(c.allocator, "{s}:{s}:{s}:{s}:{s}:{s}", .{ user.email, parts[2], parts[4], parts[1], parts[3], parts[0] });
-                dynamo.upsertAppendList(c.allocator, "externalApproval", val, group) catch |err| {
-                    std.debug.print("upsertAppendList externalApproval failed: {}\n", .{err});
-                };
+                list_op = effects.upsertAppendList("externalApproval", val, group);
             }
         } else {
             const val = try std.fmt.allocPrint(c.allocator, "{s}:{s}", .{ user.email, stringStem(parsed.sk) });
-            dynamo.upsertAppendList(c.allocator, "directApproval", val, group) catch |err| {
-                std.debug.print("upsertAppendList directApproval failed: {}\n", .{err});
-            };
+            list_op = effects.upsertAppendList("directApproval", val, group);
         }
 
         // Create/update report
-        const assignment_sk = parsed.assignmentId;
-        if (try dynamo.getItemPkSk(schema.Assignment, c.allocator, "ASSIGNMENT", parsed.classId, assignment_sk)) |assignment| {
+        var report_op: ?(anyerror!usize) = null;
+        if (try reads.item(schema.Assignment, assignment_op)) |assignment| {
             const class_name = blk: {
-                if (try dynamo.getItemPkSk(ClassBasic, c.allocator, "CLASS", user.email, parsed.classId)) |cls| {
+                if (try reads.item(ClassBasic, class_op)) |cls| {
                     break :blk cls.name;
                 }
                 break :blk @as([]const u8, "none");
             };
-            createAndSaveReport(c.allocator, user.email, parsed, assignment, class_name) catch |err| {
-                std.debug.print("createAndSaveReport failed: {}\n", .{err});
-            };
+            if (buildReport(c.allocator, parsed, assignment, class_name)) |report| {
+                report_op = effects.saveObj(report, user.email);
+            } else |err| {
+                std.debug.print("buildReport failed: {}\n", .{err});
+            }
         } else {
-            std.debug.print("approveSubmission: assignment not found classId={s} assignmentId={s}\n", .{ parsed.classId, assignment_sk });
+            std.debug.print("approveSubmission: assignment not found classId={s} assignmentId={s}\n", .{ parsed.classId, parsed.assignmentId });
         }
+
+        effects.perform();
+        session.invalidateUser(c.io, user.email) catch {};
+        logBatchFailure(&effects, approvals_op, "updateApprovals");
+        if (list_op) |op| logBatchFailure(&effects, op, "upsertAppendList");
+        if (report_op) |op| logBatchFailure(&effects, op, "createAndSaveReport");
     }
 
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
@@ -7,13 +7,98 @@ const Callback = server.Callback;
 const dynamo = @import("../dynamo.zig");
 const auth = @import("../auth.zig");
 const sql = @import("../sql.zig");
+const session = @import("../session.zig");
 const utils = @import("../utils.zig");
+const paging = @import("../paging.zig");
+const changes = @import("../changes.zig");
+const list_cache = @import("../list_cache.zig");
 
 const SubmissionIndexParams = struct {
     cid: []const u8,
     aid: []const u8,
 };
 
+/// drops backup copies from a page in place
+fn withoutBackups(items: [][]const u8) [][]const u8 {
+    var kept: usize = 0;
+    for (items) |item| {
+        if (std.mem.containsAtLeast(u8, item, 1, "BACKUP")) continue;
+        items[kept] = item;
+        kept += 1;
+    }
+    return items[0..kept];
+}
+
+/// bytes of a list response buffered before they go out as a chunk
+const stream_buffer_size = 16 * 1024;
+/// lists larger than this are streamed but not kept in list_cache
+const max_cached_list = 4 << 20;
+
+/// Streams the pages of a list query as one JSON array. The response starts
+/// with the first page, so a query that fails before any page arrives can
+/// still be answered normally.
+const ListStream = struct {
+    request: *std.http.Server.Request,
+    headers: []const std.http.Header,
+    buffer: []u8,
+    response: ?server.ChunkedResponse = null,
+    count: usize = 0,
+    skip_backups: bool = false,
+    /// items kept for list_cache, dropped once they pass max_cached_list
+    cache: ?std.ArrayList(list_cache.Entry) = null,
+    cache_bytes: usize = 0,
+    allocator: std.mem.Allocator,
+
+    fn page(self: *ListStream, items: []const [*c]const u8) !void {
+        if (self.response == null) {
+            self.response = try server.ChunkedResponse.start(self.request, self.buffer, .{ .extra_headers = self.headers });
+            try self.write("[");
+        }
+        for (items) |raw| {
+            const item = std.mem.span(raw);
+            if (self.skip_backups and std.mem.containsAtLeast(u8, item, 1, "BACKUP")) continue;
+            if (self.count > 0) try self.write(",");
+            try self.write(item);
+            self.count += 1;
+            try self.keep(item);
+        }
+        try self.response.?.flush();
+    }
+
+    fn write(self: *ListStream, bytes: []const u8) !void {
+        try self.response.?.writer().writeAll(bytes);
+    }
+
+    /// copies `item` for list_cache, the page it came from is freed after
+    /// the callback
+    fn keep(self: *ListStream, item: []const u8) !void {
+        if (self.cache) |*cache| {
+            self.cache_bytes += item.len;
+            if (self.cache_bytes > max_cached_list) {
+                self.cache = null;
+                return;
+            }
+            const copy = try self.allocator.dupe(u8, item);
+            const e = list_cache.entry(self.allocator, copy) orelse {
+                // an item without an sk cannot be patched later
+                self.cache = null;
+                return;
+            };
+            try cache.append(self.allocator, e);
+        }
+    }
+
+    /// closes the array, or answers `[]` when no page arrived
+    fn finish(self: *ListStream) !void {
+        if (self.response) |*response| {
+            try self.write("]");
+            try response.end();
+            return;
+        }
+        try self.request.respond("[]", .{ .extra_headers = self.headers });
+    }
+};
+
 pub fn index(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const headers = try server.makeHeaders(c.allocator, c.request);
@@ -43,85 +128,92 @@ pub fn getAssignmentSubmissions(c: *Context) !void {
         return;
     }
 
-    var list = try dynamo.getItemsDatatypePk(c.allocator, "SUBMISSION", params.aid);
-
-    defer list.deinit();
-
-    var total_len: usize = 2;
-    for (list.items) |item| total_len += item.len + 1;
-    const json_body = try c.allocator.alloc(u8, total_len);
-    var pos: usize = 0;
-    json_body[pos] = '[';
-    pos += 1;
-    var first = true;
-    for (list.items) |item| {
-        if (!first) {
-            json_body[pos] = ',';
-            pos += 1;
-        }
-        @memcpy(json_body[pos..][0..item.len], item);
-        pos += item.len;
-        first = false;
+    const scope = try std.fmt.allocPrint(c.allocator, "assignment-submissions:{s}:{s}", .{ params.aid, user.email });
+    const page_request = paging.parse(c.allocator, c.request, scope) catch {
+        try c.request.respond("", .{ .status = .bad_request, .extra_headers = headers });
+        return;
+    };
+    if (page_request) |p| {
+        const page = try dynamo.pageDatatypePk(c.allocator, "SUBMISSION", params.aid, p.limit, p.start_key);
+        try paging.respond(c.allocator, c.request, headers, scope, page.items, page.next_key);
+        return;
     }
-    json_body[pos] = ']';
 
-    try c.request.respond(json_body[0 .. pos + 1], .{ .extra_headers = headers });
+    var list: ListStream = .{ .request = c.request, .headers = headers, .buffer = try c.allocator.alloc(u8, stream_buffer_size), .allocator = c.allocator };
+    dynamo.eachPageDatatypePk(c.allocator, "SUBMISSION", params.aid, &list, ListStream.page) catch |err| {
+        if (list.response) |*response| return response.abort();
+        return err;
+    };
+    try list.finish();
 }
 
 pub fn getAllSubmissions(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const headers = try server.makeHeaders(c.allocator, c.request);
 
-    const cached = sql.getAll(c.allocator, "SELECT data FROM fetch_cache WHERE data_type = 'submissions' AND name = ? AND updated_at > datetime('now', '-3 minutes') LIMIT 1", .{user.email}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            try c.request.respond(data, .{ .extra_headers = headers });
-            return;
-        }
+    if (server.Parser.queryValue(c.request, "since")) |raw| {
+        const since_iso = try server.Parser.urlDecode(raw, c.allocator);
+        const delta = changes.since(c.allocator, user.email, since_iso) catch |err| switch (err) {
+            error.InvalidSince => {
+                try c.request.respond("", .{ .status = .bad_request, .extra_headers = headers });
+                return;
+            },
+            // too old or too much changed, the client refetches the whole list
+            error.SyncExpired => {
+                try c.request.respond("", .{ .status = .gone, .extra_headers = headers });
+                return;
+            },
+            else => return err,
+        };
+        try server.sendJson(c.allocator, c.request, delta, .{ .extra_headers = headers });
+        return;
     }
 
-    const all = try dynamo.getItemsOwnerDtProjRaw(c.allocator, user.email, "SUBMISSION", "pk, sk, severity, DATATYPE, #n, studentName, assignmentId, rubricId, simpleHash, classId, #owner, isStarred, #s, externalId", "\"#n\":\"name\",\"#s\":\"status\"");
-
-    var total_len: usize = 2; // [ and ]
-    for (all) |item| {
-        if (!std.mem.containsAtLeast(u8, item, 1, "BACKUP")) total_len += item.len + 1; // +1 for comma
+    // pages skip list_cache, which only holds the whole list
+    const scope = try std.fmt.allocPrint(c.allocator, "submissions:{s}", .{user.email});
+    const page_request = paging.parse(c.allocator, c.request, scope) catch {
+        try c.request.respond("", .{ .status = .bad_request, .extra_headers = headers });
+        return;
+    };
+    if (page_request) |p| {
+        const page = try dynamo.pageOwnerDtProj(c.allocator, user.email, "SUBMISSION", dynamo.SubmissionList.projection, dynamo.SubmissionList.names, p.limit, p.start_key);
+        try paging.respond(c.allocator, c.request, headers, scope, withoutBackups(page.items), page.next_key);
+        return;
     }
-    const json_body = try c.allocator.alloc(u8, total_len);
-    var pos: usize = 0;
-    json_body[pos] = '[';
-    pos += 1;
-    var first = true;
-    for (all) |item| {
-        if (std.mem.containsAtLeast(u8, item, 1, "BACKUP")) continue;
-        if (!first) {
-            json_body[pos] = ',';
-            pos += 1;
-        }
-        @memcpy(json_body[pos..][0..item.len], item);
-        pos += item.len;
-        first = false;
+
+    if (list_cache.get(c.allocator, user.email, .submissions) catch null) |body| {
+        try c.request.respond(body, .{ .extra_headers = headers });
+        return;
     }
-    json_body[pos] = ']';
 
-    sql.exec(c.allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data) VALUES ('submissions', ?, ?, ?)", .{ user.email, user.email, json_body }) catch |err| {
-        server.debugPrint("cache write failed: {}\n", .{err});
+    const seen = list_cache.version(c.allocator, user.email, .submissions) catch null;
+    var list: ListStream = .{
+        .request = c.request,
+        .headers = headers,
+        .buffer = try c.allocator.alloc(u8, stream_buffer_size),
+        .skip_backups = true,
+        .cache = if (seen != null) std.ArrayList(list_cache.Entry).empty else null,
+        .allocator = c.allocator,
+    };
+    dynamo.eachPageOwnerDtProj(c.allocator, user.email, "SUBMISSION", dynamo.SubmissionList.projection, dynamo.SubmissionList.names, &list, ListStream.page) catch |err| {
+        if (list.response) |*response| return response.abort();
+        return err;
     };
+    try list.finish();
 
-    try c.request.respond(json_body, .{ .extra_headers = headers });
+    if (list.cache) |cache| list_cache.fill(c.allocator, user.email, .submissions, seen.?, cache.items);
 }
 
 pub fn getUnapprovedSubmissions(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const headers = try server.makeHeaders(c.allocator, c.request);
 
-    const cached = sql.getAll(c.allocator, "SELECT data FROM fetch_cache WHERE data_type = 'submissions_unapproved' AND name = ? AND updated_at > datetime('now', '-3 minutes') LIMIT 1", .{user.email}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            try c.request.respond(data, .{ .extra_headers = headers });
-            return;
-        }
+    cached: {
+        var rows = sql.query(c.allocator, "SELECT data FROM fetch_cache WHERE data_type = 'submissions_unapproved' AND name = ? AND expires_at > unixepoch() LIMIT 1", .{user.email}) catch break :cached;
+        defer rows.deinit();
+        const row = (rows.next() catch null) orelse break :cached;
+        try c.request.respond(row.blob(0), .{ .extra_headers = headers });
+        return;
     }
 
     const all = try dynamo.getItemsOwnerDt(dynamo.Submission, c.allocator, user.email, "SUBMISSION");
@@ -139,7 +231,7 @@ pub fn getUnapprovedSubmissions(c: *Context) !void {
     }
     const json_body = try std.json.Stringify.valueAlloc(c.allocator, unapproved, .{});
 
-    sql.exec(c.allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data) VALUES ('submissions_unapproved', ?, ?, ?)", .{ user.email, user.email, json_body }) catch |err| {
+    sql.exec(c.allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data, expires_at) VALUES ('submissions_unapproved', ?, ?, ?, unixepoch() + 180)", .{ user.email, user.email, sql.Blob{ .bytes = json_body } }) catch |err| {
         server.debugPrint("cache write failed: {}\n", .{err});
     };
 
@@ -172,12 +264,6 @@ pub fn get_submission(c: *Context) !void {
     try server.sendJson(c.allocator, c.request, null, .{ .extra_headers = headers });
 }
 
-pub fn invalidateSubmissionCache(user_email: []const u8) void {
-    sql.exec(std.heap.c_allocator,"DELETE FROM fetch_cache WHERE data_type IN ('submissions', 'submissions_unapproved') AND user_email = ?", .{user_email}) catch |err| {
-        std.debug.print("cache invalidate failed: {}\n", .{err});
-    };
-}
-
 const AssignmentAccess = struct {
     OWNER: []const u8,
     sharedWith: [][]const u8 = &.{},
@@ -204,30 +290,16 @@ fn isSubmissionNew(allocator: std.mem.Allocator, user_email: []const u8, pk_str:
     const sk = sk_str orelse return true;
 
     // 1. Check submissions cache (ignore staleness)
-    const cached = sql.getAll(allocator, "SELECT data FROM fetch_cache WHERE data_type = 'submissions' AND name = ? LIMIT 1", .{user_email}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0 and rows[0].len > 11) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            if (std.mem.containsAtLeast(u8, data, 1, sk)) {
-                std.debug.print("submission {s} found in cache, is existing\n", .{sk});
-                return false;
-            }
-        }
+    if (list_cache.contains(allocator, user_email, .submissions, sk) catch false) {
+        std.debug.print("submission {s} found in cache, is existing\n", .{sk});
+        return false;
     }
 
     // 2. Not in cache — check DynamoDB
     const pk = pk_str orelse return true;
     const pk_stem = if (std.mem.indexOf(u8, pk, "#")) |idx| pk[idx + 1 ..] else pk;
     const sk_stem = if (std.mem.indexOf(u8, sk, "#")) |idx| sk[idx + 1 ..] else sk;
-    const cpx = try std.heap.c_allocator.dupeZ(u8, "SUBMISSION");
-    defer std.heap.c_allocator.free(cpx);
-    const cpk = try std.heap.c_allocator.dupeZ(u8, pk_stem);
-    defer std.heap.c_allocator.free(cpk);
-    const csk = try std.heap.c_allocator.dupeZ(u8, sk_stem);
-    defer std.heap.c_allocator.free(csk);
-    const result = dynamo.c.get_item_pk_sk(cpx, cpk, csk);
-    if (result != null) {
-        std.c.free(result);
+    if (try dynamo.itemExists(allocator, "SUBMISSION", pk_stem, sk_stem)) {
         std.debug.print("submission {s} found in dynamo, is existing\n", .{sk});
         return false;
     }
@@ -236,6 +308,21 @@ fn isSubmissionNew(allocator: std.mem.Allocator, user_email: []const u8, pk_str:
     return true;
 }
 
+/// the owner of a saved submission, who need not be the editor
+fn ownerOf(obj: *const std.json.ObjectMap, editor: []const u8) []const u8 {
+    return if (obj.get("OWNER")) |v| switch (v) {
+        .string => |o| o,
+        else => editor,
+    } else editor;
+}
+
+/// Logs a saved submission for delta syncs and patches it into its owner's
+/// cached lists.
+fn recordChange(allocator: std.mem.Allocator, item: std.json.Value, owner: []const u8, pk_str: ?[]const u8, sk_str: ?[]const u8) void {
+    if (pk_str) |pk| if (sk_str) |sk| changes.record(allocator, owner, pk, sk, false);
+    list_cache.putSubmission(allocator, item);
+}
+
 fn hasAvailableCredits(user: dynamo.User) bool {
     const sub = user.subscriptionInfo;
     const available = (sub.credits orelse 0) - sub.creditsUsed + (sub.bonus orelse 0);
@@ -299,8 +386,7 @@ pub fn approveSubmission(c: *Context) !void {
         }
     }
 
-    const modified_body = try std.json.Stringify.valueAlloc(c.allocator, parsed, .{});
-    dynamo.saveItem(c.allocator, modified_body, null) catch {
+    dynamo.saveObj(c.allocator, parsed, null) catch {
         try c.request.respond("", .{ .status = .internal_server_error });
         return;
     };
@@ -310,9 +396,10 @@ pub fn approveSubmission(c: *Context) !void {
         dynamo.updateCreditsUsed(c.allocator, user.email) catch |err| {
             std.debug.print("updateCreditsUsed failed: {}\n", .{err});
         };
+        session.invalidateUser(c.io, user.email) catch {};
     }
 
-    invalidateSubmissionCache(user.email);
+    recordChange(c.allocator, parsed, ownerOf(obj, user.email), pk_str, sk_str);
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
 
@@ -370,8 +457,7 @@ pub fn saveSubmission(c: *Context) !void {
         }
     }
 
-    const modified_body = try std.json.Stringify.valueAlloc(c.allocator, parsed, .{});
-    dynamo.saveItem(c.allocator, modified_body, null) catch {
+    dynamo.saveObj(c.allocator, parsed, null) catch {
         try c.request.respond("", .{ .status = .internal_server_error });
         return;
     };
@@ -381,8 +467,9 @@ pub fn saveSubmission(c: *Context) !void {
         dynamo.updateCreditsUsed(c.allocator, user.email) catch |err| {
             std.debug.print("updateCreditsUsed failed: {}\n", .{err});
         };
+        session.invalidateUser(c.io, user.email) catch {};
     }
 
-    invalidateSubmissionCache(user.email);
+    recordChange(c.allocator, parsed, ownerOf(obj, user.email), pk_str, sk_str);
     try server.sendJson(c.allocator, c.request, .{ .message = "success" }, .{ .extra_headers = headers });
 }
@@ -5,6 +5,7 @@ const Context = server.Context;
 const dynamo = @import("../dynamo.zig");
 const tasks = @import("../tasks.zig");
 const sql = @import("../sql.zig");
+const task_stream = @import("../task_stream.zig");
 
 const UpdateOptimizeBody = struct {
     taskToken: []const u8,
@@ -23,7 +24,6 @@ pub fn updateOptimizeTask(c: *Context) !void {
     }
     const h = &[_]std.http.Header{
         .{ .name = "Content-Type", .value = "application/json" },
-        .{ .name = "Connection", .value = "close" },
         .{ .name = "Access-Control-Allow-Origin", .value = origin },
         .{ .name = "Access-Control-Allow-Credentials", .value = "true" },
     };
@@ -42,9 +42,9 @@ pub fn updateOptimizeTask(c: *Context) !void {
     });
     const is_complete = std.mem.eql(u8, parsed.status, "complete");
     if (!std.mem.eql(u8, parsed.status, "error")) {
-        tasks.updateTask(c.allocator, parsed.taskToken, parsed.status, parsed.step, is_complete, parsed.metadata) catch {};
+        tasks.updateTask(c.io, c.allocator, parsed.taskToken, parsed.status, parsed.step, is_complete, parsed.metadata) catch {};
     } else {
-        tasks.markError(c.allocator, parsed.taskToken, null) catch {};
+        tasks.markError(c.io, c.allocator, parsed.taskToken, null) catch {};
     }
     try server.sendJson(c.allocator, c.request, .{ .message = "ok" }, .{ .extra_headers = h });
 }
@@ -65,7 +65,6 @@ pub fn updateTask(c: *Context) !void {
     }
     const h = &[_]std.http.Header{
         .{ .name = "Content-Type", .value = "application/json" },
-        .{ .name = "Connection", .value = "close" },
         .{ .name = "Access-Control-Allow-Origin", .value = origin },
         .{ .name = "Access-Control-Allow-Credentials", .value = "true" },
     };
@@ -85,20 +84,37 @@ pub fn updateTask(c: *Context) !void {
 
     const is_complete = std.mem.eql(u8, parsed.status, "complete");
     if (!std.mem.eql(u8, parsed.status, "error")) {
-        tasks.updateTask(c.allocator, parsed.taskToken, parsed.status, parsed.step, is_complete, null) catch {};
+        tasks.updateTask(c.io, c.allocator, parsed.taskToken, parsed.status, parsed.step, is_complete, null) catch {};
     } else {
-        tasks.markError(c.allocator, parsed.taskToken, null) catch {};
+        tasks.markError(c.io, c.allocator, parsed.taskToken, null) catch {};
     }
     try server.sendJson(c.allocator, c.request, .{ .message = "ok" }, .{ .extra_headers = h });
 }
 
+/// Server-sent events with the user's task progress. The stream opens with
+/// their active tasks, then carries every update as tasks are written.
+pub fn streamTasks(c: *Context) !void {
+    const user = try dynamo.getUser(c);
+    const headers = try server.makeHeaders(c.allocator, c.request);
+    const origin = headers[1].value;
+
+    var initial: std.Io.Writer.Allocating = .init(c.allocator);
+    tasks.writeActiveTasks(c.allocator, &initial.writer, user.email) catch |err| {
+        server.debugPrint("task stream snapshot failed: {}\n", .{err});
+    };
+    const stream = try c.detach();
+    task_stream.subscribe(c.io, stream, user.email, origin, initial.written()) catch |err| {
+        server.debugPrint("task stream closed: {}\n", .{err});
+    };
+}
+
 pub fn getGradingStatus(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const headers = try server.makeHeaders(c.allocator, c.request);
 
     const rows = sql.getAll(
         c.allocator,
-        "SELECT status, updated_at || 'Z', json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue WHERE user_email = ? AND task = 'grade_submission' AND is_complete = 0 AND updated_at >= datetime('now', '-2 minutes', 'utc') ",
+        "SELECT status, updated_at || 'Z', sk, pk, step, 5 steps FROM task_queue WHERE user_email = ? AND task = 'grade_submission' AND is_complete = 0 AND updated_at >= datetime('now', '-2 minutes', 'utc') ",
         .{user.email},
     ) catch null;
     if (rows != null) {
@@ -116,7 +132,7 @@ pub fn getOptimizeStatus(c: *Context) !void {
     };
     const rows = sql.getAll(
         c.allocator,
-        "SELECT status, updated_at || 'Z', json_extract(json_extract(meta_data, '$.body'), '$.sk') as sk, json_extract(json_extract(meta_data, '$.body'), '$.pk') as pk, step, 5 steps FROM task_queue WHERE task = 'optimize_criterion' AND is_complete = 0 AND updated_at >= datetime('now', '-5 minutes', 'utc') AND reference = ?",
+        "SELECT status, updated_at || 'Z', sk, pk, step, 5 steps FROM task_queue WHERE task = 'optimize_criterion' AND is_complete = 0 AND updated_at >= datetime('now', '-5 minutes', 'utc') AND reference = ?",
         .{ params.sk},
     ) catch null;
     if (rows != null) {
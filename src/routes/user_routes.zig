@@ -13,7 +13,7 @@ fn authMiddleware(c: *Context) !void {
     const cookies = try server.Parser.parseCookies(c.allocator, c.request);
     const token = cookies.get("userToken");
     if (token == null) {
-        try c.request.respond("", .{ .status = .forbidden, .keep_alive = false });
+        try c.request.respond("", .{ .status = .forbidden });
         return error.Client;
     }
     const decoded = try auth.decodeAuth(c.allocator, token.?);
@@ -21,7 +21,7 @@ fn authMiddleware(c: *Context) !void {
     defer std.heap.c_allocator.free(c_str);
     const result = dynamo.c.get_item_pk_sk("USER", c_str, c_str);
     if (result == null) {
-        try c.request.respond("", .{ .status = .forbidden, .keep_alive = false });
+        try c.request.respond("", .{ .status = .forbidden });
         return;
     }
     defer std.c.free(result);
@@ -36,7 +36,7 @@ pub fn index(c: *Context) !void {
     const user = try dynamo.getUser(c);
     const body = try fmt.renderTemplate(c.io, "./static/index.html", .{ .value = user.pk }, c.allocator);
     defer c.allocator.free(body);
-    try c.request.respond(body, .{ .status = .ok, .keep_alive = false });
+    try c.request.respond(body, .{ .status = .ok });
 }
 
 const TestParams = struct {
@@ -45,7 +45,7 @@ const TestParams = struct {
 
 fn param_test(c: *Context) !void {
     const params = server.Parser.params(TestParams, c) catch TestParams{ .param = "Could not parse" };
-    try c.request.respond(params.param, .{ .status = .ok, .keep_alive = false });
+    try c.request.respond(params.param, .{ .status = .ok });
 }
 
 const PubCounter = struct {
@@ -80,5 +80,5 @@ fn postEndpoint(c: *Context) !void {
     const headers = &[_]std.http.Header{
         .{ .name = "Content-Type", .value = "application/json" },
     };
-    try server.sendJson(c.allocator, c.request, out, .{ .status = .ok, .keep_alive = false, .extra_headers = headers });
+    try server.sendJson(c.allocator, c.request, out, .{ .status = .ok, .extra_headers = headers });
 }
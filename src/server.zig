@@ -1,6 +1,7 @@
 const std = @import("std");
 const Config = @import("config.zig");
 const builtin = @import("builtin");
+const Session = @import("session.zig").Entry;
 const clib = @cImport({
     @cInclude("dynamo.h");
 });
@@ -20,6 +21,14 @@ pub fn debugPrint(comptime fstring: []const u8, values: anytype) void {
 
 pub const Callback: type = *const fn (*Context) anyerror!void;
 
+/// most ':param' segments a single route may declare
+pub const max_params = 8;
+
+pub const Param = struct {
+    name: []const u8,
+    value: []const u8,
+};
+
 pub const Context = struct {
     request: *std.http.Server.Request,
     next: bool = true,
@@ -27,15 +36,37 @@ pub const Context = struct {
     io: std.Io,
     route: *const Route,
     values: std.StringHashMap([]const u8),
+    /// url parameters captured by the router while matching, still url encoded
+    params: [max_params]Param = undefined,
+    param_count: usize = 0,
+    /// verified claims and typed user, set by the auth middleware; the
+    /// router releases it once the request is done
+    session: ?*Session = null,
+    /// connection the request arrived on, for handlers that take it over
+    conn: ?*Connection = null,
     pub fn get(self: *Context, key: []const u8) ?[]const u8 {
         return self.values.get(key);
     }
+    pub fn param(self: *const Context, key: []const u8) ?[]const u8 {
+        for (self.params[0..self.param_count]) |p| {
+            if (std.mem.eql(u8, p.name, key)) return p.value;
+        }
+        return null;
+    }
     pub fn put(self: *Context, key: []const u8, value: []const u8) !void {
         try self.values.put(key, value);
     }
     pub fn init(request: *std.http.Server.Request, route: *const Route, allocator: std.mem.Allocator, io: std.Io) !Context {
         return .{ .allocator = allocator, .request = request, .route = route, .io = io, .values = .init(allocator) };
     }
+    /// Hands the socket to the caller for a long-lived response such as an
+    /// event stream. The worker moves on without answering or closing it;
+    /// the caller writes the response itself and closes the stream.
+    pub fn detach(self: *Context) !std.Io.net.Stream {
+        const conn = self.conn orelse return error.NotDetachable;
+        conn.detached = true;
+        return conn.stream;
+    }
 };
 
 pub const State = enum {
@@ -54,32 +85,15 @@ pub const Route = struct {
     method: std.http.Method = .GET,
     callback: Callback = default,
     middleware: ?[]const Callback = null,
+    /// worker pool the route is served on
+    class: Class = .fast,
 
-    pub fn match(self: *Route, path: []const u8, m: std.http.Method) bool {
-        if (m != self.method) {
-            return false;
-        }
-        var a = std.mem.tokenizeSequence(u8, self.path, "/");
-        var b = std.mem.tokenizeSequence(u8, path, "/");
-        while (a.peek() != null and b.peek() != null) {
-            if (std.mem.eql(u8, a.peek().?, "*")) {
-                return true;
-            }
-            if (std.mem.startsWith(u8, a.peek().?, ":")) {
-                // do nothing
-            } else if (!std.mem.eql(u8, a.peek().?, b.peek().?)) {
-                return false;
-            }
-            _ = a.next();
-            _ = b.next();
-        }
-        if ((a.peek() == null and b.peek() != null) or (a.peek() != null and b.next() == null)) {
-            return false;
-        }
-        return true;
-    }
+    /// `.fast` routes share the main worker pool. `.slow` routes hold their
+    /// worker for a long upstream call, so they run on a separate bounded pool
+    /// and are answered with a 503 when its queue is full.
+    pub const Class = enum { fast, slow };
 
-    pub fn run(self: *Route, c: *Context) !void {
+    pub fn run(self: *const Route, c: *Context) !void {
         if (self.middleware != null) {
             for (self.middleware.?) |middleware| {
                 middleware(c) catch |err| {
@@ -92,7 +106,7 @@ pub const Route = struct {
 
     pub fn default(c: *Context) !void {
         const body = std.fmt.allocPrint(c.allocator, "hello world from {s}", .{c.request.head.target}) catch return ServerError.Server;
-        c.request.respond(body, .{ .status = .ok, .keep_alive = false }) catch return ServerError.Server;
+        c.request.respond(body, .{ .status = .ok }) catch return ServerError.Server;
     }
 };
 
@@ -105,14 +119,21 @@ pub fn sendJson(allocator: std.mem.Allocator, request: *std.http.Server.Request,
 ///this function returns a 404 error
 pub fn four0four(c: *Context) !void {
     const body = "<h1>NOT FOUND</h1>";
-    c.request.respond(body, .{ .status = .not_found, .keep_alive = false }) catch return ServerError.Server;
+    c.request.respond(body, .{ .status = .not_found }) catch return ServerError.Server;
 }
 
 ///this function returns a 500 error
 pub fn five00(request: *std.http.Server.Request, allocator: std.mem.Allocator) !void {
     _ = allocator;
     const body = "<h1>ERROR</h1>";
-    request.respond(body, .{ .status = .internal_server_error, .keep_alive = false }) catch return ServerError.Server;
+    request.respond(body, .{ .status = .internal_server_error }) catch return ServerError.Server;
+}
+
+///this function returns a 503 error, sent when the slow pool has no room for a request
+pub fn five03(request: *std.http.Server.Request, allocator: std.mem.Allocator) !void {
+    const cors = try makeHeaders(allocator, request);
+    const headers = try std.mem.concat(allocator, std.http.Header, &.{ cors, &.{.{ .name = "Retry-After", .value = "5" }} });
+    request.respond("", .{ .status = .service_unavailable, .extra_headers = headers }) catch return ServerError.Server;
 }
 
 ///function for serving static files, the path on a route with this method should end with '\*' or ':<parameter>' unless only one file is meant to be served on the route
@@ -120,7 +141,7 @@ pub fn static(c: *Context) !void {
     const request = c.request;
     const allocator = c.allocator;
     if (conf.hideDotFiles and std.mem.containsAtLeast(u8, request.head.target, 1, "/.")) {
-        request.respond("<h1>403</h1>", .{ .status = .forbidden, .keep_alive = false }) catch return ServerError.Server;
+        request.respond("<h1>403</h1>", .{ .status = .forbidden }) catch return ServerError.Server;
         return;
     }
     debugPrint("static {s}\n", .{request.head.target[1..]});
@@ -147,7 +168,7 @@ pub fn static(c: *Context) !void {
     const body: []u8 = try allocator.alloc(u8, file_size);
     var reader = file.reader(c.io, body);
     _ = try reader.interface.readSliceAll(body);
-    request.respond(body, .{ .status = .ok, .keep_alive = false }) catch return ServerError.Server;
+    request.respond(body, .{ .status = .ok }) catch return ServerError.Server;
 }
 
 pub fn isAllowedOrigin(origin: []const u8) bool {
@@ -167,86 +188,432 @@ pub fn makeHeaders(allocator: std.mem.Allocator, request: *std.http.Server.Reque
             break;
         }
     }
-    const h = try allocator.alloc(std.http.Header, 4);
+    const h = try allocator.alloc(std.http.Header, 3);
     h[0] = .{ .name = "Content-Type", .value = "application/json" };
-    h[1] = .{ .name = "Connection", .value = "close" };
-    h[2] = .{ .name = "Access-Control-Allow-Origin", .value = origin };
-    h[3] = .{ .name = "Access-Control-Allow-Credentials", .value = "true" };
+    h[1] = .{ .name = "Access-Control-Allow-Origin", .value = origin };
+    h[2] = .{ .name = "Access-Control-Allow-Credentials", .value = "true" };
     return h;
 }
 
+/// A response body sent with Transfer-Encoding: chunked while it is still
+/// being produced, for lists too large to build in memory first. Every
+/// flush sends what was written since the last one as a chunk.
+pub const ChunkedResponse = struct {
+    request: *std.http.Server.Request,
+    body: std.http.BodyWriter,
+
+    /// writes the response head; the value must not move once writer() is used
+    pub fn start(request: *std.http.Server.Request, buffer: []u8, options: std.http.Server.Request.RespondOptions) !ChunkedResponse {
+        return .{ .request = request, .body = try request.respondStreaming(buffer, .{ .respond_options = options }) };
+    }
+
+    pub fn writer(self: *ChunkedResponse) *std.Io.Writer {
+        return &self.body.writer;
+    }
+
+    pub fn flush(self: *ChunkedResponse) !void {
+        try self.body.flush();
+    }
+
+    /// sends the terminating chunk, the connection stays usable
+    pub fn end(self: *ChunkedResponse) !void {
+        try self.body.end();
+    }
+
+    /// gives up on a body that can't be completed: the connection is closed
+    /// without the terminating chunk, so the client sees a failed transfer
+    /// rather than a short but well-formed response
+    pub fn abort(self: *ChunkedResponse) void {
+        self.request.server.reader.state = .closing;
+    }
+};
+
 ///this route returns a 404 error and is called when no other route matched
 const notFound = Route{ .callback = four0four };
 
-///this struct is a wrapper around a std.ArrayList(Route) call Router.route to find the correct route for a request
+const RouteLeaf = struct {
+    route: *const Route,
+    /// names of the route's ':param' segments in path order
+    names: []const []const u8,
+};
+
+const Handlers = std.EnumArray(std.http.Method, ?RouteLeaf);
+
+/// one path segment of the route trie
+const RouteNode = struct {
+    segment: []const u8 = "",
+    children: std.ArrayList(*RouteNode) = .{},
+    param: ?*RouteNode = null,
+    handlers: Handlers = .initFill(null),
+    wildcard: Handlers = .initFill(null),
+};
+
+///this struct compiles the route table into a trie keyed by path segment, call Router.route to find the correct route for a request
+///static segments are tried before ':param' segments, which are tried before '\*'
 pub const Router = struct {
-    routes: std.ArrayList(Route),
+    root: *RouteNode,
+    arena: std.heap.ArenaAllocator,
 
-    pub fn init(allocator: std.mem.Allocator) !Router {
-        const router = Router{
-            .routes = std.ArrayList(Route).init(allocator),
-        };
+    pub fn init(allocator: std.mem.Allocator, routes: []const Route) !Router {
+        var arena = std.heap.ArenaAllocator.init(allocator);
+        errdefer arena.deinit();
+        const root = try arena.allocator().create(RouteNode);
+        root.* = .{};
+        var router = Router{ .root = root, .arena = arena };
+        for (routes) |*r| try router.insert(r);
         return router;
     }
 
     pub fn deinit(self: *Router) void {
-        self.routes.deinit();
-    }
-
-    /// dispatch a request to the first route with a matching path and method
-    pub fn route(self: Router, io: std.Io, request: *std.http.Server.Request, allocator: std.mem.Allocator) anyerror!void {
-        for (self.routes.items) |*r| {
-            const query = std.mem.indexOf(u8, request.head.target, "?") orelse request.head.target.len;
-            if (request.head.method == .OPTIONS) {
-                var origin: []const u8 = "";
-                var hit = request.iterateHeaders();
-                while (hit.next()) |h| {
-                    if (std.ascii.eqlIgnoreCase(h.name, "origin")) {
-                        if (isAllowedOrigin(h.value)) origin = h.value;
-                        break;
-                    }
+        self.arena.deinit();
+    }
+
+    fn insert(self: *Router, r: *const Route) !void {
+        const allocator = self.arena.allocator();
+        var names: std.ArrayList([]const u8) = .{};
+        var node = self.root;
+        var it = std.mem.tokenizeScalar(u8, r.path, '/');
+        while (it.next()) |seg| {
+            if (std.mem.eql(u8, seg, "*")) {
+                // first registration wins, same as the old in-order scan
+                if (node.wildcard.get(r.method) == null) {
+                    node.wildcard.set(r.method, .{ .route = r, .names = try names.toOwnedSlice(allocator) });
                 }
-                const opt_headers = [_]std.http.Header{
-                    .{ .name = "Content-Type", .value = "application/json" },
-                    .{ .name = "Connection", .value = "close" },
-                    .{ .name = "Access-Control-Allow-Origin", .value = origin },
-                    .{ .name = "Access-Control-Allow-Methods", .value = "GET, POST, PUT, DELETE, OPTIONS" },
-                    .{ .name = "Access-Control-Allow-Headers", .value = "Content-Type" },
-                    .{ .name = "Access-Control-Allow-Credentials", .value = "true" },
-                    .{ .name = "Access-Control-Max-Age", .value = "86400" },
-                };
-                try request.respond("", .{ .status = .ok, .keep_alive = false, .extra_headers = &opt_headers });
                 return;
             }
-            if (r.match(request.head.target[0..query], request.head.method)) {
-                var c: Context = try .init(request, r, allocator, io);
-
-                debugPrint("match: {s}\n", .{r.path});
-                r.run(&c) catch |err| {
-                    debugPrint("error: {}\n", .{err});
-                    return;
+            if (seg[0] == ':') {
+                if (names.items.len == max_params) return error.TooManyParams;
+                try names.append(allocator, seg[1..]);
+                node = node.param orelse blk: {
+                    const child = try allocator.create(RouteNode);
+                    child.* = .{};
+                    node.param = child;
+                    break :blk child;
                 };
-                return;
+                continue;
             }
+            node = for (node.children.items) |child| {
+                if (std.mem.eql(u8, child.segment, seg)) break child;
+            } else blk: {
+                const child = try allocator.create(RouteNode);
+                child.* = .{ .segment = seg };
+                try node.children.append(allocator, child);
+                break :blk child;
+            };
         }
-        var c: Context = try .init(request, &notFound, allocator, io);
-        notFound.callback(&c) catch return ServerError.Server;
-        return;
+        if (node.handlers.get(r.method) == null) {
+            node.handlers.set(r.method, .{ .route = r, .names = try names.toOwnedSlice(allocator) });
+        }
+    }
+
+    /// walk the trie one request segment at a time, backtracking from static to param to wildcard children
+    fn lookup(node: *const RouteNode, segments: std.mem.TokenIterator(u8, .scalar), method: std.http.Method, captures: *[max_params][]const u8, depth: usize) ?RouteLeaf {
+        var rest = segments;
+        const seg = rest.next() orelse return node.handlers.get(method);
+        for (node.children.items) |child| {
+            if (std.mem.eql(u8, child.segment, seg)) {
+                if (lookup(child, rest, method, captures, depth)) |leaf| return leaf;
+                break;
+            }
+        }
+        if (node.param) |child| {
+            if (depth < max_params) {
+                captures[depth] = seg;
+                if (lookup(child, rest, method, captures, depth + 1)) |leaf| return leaf;
+            }
+        }
+        return node.wildcard.get(method);
+    }
+
+    /// the route a request resolved to, with its ':param' values; captures
+    /// point into the request target
+    pub const Match = struct {
+        /// null for OPTIONS and for paths no route matches
+        leaf: ?RouteLeaf = null,
+        captures: [max_params][]const u8 = undefined,
+
+        /// scheduling class of the matched route
+        pub fn class(self: *const Match) Route.Class {
+            const leaf = self.leaf orelse return .fast;
+            return leaf.route.class;
+        }
+    };
+
+    /// walk the trie once for a request, the result picks the pool and is then dispatched
+    pub fn match(self: Router, request: *std.http.Server.Request) Match {
+        var m: Match = .{};
+        if (request.head.method == .OPTIONS) return m;
+        const query = std.mem.indexOfScalar(u8, request.head.target, '?') orelse request.head.target.len;
+        const segments = std.mem.tokenizeScalar(u8, request.head.target[0..query], '/');
+        m.leaf = lookup(self.root, segments, request.head.method, &m.captures, 0);
+        return m;
+    }
+
+    /// dispatch a request to the route matching its path and method
+    pub fn route(self: Router, io: std.Io, request: *std.http.Server.Request, allocator: std.mem.Allocator, conn: ?*Connection) anyerror!void {
+        const m = self.match(request);
+        return dispatch(io, request, &m, allocator, conn);
+    }
+
+    /// run the route `m` found for `request`
+    pub fn dispatch(io: std.Io, request: *std.http.Server.Request, m: *const Match, allocator: std.mem.Allocator, conn: ?*Connection) anyerror!void {
+        if (request.head.method == .OPTIONS) {
+            var origin: []const u8 = "";
+            var hit = request.iterateHeaders();
+            while (hit.next()) |h| {
+                if (std.ascii.eqlIgnoreCase(h.name, "origin")) {
+                    if (isAllowedOrigin(h.value)) origin = h.value;
+                    break;
+                }
+            }
+            const opt_headers = [_]std.http.Header{
+                .{ .name = "Content-Type", .value = "application/json" },
+                .{ .name = "Access-Control-Allow-Origin", .value = origin },
+                .{ .name = "Access-Control-Allow-Methods", .value = "GET, POST, PUT, DELETE, OPTIONS" },
+                .{ .name = "Access-Control-Allow-Headers", .value = "Content-Type" },
+                .{ .name = "Access-Control-Allow-Credentials", .value = "true" },
+                .{ .name = "Access-Control-Max-Age", .value = "86400" },
+            };
+            try request.respond("", .{ .status = .ok, .extra_headers = &opt_headers });
+            return;
+        }
+
+        const leaf = m.leaf orelse {
+            var c: Context = try .init(request, &notFound, allocator, io);
+            notFound.callback(&c) catch return ServerError.Server;
+            return;
+        };
+
+        var c: Context = try .init(request, leaf.route, allocator, io);
+        c.conn = conn;
+        for (leaf.names, 0..) |name, i| {
+            c.params[i] = .{ .name = name, .value = m.captures[i] };
+        }
+        c.param_count = leaf.names.len;
+
+        debugPrint("match: {s}\n", .{leaf.route.path});
+        defer if (c.session) |session| session.release();
+        leaf.route.run(&c) catch |err| {
+            debugPrint("error: {}\n", .{err});
+            return;
+        };
     }
 };
 
 /// this is here to allow or disalow the static function from serving dotfiles
 var conf: *Config = undefined;
 
-/// A wrapper around std.Io.net.Server with builtin multithreading, arena based memory management and routing
+/// readiness notifications for sockets: epoll on linux, kqueue on FreeBSD and macOS.
+/// every registration is one-shot, a fired socket stays silent until it is armed again
+pub const Poller = struct {
+    fd: i32,
+
+    pub const Event = struct { data: usize };
+    const use_epoll = builtin.os.tag == .linux;
+    const linux = std.os.linux;
+
+    pub fn init() !Poller {
+        const fd = if (use_epoll) std.c.epoll_create1(linux.EPOLL.CLOEXEC) else std.c.kqueue();
+        if (fd < 0) return error.PollerInit;
+        return .{ .fd = fd };
+    }
+
+    pub fn deinit(self: *Poller) void {
+        _ = std.c.close(self.fd);
+    }
+
+    /// ask for a single readable notification on `fd` carrying `data`
+    pub fn arm(self: *Poller, fd: std.Io.net.Socket.Handle, data: usize, first: bool) !void {
+        if (use_epoll) {
+            var ev: linux.epoll_event = .{
+                .events = linux.EPOLL.IN | linux.EPOLL.RDHUP | linux.EPOLL.ONESHOT,
+                .data = .{ .ptr = data },
+            };
+            const op: u32 = if (first) linux.EPOLL.CTL_ADD else linux.EPOLL.CTL_MOD;
+            if (std.c.epoll_ctl(self.fd, op, fd, &ev) != 0) return error.PollerArm;
+        } else {
+            var ev = std.mem.zeroes(std.c.Kevent);
+            ev.ident = @intCast(fd);
+            ev.filter = std.c.EVFILT.READ;
+            ev.flags = std.c.EV.ADD | std.c.EV.ONESHOT;
+            ev.udata = data;
+            if (std.c.kevent(self.fd, @ptrCast(&ev), 1, @ptrCast(&ev), 0, null) != 0) return error.PollerArm;
+        }
+    }
+
+    /// drop an armed socket before closing it
+    pub fn remove(self: *Poller, fd: std.Io.net.Socket.Handle) void {
+        if (use_epoll) {
+            _ = std.c.epoll_ctl(self.fd, linux.EPOLL.CTL_DEL, fd, null);
+        } else {
+            var ev = std.mem.zeroes(std.c.Kevent);
+            ev.ident = @intCast(fd);
+            ev.filter = std.c.EVFILT.READ;
+            ev.flags = std.c.EV.DELETE;
+            _ = std.c.kevent(self.fd, @ptrCast(&ev), 1, @ptrCast(&ev), 0, null);
+        }
+    }
+
+    /// block up to `timeout_ms` and fill `out` with the sockets that became readable
+    pub fn wait(self: *Poller, out: []Event, timeout_ms: i32) usize {
+        if (use_epoll) {
+            var evs: [64]linux.epoll_event = undefined;
+            const max: usize = @min(out.len, evs.len);
+            const n = std.c.epoll_wait(self.fd, &evs, @intCast(max), timeout_ms);
+            if (n <= 0) return 0;
+            for (evs[0..@intCast(n)], 0..) |ev, i| out[i] = .{ .data = ev.data.ptr };
+            return @intCast(n);
+        } else {
+            var evs: [64]std.c.Kevent = undefined;
+            const max: usize = @min(out.len, evs.len);
+            const ts: std.c.timespec = .{
+                .sec = @divTrunc(timeout_ms, 1000),
+                .nsec = @rem(timeout_ms, 1000) * std.time.ns_per_ms,
+            };
+            const n = std.c.kevent(self.fd, @ptrCast(&evs), 0, &evs, @intCast(max), &ts);
+            if (n <= 0) return 0;
+            for (evs[0..@intCast(n)], 0..) |ev, i| out[i] = .{ .data = ev.udata };
+            return @intCast(n);
+        }
+    }
+};
+
+/// bounded FIFO shared between the event loop and the worker pool
+pub fn WorkQueue(comptime T: type) type {
+    return struct {
+        const Self = @This();
+        items: []T,
+        head: usize = 0,
+        len: usize = 0,
+        lock: std.Io.Mutex = .init,
+        ready: std.Io.Condition = .init,
+
+        pub fn init(allocator: std.mem.Allocator, capacity: usize) !Self {
+            return .{ .items = try allocator.alloc(T, capacity) };
+        }
+
+        pub fn deinit(self: *Self, allocator: std.mem.Allocator) void {
+            allocator.free(self.items);
+        }
+
+        /// returns false instead of blocking when the queue is full
+        pub fn push(self: *Self, io: std.Io, item: T) !bool {
+            try self.lock.lock(io);
+            defer self.lock.unlock(io);
+            if (self.len == self.items.len) return false;
+            self.items[(self.head + self.len) % self.items.len] = item;
+            self.len += 1;
+            self.ready.signal(io);
+            return true;
+        }
+
+        /// blocks until an item is available
+        pub fn pop(self: *Self, io: std.Io) !T {
+            try self.lock.lock(io);
+            defer self.lock.unlock(io);
+            while (self.len == 0) try self.ready.wait(io, &self.lock);
+            const item = self.items[self.head];
+            self.head = (self.head + 1) % self.items.len;
+            self.len -= 1;
+            return item;
+        }
+    };
+}
+
+/// bytes read per connection before a larger request moves to a heap buffer
+const recv_buffer_size = 4096;
+
+/// per-connection state, kept alive across requests while the socket waits in the poller
+const Connection = struct {
+    stream: std.Io.net.Stream,
+    reader: std.Io.net.Stream.Reader = undefined,
+    writer: std.Io.net.Stream.Writer = undefined,
+    http: std.http.Server = undefined,
+    served: usize = 0,
+    registered: bool = false,
+    /// a handler took over the socket, see Context.detach
+    detached: bool = false,
+    /// head of a slow route's request, read by a fast worker and left for the slow pool
+    pending: std.http.Server.Request = undefined,
+    /// the route `pending` resolved to, so the slow worker does not look it up again
+    pending_match: Router.Match = .{},
+    idle_since: i64 = 0,
+    /// when the first byte of the request being buffered arrived, 0 while none is
+    request_started: i64 = 0,
+    /// "100 Continue" was already sent for the request being buffered
+    continued: bool = false,
+    /// replaces recv_buffer while a request does not fit in it
+    large_buffer: ?[]u8 = null,
+    prev: ?*Connection = null,
+    next: ?*Connection = null,
+    recv_buffer: [recv_buffer_size]u8 = undefined,
+    send_buffer: [4096]u8 = undefined,
+
+    fn create(allocator: std.mem.Allocator, io: std.Io, stream: std.Io.net.Stream) !*Connection {
+        const conn = try allocator.create(Connection);
+        conn.* = .{ .stream = stream };
+        conn.reader = stream.reader(io, &conn.recv_buffer);
+        conn.writer = stream.writer(io, &conn.send_buffer);
+        conn.http = .init(&conn.reader.interface, &conn.writer.interface);
+        return conn;
+    }
+};
+
+/// how far `Server.fillRequest` got with the next request on a connection
+const Fill = enum {
+    /// head and body are buffered, reading them will not block
+    complete,
+    /// nothing buffered, the connection is between requests
+    idle,
+    /// part of a request is buffered, the rest has not arrived yet
+    partial,
+    closed,
+    /// a chunked body, whose end is not known up front
+    length_required,
+    too_large,
+};
+
+/// connections parked in the poller, oldest first so idle sweeps stop at the first live one
+const ParkedList = struct {
+    head: ?*Connection = null,
+    tail: ?*Connection = null,
+
+    fn append(self: *ParkedList, conn: *Connection) void {
+        conn.prev = self.tail;
+        conn.next = null;
+        if (self.tail) |t| t.next = conn else self.head = conn;
+        self.tail = conn;
+    }
+
+    fn remove(self: *ParkedList, conn: *Connection) void {
+        if (conn.prev) |p| p.next = conn.next else self.head = conn.next;
+        if (conn.next) |n| n.prev = conn.prev else self.tail = conn.prev;
+        conn.prev = null;
+        conn.next = null;
+    }
+};
+
+/// A wrapper around std.Io.net.Server with an epoll/kqueue event loop, a worker pool, arena based memory management and routing.
+/// Idle connections wait in the poller, a worker is only occupied while a request is being served.
 pub const Server = struct {
     settings: *Config,
     io: std.Io,
     allocator: std.mem.Allocator,
-    server: std.Io.net.Server,
+    /// one shared socket, or one per worker when reusePort is set
+    listeners: []std.Io.net.Server,
     address: std.Io.net.IpAddress,
     should_close: bool = false,
     lock: std.Io.Mutex,
+    poller: Poller = undefined,
+    queue: WorkQueue(*Connection) = undefined,
+    /// connections whose pending request is a slow route, bounded by slowQueueDepth
+    slow_queue: WorkQueue(*Connection) = undefined,
+    parked: ParkedList = .{},
+    /// connections parked with part of a request buffered, held to requestTimeout
+    partial: ParkedList = .{},
+    parked_lock: std.Io.Mutex = .init,
+    live_connections: std.atomic.Value(usize) = .init(0),
+
     pub fn triggerClose(self: *Server) !void {
         try self.lock.lock(self.io);
         self.should_close = true;
@@ -259,16 +626,23 @@ pub const Server = struct {
         settings: *Config,
     ) !Server {
         const addr: std.Io.net.IpAddress = try .resolve(io, settings.address, settings.port);
-        const tcp_server = try addr.listen(io, .{ .reuse_address = true });
+        const count: usize = if (settings.reusePort) @max(settings.workers, 1) else 1;
+        const listeners = try allocator.alloc(std.Io.net.Server, count);
+        errdefer allocator.free(listeners);
+        for (listeners, 0..) |*l, i| {
+            errdefer for (listeners[0..i]) |*prev| prev.deinit(io);
+            l.* = if (settings.reusePort) try listenReusePort(addr) else try addr.listen(io, .{ .reuse_address = true });
+        }
         conf = settings;
-        return .{ .settings = settings, .allocator = allocator, .io = io, .address = addr, .server = tcp_server, .lock = std.Io.Mutex.init };
+        return .{ .settings = settings, .allocator = allocator, .io = io, .address = addr, .listeners = listeners, .lock = std.Io.Mutex.init };
     }
 
     /// listen on the address and port indicated from the provided config, dispatch requests via the router to the provided routes
     pub fn runServer(self: *Server, router: Router) !void {
-        //const allocator = self.allocator;
-        var server = self.server;
-        defer server.deinit(self.io);
+        defer {
+            for (self.listeners) |*l| l.deinit(self.io);
+            self.allocator.free(self.listeners);
+        }
         var buf: [1024]u8 = undefined;
 
         var stdout_file_writer: std.Io.File.Writer = .init(.stdout(), self.io, &buf);
@@ -276,18 +650,38 @@ pub const Server = struct {
 
         try stdout.print("Listening on http://{s}\n", .{self.settings.address});
 
-        var state: State = .waiting;
-        const worker_count: usize = self.settings.workers;
+        self.poller = try Poller.init();
+        defer self.poller.deinit();
+        self.queue = try .init(self.allocator, self.settings.maxConnections);
+        defer self.queue.deinit(self.allocator);
+        self.slow_queue = try .init(self.allocator, @max(self.settings.slowQueueDepth, 1));
+        defer self.slow_queue.deinit(self.allocator);
+
+        var loop_state: State = .waiting;
+        var loop_thread = try std.Thread.spawn(.{}, eventLoop, .{ self, &loop_state });
+
+        // the supervisor owns the listening sockets, a restarted acceptor picks up the same backlog
+        const acceptors: []std.Thread = try self.allocator.alloc(std.Thread, self.listeners.len);
+        const acceptor_states = try self.allocator.alloc(State, self.listeners.len);
+        defer self.allocator.free(acceptors);
+        defer self.allocator.free(acceptor_states);
+        for (self.listeners, 0..) |*l, i| {
+            acceptors[i] = try std.Thread.spawn(.{}, acceptLoop, .{ self, l, &acceptor_states[i] });
+        }
+
+        // the first `workers` threads serve the main queue, the rest the slow one
+        const fast_count: usize = self.settings.workers;
+        const worker_count: usize = fast_count + @max(self.settings.slowWorkers, 1);
         const workers: []std.Thread = try self.allocator.alloc(std.Thread, worker_count);
         const worker_states = try self.allocator.alloc(State, worker_count);
         defer self.allocator.free(workers);
         defer self.allocator.free(worker_states);
 
-        // Initialize worker states
         // Spawn workers
         for (0..worker_count) |i| {
             debugPrint("Spawning worker: {}\n", .{i + 1});
-            workers[i] = try std.Thread.spawn(.{ .stack_size = 1024 * 512 }, listen, .{ self, i, &worker_states[i], router });
+            const class: Route.Class = if (i < fast_count) .fast else .slow;
+            workers[i] = try std.Thread.spawn(.{ .stack_size = 1024 * 512 }, work, .{ self, i, &worker_states[i], router, class });
         }
 
         // Monitor and respawn threads if they finish
@@ -295,13 +689,24 @@ pub const Server = struct {
             var idle_count: usize = 0;
 
             for (0..worker_count) |i| {
-                // error state
                 if (worker_states[i] == .waiting) {
                     idle_count += 1;
                 }
+                // error state
                 if (worker_states[i] == .err) {
                     debugPrint("Worker {d} stopped. Restarting...\n", .{i + 1});
-                    workers[i] = try std.Thread.spawn(.{}, listen, .{ self, i, &worker_states[i], router });
+                    const class: Route.Class = if (i < fast_count) .fast else .slow;
+                    workers[i] = try std.Thread.spawn(.{ .stack_size = 1024 * 512 }, work, .{ self, i, &worker_states[i], router, class });
+                }
+            }
+            if (loop_state == .err) {
+                debugPrint("Event loop stopped. Restarting...\n", .{});
+                loop_thread = try std.Thread.spawn(.{}, eventLoop, .{ self, &loop_state });
+            }
+            for (self.listeners, 0..) |*l, i| {
+                if (acceptor_states[i] == .err) {
+                    debugPrint("Acceptor {d} stopped. Restarting...\n", .{i + 1});
+                    acceptors[i] = try std.Thread.spawn(.{}, acceptLoop, .{ self, l, &acceptor_states[i] });
                 }
             }
             if (self.should_close == true and idle_count >= worker_count) {
@@ -313,46 +718,343 @@ pub const Server = struct {
 
             _ = try std.Io.sleep(self.io, std.Io.Duration.fromMilliseconds(1000), std.Io.Clock.real);
         }
-        try self.listen(0, &state, router);
     }
 
-    /// should normally not be called directly, intead call runServer
-    pub fn listen(self: *Server, id: usize, state: *State, router: Router) !void {
-        const io = self.io;
+    /// accepts sockets and parks them in the poller until the client sends a request
+    fn acceptLoop(self: *Server, listener: *std.Io.net.Server, state: *State) !void {
+        state.* = .waiting;
+        errdefer state.* = .err; // on error this thread will be killed and replaced
+        while (!self.should_close) {
+            var stream = try listener.accept(self.io);
+            if (self.live_connections.load(.monotonic) >= self.settings.maxConnections) {
+                debugPrint("connection limit reached, dropping connection\n", .{});
+                stream.close(self.io);
+                continue;
+            }
+            setIdleTimeout(stream, self.settings.keepAliveTimeout);
+            const conn = Connection.create(self.allocator, self.io, stream) catch {
+                stream.close(self.io);
+                continue;
+            };
+            _ = self.live_connections.fetchAdd(1, .monotonic);
+            self.park(conn) catch self.closeConnection(conn);
+        }
+    }
+
+    /// waits on the poller, queues connections with pending requests and drops ones idle for too long
+    fn eventLoop(self: *Server, state: *State) !void {
+        state.* = .waiting;
+        errdefer state.* = .err; // on error this thread will be killed and replaced
+        var events: [64]Poller.Event = undefined;
+        var last_sweep = nowSeconds(self.io);
+        while (!self.should_close) {
+            const n = self.poller.wait(&events, 1000);
+            for (events[0..n]) |ev| {
+                const conn: *Connection = @ptrFromInt(ev.data);
+                try self.parked_lock.lock(self.io);
+                self.parkedList(conn).remove(conn);
+                self.parked_lock.unlock(self.io);
+                if (!try self.queue.push(self.io, conn)) {
+                    debugPrint("work queue full, dropping connection\n", .{});
+                    self.closeConnection(conn);
+                }
+            }
+            const now = nowSeconds(self.io);
+            if (now != last_sweep) {
+                try self.sweepIdle(now);
+                last_sweep = now;
+            }
+        }
+    }
+
+    /// close parked connections that have been idle longer than keepAliveTimeout,
+    /// and ones that have not finished sending a request within requestTimeout
+    fn sweepIdle(self: *Server, now: i64) !void {
+        try self.parked_lock.lock(self.io);
+        defer self.parked_lock.unlock(self.io);
+        while (self.parked.head) |conn| {
+            if (now - conn.idle_since < self.settings.keepAliveTimeout) break;
+            self.parked.remove(conn);
+            self.poller.remove(conn.stream.socket.handle);
+            self.closeConnection(conn);
+        }
+        // re-parked after every read, so not ordered by request_started
+        var next = self.partial.head;
+        while (next) |conn| {
+            next = conn.next;
+            if (now - conn.request_started < self.settings.requestTimeout) continue;
+            self.partial.remove(conn);
+            self.poller.remove(conn.stream.socket.handle);
+            self.closeConnection(conn);
+        }
+    }
+
+    fn parkedList(self: *Server, conn: *Connection) *ParkedList {
+        return if (conn.request_started != 0) &self.partial else &self.parked;
+    }
 
-        var recv_buffer: [4096]u8 = undefined;
-        var send_buffer: [4096]u8 = undefined;
+    /// hand a connection back to the poller until its next request, or the rest of one, arrives
+    fn park(self: *Server, conn: *Connection) !void {
+        conn.idle_since = nowSeconds(self.io);
+        try self.parked_lock.lock(self.io);
+        defer self.parked_lock.unlock(self.io);
+        const list = self.parkedList(conn);
+        list.append(conn);
+        errdefer list.remove(conn);
+        try self.poller.arm(conn.stream.socket.handle, @intFromPtr(conn), !conn.registered);
+        conn.registered = true;
+    }
+
+    fn closeConnection(self: *Server, conn: *Connection) void {
+        conn.stream.close(self.io);
+        if (conn.large_buffer) |buf| self.allocator.free(buf);
+        self.allocator.destroy(conn);
+        _ = self.live_connections.fetchSub(1, .monotonic);
+    }
 
+    /// should normally not be called directly, intead call runServer
+    pub fn work(self: *Server, id: usize, state: *State, router: Router, class: Route.Class) !void {
         state.* = .waiting;
         errdefer state.* = .err; // on error this thread will be killed and replaced
-        debugPrint("path {s}\n", .{router.routes.items[0].path});
         var arena = std.heap.ArenaAllocator.init(self.allocator);
         defer arena.deinit();
+        const queue = switch (class) {
+            .fast => &self.queue,
+            .slow => &self.slow_queue,
+        };
 
         while (!self.should_close) {
-            var stream = try self.server.accept(io);
-            var connection_reader = stream.reader(io, &recv_buffer);
-            var connection_writer = stream.writer(io, &send_buffer);
-            var server: std.http.Server = .init(&connection_reader.interface, &connection_writer.interface);
-            debugPrint("{d} - {any}\n", .{ id, state });
-            state.* = .waiting;
+            const conn = try queue.pop(self.io);
             state.* = .busy; // tell the parent server that we are answering a request
-            // Fixed: Create reader and writer from connection.stream
+            const served = switch (class) {
+                .fast => self.serve(id, conn, router, &arena),
+                .slow => self.serveSlow(id, conn, &arena),
+            };
+            served catch |err| {
+                self.closeConnection(conn);
+                return err;
+            };
+            state.* = .waiting;
+        }
+    }
 
-            if (self.should_close) {
+    /// answer every request already buffered on `conn`, then park it until the client sends more
+    fn serve(self: *Server, id: usize, conn: *Connection, router: Router, arena: *std.heap.ArenaAllocator) !void {
+        while (true) {
+            switch (self.fillRequest(conn) catch .closed) {
+                .complete => {},
+                .idle, .partial => break,
+                .closed => {
+                    self.closeConnection(conn);
+                    return;
+                },
+                .length_required => return self.refuse(conn, "411 Length Required"),
+                .too_large => return self.refuse(conn, "413 Content Too Large"),
+            }
+            var request = conn.http.receiveHead() catch |err| {
+                if (err != error.HttpConnectionClosing) debugPrint("Worker #{d}: connection dropped {}\n", .{ id, err });
+                self.closeConnection(conn);
                 return;
+            };
+            // fillRequest already asked for the body
+            if (conn.continued) request.head.expect = null;
+            conn.served += 1;
+            if (conn.served >= self.settings.maxRequestsPerConnection) {
+                request.head.keep_alive = false;
             }
-            var request = try server.receiveHead();
             //print which path we are reaching
             debugPrint("Worker #{d}: {s} \n", .{ id, request.head.target });
-            // this is to ensure clean memory usage but can be bypassed in config.json
-            try router.route(self.io, &request, arena.allocator());
-            state.* = .waiting;
-            _ = arena.reset(.free_all);
+            const m = router.match(&request);
+            if (m.class() == .slow) {
+                // the head stays in the connection's buffer until a slow worker answers it
+                conn.pending = request;
+                conn.pending_match = m;
+                if (try self.slow_queue.push(self.io, conn)) return;
+                debugPrint("slow queue full, rejecting {s}\n", .{request.head.target});
+                try five03(&request, arena.allocator());
+            } else {
+                try Router.dispatch(self.io, &request, &m, arena.allocator(), conn);
+            }
+            if (!self.finishRequest(conn, arena)) return;
+            // pipelined requests are already buffered and will never wake the poller
+            if (conn.reader.interface.bufferedLen() == 0) break;
+        }
+        try self.park(conn);
+    }
+
+    /// Buffers the next request on `conn`, head and body, without blocking. A
+    /// worker only parses and dispatches a request once all of it is here, so
+    /// neither receiveHead nor a handler's body read waits on the client, and
+    /// a client trickling bytes is closed once requestTimeout runs out.
+    fn fillRequest(self: *Server, conn: *Connection) !Fill {
+        const r = &conn.reader.interface;
+        while (true) {
+            const buffered = r.buffer[r.seek..r.end];
+            if (buffered.len > 0) {
+                if (conn.request_started == 0) conn.request_started = nowSeconds(self.io);
+                var head_parser: std.http.HeadParser = .{};
+                const head_len = head_parser.feed(buffered);
+                if (head_parser.state == .finished) {
+                    // a malformed head is left for receiveHead to reject
+                    const head = std.http.Server.Request.Head.parse(buffered[0..head_len]) catch return .complete;
+                    if (head.transfer_encoding != .none) return .length_required;
+                    const content_length = head.content_length orelse 0;
+                    if (content_length > self.requestLimit() - head_len) return .too_large;
+                    const body_len: usize = @intCast(content_length);
+                    if (buffered.len >= head_len + body_len) return .complete;
+                    const expect = head.expect orelse "";
+                    if (std.ascii.eqlIgnoreCase(expect, "100-continue") and !conn.continued) {
+                        conn.continued = true;
+                        try conn.writer.interface.writeAll("HTTP/1.1 100 Continue\r\n\r\n");
+                        try conn.writer.interface.flush();
+                    }
+                }
+                if (nowSeconds(self.io) - conn.request_started >= self.settings.requestTimeout) return .closed;
+            }
+            if (!try self.makeRoom(conn)) return .too_large;
+            const n = std.c.recv(conn.stream.socket.handle, r.buffer[r.end..].ptr, r.buffer.len - r.end, std.c.MSG.DONTWAIT);
+            if (n == 0) return .closed;
+            if (n < 0) {
+                const err = std.c._errno().*;
+                if (err == @intFromEnum(std.c.E.INTR)) continue;
+                if (err != @intFromEnum(std.c.E.AGAIN)) return .closed;
+                return if (buffered.len == 0) .idle else .partial;
+            }
+            r.end += @intCast(n);
+        }
+    }
+
+    /// Frees space at the end of `conn`'s read buffer, growing it past
+    /// recv_buffer as the request's bytes arrive. False once the buffered
+    /// request has reached maxRequestBytes.
+    fn makeRoom(self: *Server, conn: *Connection) !bool {
+        const r = &conn.reader.interface;
+        if (r.end < r.buffer.len) return true;
+        const len = r.end - r.seek;
+        if (r.seek > 0) {
+            @memmove(r.buffer[0..len], r.buffer[r.seek..r.end]);
+            r.seek = 0;
+            r.end = len;
+            return true;
+        }
+        const limit = self.requestLimit();
+        if (r.buffer.len >= limit) return false;
+        const grown = try self.allocator.alloc(u8, @min(r.buffer.len * 2, limit));
+        @memcpy(grown[0..len], r.buffer[0..len]);
+        if (conn.large_buffer) |old| self.allocator.free(old);
+        conn.large_buffer = grown;
+        r.buffer = grown;
+        return true;
+    }
+
+    fn requestLimit(self: *Server) usize {
+        return @max(self.settings.maxRequestBytes, recv_buffer_size);
+    }
+
+    /// Forgets the request just answered on `conn`, and moves what is left
+    /// buffered back into recv_buffer when it fits.
+    fn requestDone(self: *Server, conn: *Connection) void {
+        conn.request_started = 0;
+        conn.continued = false;
+        const large = conn.large_buffer orelse return;
+        const r = &conn.reader.interface;
+        const len = r.end - r.seek;
+        if (len > conn.recv_buffer.len) return;
+        @memcpy(conn.recv_buffer[0..len], r.buffer[r.seek..r.end]);
+        r.buffer = &conn.recv_buffer;
+        r.seek = 0;
+        r.end = len;
+        self.allocator.free(large);
+        conn.large_buffer = null;
+    }
+
+    /// answer a request that will not be buffered with `status` and close the connection
+    fn refuse(self: *Server, conn: *Connection, status: []const u8) void {
+        const w = &conn.writer.interface;
+        w.print("HTTP/1.1 {s}\r\ncontent-length: 0\r\nconnection: close\r\n\r\n", .{status}) catch {};
+        w.flush() catch {};
+        self.closeConnection(conn);
+    }
+
+    /// answer the slow request a fast worker queued on `conn`, then hand the connection back to the fast pool
+    fn serveSlow(self: *Server, id: usize, conn: *Connection, arena: *std.heap.ArenaAllocator) !void {
+        debugPrint("Worker #{d}: {s} (slow)\n", .{ id, conn.pending.head.target });
+        try Router.dispatch(self.io, &conn.pending, &conn.pending_match, arena.allocator(), conn);
+        if (!self.finishRequest(conn, arena)) return;
+        if (conn.reader.interface.bufferedLen() > 0) {
+            if (!try self.queue.push(self.io, conn)) self.closeConnection(conn);
+            return;
+        }
+        try self.park(conn);
+    }
+
+    /// release per-request state; false when the connection is gone or was taken over by the handler
+    fn finishRequest(self: *Server, conn: *Connection, arena: *std.heap.ArenaAllocator) bool {
+        _ = arena.reset(.{ .retain_with_limit = arena_retain_limit });
+        if (conn.detached) {
+            // the socket belongs to the handler now, only drop our state
+            if (conn.registered) self.poller.remove(conn.stream.socket.handle);
+            if (conn.large_buffer) |buf| self.allocator.free(buf);
+            self.allocator.destroy(conn);
+            _ = self.live_connections.fetchSub(1, .monotonic);
+            return false;
+        }
+        // anything other than ready means the response closed the connection
+        // or the handler never answered, either way the socket is done
+        if (conn.http.reader.state != .ready) {
+            self.closeConnection(conn);
+            return false;
         }
+        self.requestDone(conn);
+        return true;
     }
 };
 
+/// open a listening socket that shares its port with the other workers' sockets.
+/// SO_REUSEPORT_LB on FreeBSD and SO_REUSEPORT on Linux let the kernel spread new connections across them
+fn listenReusePort(addr: std.Io.net.IpAddress) !std.Io.net.Server {
+    const family: u32 = switch (addr) {
+        .ip4 => std.c.AF.INET,
+        .ip6 => std.c.AF.INET6,
+    };
+    const fd = std.c.socket(family, std.c.SOCK.STREAM | std.c.SOCK.CLOEXEC, std.c.IPPROTO.TCP);
+    if (fd < 0) return error.SocketFailed;
+    errdefer _ = std.c.close(fd);
+
+    const one: c_int = 1;
+    const reuse_port = if (@hasDecl(std.c.SO, "REUSEPORT_LB")) std.c.SO.REUSEPORT_LB else std.c.SO.REUSEPORT;
+    if (std.c.setsockopt(fd, std.c.SOL.SOCKET, std.c.SO.REUSEADDR, std.mem.asBytes(&one), @sizeOf(c_int)) != 0) return error.SetSockOptFailed;
+    if (std.c.setsockopt(fd, std.c.SOL.SOCKET, reuse_port, std.mem.asBytes(&one), @sizeOf(c_int)) != 0) return error.SetSockOptFailed;
+
+    const rc = switch (addr) {
+        .ip4 => |a| blk: {
+            const sa: std.c.sockaddr.in = .{ .port = std.mem.nativeToBig(u16, a.port), .addr = @bitCast(a.bytes) };
+            break :blk std.c.bind(fd, @ptrCast(&sa), @sizeOf(std.c.sockaddr.in));
+        },
+        .ip6 => |a| blk: {
+            const sa: std.c.sockaddr.in6 = .{ .port = std.mem.nativeToBig(u16, a.port), .flowinfo = a.flow, .addr = a.bytes, .scope_id = a.interface.index };
+            break :blk std.c.bind(fd, @ptrCast(&sa), @sizeOf(std.c.sockaddr.in6));
+        },
+    };
+    if (rc != 0) return error.BindFailed;
+    if (std.c.listen(fd, 128) != 0) return error.ListenFailed;
+    return .{ .socket = .{ .handle = fd, .address = addr } };
+}
+
+/// bytes of arena capacity a worker keeps between requests
+const arena_retain_limit = 1024 * 1024;
+
+/// a last bound on blocking reads; requests are buffered whole by fillRequest before anything reads them
+fn setIdleTimeout(stream: std.Io.net.Stream, seconds: u32) void {
+    const tv: std.c.timeval = .{ .sec = @intCast(seconds), .usec = 0 };
+    _ = std.c.setsockopt(stream.socket.handle, std.c.SOL.SOCKET, std.c.SO.RCVTIMEO, std.mem.asBytes(&tv), @sizeOf(std.c.timeval));
+}
+
+fn nowSeconds(io: std.Io) i64 {
+    const ts = std.Io.Clock.awake.now(io) catch return 0;
+    return ts.toSeconds();
+}
+
 /// this struct is used to parse []const u8 into a given type
 pub const Parser = struct {
     ///parse a json encoded string to a provided type
@@ -408,6 +1110,20 @@ pub const Parser = struct {
         return cookies;
     }
 
+    /// value of one cookie, without building the whole map
+    pub fn cookie(request: *std.http.Server.Request, name: []const u8) ?[]const u8 {
+        var it = request.iterateHeaders();
+        while (it.next()) |header| {
+            if (!std.ascii.eqlIgnoreCase(header.name, "Cookie")) continue;
+            var pairs = std.mem.tokenizeSequence(u8, header.value, "; ");
+            while (pairs.next()) |kv| {
+                const delim = std.mem.indexOfScalar(u8, kv, '=') orelse continue;
+                if (std.mem.eql(u8, kv[0..delim], name)) return kv[delim + 1 ..];
+            }
+        }
+        return null;
+    }
+
     fn parseStringToType(T: type, str: []const u8) !T {
         return switch (T) {
             []const u8 => str,
@@ -424,6 +1140,17 @@ pub const Parser = struct {
         };
     }
 
+    /// value of one query string parameter, still url encoded
+    pub fn queryValue(request: *std.http.Server.Request, key: []const u8) ?[]const u8 {
+        const q = std.mem.indexOfScalar(u8, request.head.target, '?') orelse return null;
+        var it = std.mem.tokenizeScalar(u8, request.head.target[q + 1 ..], '&');
+        while (it.next()) |pair| {
+            const eq = std.mem.indexOfScalar(u8, pair, '=') orelse continue;
+            if (std.mem.eql(u8, pair[0..eq], key)) return pair[eq + 1 ..];
+        }
+        return null;
+    }
+
     /// takes a request and a type and returns query params that match that type.
     pub fn query(T: type, allocator: std.mem.Allocator, request: *std.http.Server.Request) ?T {
         const qIndex = std.mem.indexOf(u8, request.head.target, "?") orelse return null;
@@ -459,20 +1186,11 @@ pub const Parser = struct {
         return x;
     }
 
-    /// fetches single param from url
+    /// fetches single param captured by the router
     pub fn single_param(T: type, c: *Context, key: []const u8) !?T {
-        var foo = std.mem.tokenizeScalar(u8, c.route.path, '/');
-        var bar = std.mem.tokenizeScalar(u8, c.request.head.target, '/');
-        while (foo.peek() != null and bar.peek() != null) {
-            const a = foo.peek();
-            if (std.mem.eql(u8, a.?[1..], key)) {
-                const decoded = try urlDecode(bar.peek().?, c.allocator);
-                return try parseStringToType(T, decoded);
-            }
-            _ = foo.next();
-            _ = bar.next();
-        }
-        return null;
+        const raw = c.param(key) orelse return null;
+        const decoded = if (std.mem.indexOfScalar(u8, raw, '%') == null) raw else try urlDecode(raw, c.allocator);
+        return try parseStringToType(T, decoded);
     }
 
     /// this function parses key value pairs, memory is leaky so an arena is suggested
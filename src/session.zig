@@ -0,0 +1,179 @@
+//! Verified sessions kept in memory, so an authenticated request costs one
+//! hash lookup instead of JWT verification, a fetch_cache query and two JSON
+//! parses. Entries are keyed by the token's signature, split over
+//! lock-striped shards, and hold the claims plus the parsed user.
+const std = @import("std");
+const auth = @import("auth.zig");
+const dynamo = @import("dynamo.zig");
+
+/// how long a verified session is trusted before the user is fetched again
+pub const ttl_seconds = 5 * 60;
+const shard_count = 16;
+/// entries per shard before the oldest-expiring one is evicted
+const shard_capacity = 1024;
+
+/// A cached session. It is reference counted: the cache holds one
+/// reference, and a request holds one from lookup until it finishes.
+pub const Entry = struct {
+    arena: std.heap.ArenaAllocator,
+    token: []const u8,
+    claims: auth.AuthBody,
+    user: dynamo.User,
+    /// the user item as plain JSON, for handlers that forward it
+    user_json: []const u8,
+    expires: i64,
+    refs: std.atomic.Value(u32) = .init(1),
+
+    pub fn release(self: *Entry) void {
+        if (self.refs.fetchSub(1, .acq_rel) != 1) return;
+        var arena = self.arena;
+        arena.deinit();
+    }
+
+    fn acquire(self: *Entry) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+};
+
+const Shard = struct {
+    lock: std.Io.Mutex = .init,
+    map: std.AutoHashMapUnmanaged(u64, *Entry) = .empty,
+    /// bumped by invalidateUser; a load that saw another value read its
+    /// user before the invalidation and must not be cached
+    generation: u64 = 0,
+};
+
+var shards: [shard_count]Shard = @splat(.{});
+
+fn now(io: std.Io) i64 {
+    const ts = std.Io.Clock.awake.now(io) catch return 0;
+    return ts.toSeconds();
+}
+
+fn keyOf(token: []const u8) u64 {
+    const sig = token[(std.mem.lastIndexOfScalar(u8, token, '.') orelse 0)..];
+    return std.hash.Wyhash.hash(0, sig);
+}
+
+fn shardOf(key: u64) *Shard {
+    return &shards[key % shard_count];
+}
+
+/// Returns the live session for `token` with a reference the caller must
+/// release, or null on a miss.
+pub fn lookup(io: std.Io, token: []const u8) !?*Entry {
+    const key = keyOf(token);
+    const shard = shardOf(key);
+    try shard.lock.lock(io);
+    defer shard.lock.unlock(io);
+    const entry = shard.map.get(key) orelse return null;
+    // the signature only selects the slot, the whole token must match
+    if (entry.expires <= now(io) or !std.mem.eql(u8, entry.token, token)) return null;
+    entry.acquire();
+    return entry;
+}
+
+/// Verifies `token`, fetches its user and caches both. Returns a referenced
+/// entry, or null if the user does not exist.
+pub fn load(io: std.Io, token: []const u8, secret: ?[]const u8) !?*Entry {
+    var arena = std.heap.ArenaAllocator.init(std.heap.c_allocator);
+    errdefer arena.deinit();
+    const allocator = arena.allocator();
+
+    const claims = try auth.decodeAuth(auth.AuthBody, allocator, token, secret);
+    const key = keyOf(token);
+    const generation = try generationOf(io, shardOf(key));
+    const email = try allocator.dupeZ(u8, claims.user);
+    const result = dynamo.c.get_item_pk_sk("USER", email, email) orelse {
+        arena.deinit();
+        return null;
+    };
+    defer std.c.free(result);
+    const user_json = try allocator.dupe(u8, std.mem.span(result));
+    const user = try std.json.parseFromSliceLeaky(dynamo.User, allocator, user_json, .{
+        .ignore_unknown_fields = true,
+        .allocate = .alloc_if_needed,
+    });
+
+    const entry = try allocator.create(Entry);
+    entry.* = .{
+        .arena = undefined,
+        .token = try allocator.dupe(u8, token),
+        .claims = claims,
+        .user = user,
+        .user_json = user_json,
+        .expires = now(io) + ttl_seconds,
+    };
+    entry.arena = arena;
+    // one reference for the cache, one for the caller
+    entry.acquire();
+    insert(io, key, entry, generation) catch entry.release();
+    return entry;
+}
+
+fn generationOf(io: std.Io, shard: *Shard) !u64 {
+    try shard.lock.lock(io);
+    defer shard.lock.unlock(io);
+    return shard.generation;
+}
+
+fn insert(io: std.Io, key: u64, entry: *Entry, generation: u64) !void {
+    const shard = shardOf(key);
+    try shard.lock.lock(io);
+    defer shard.lock.unlock(io);
+    if (shard.generation != generation) return error.Invalidated;
+    if (shard.map.count() >= shard_capacity and !shard.map.contains(key)) evict(shard, now(io));
+    const slot = try shard.map.getOrPut(std.heap.c_allocator, key);
+    if (slot.found_existing) slot.value_ptr.*.release();
+    slot.value_ptr.* = entry;
+}
+
+/// Drops expired entries, or failing that the one closest to expiring.
+fn evict(shard: *Shard, t: i64) void {
+    removeIf(shard, t, null);
+    if (shard.map.count() < shard_capacity) return;
+    var soonest: ?u64 = null;
+    var soonest_expires: i64 = std.math.maxInt(i64);
+    var it = shard.map.iterator();
+    while (it.next()) |kv| {
+        if (kv.value_ptr.*.expires < soonest_expires) {
+            soonest = kv.key_ptr.*;
+            soonest_expires = kv.value_ptr.*.expires;
+        }
+    }
+    if (soonest) |key| {
+        if (shard.map.fetchRemove(key)) |kv| kv.value.release();
+    }
+}
+
+/// Removes entries that expired by `t`, or belong to `email` when given.
+fn removeIf(shard: *Shard, t: i64, email: ?[]const u8) void {
+    while (true) {
+        var victims: [64]u64 = undefined;
+        var n: usize = 0;
+        var it = shard.map.iterator();
+        while (it.next()) |kv| {
+            const e = kv.value_ptr.*;
+            const match = if (email) |m| std.mem.eql(u8, e.user.email, m) else e.expires <= t;
+            if (!match) continue;
+            victims[n] = kv.key_ptr.*;
+            n += 1;
+            if (n == victims.len) break;
+        }
+        for (victims[0..n]) |key| {
+            if (shard.map.fetchRemove(key)) |kv| kv.value.release();
+        }
+        if (n < victims.len) return;
+    }
+}
+
+/// Forgets every session of `email`, e.g. after its user item changed, so
+/// the next request reads it fresh. Loads already under way are not cached.
+pub fn invalidateUser(io: std.Io, email: []const u8) !void {
+    for (&shards) |*shard| {
+        try shard.lock.lock(io);
+        defer shard.lock.unlock(io);
+        shard.generation +%= 1;
+        removeIf(shard, 0, email);
+    }
+}
@@ -4,11 +4,25 @@ pub const c = @cImport({
     @cInclude("sqlite3.h");
 });
 
-// Thread-local storage - each thread gets its own connection and statement
+// Thread-local storage - each thread gets its own connection and statement cache
 threadlocal var thread_db: ?*c.sqlite3 = null;
-threadlocal var thread_stmt: ?*c.sqlite3_stmt = null;
 threadlocal var thread_initialized: bool = false;
 
+/// prepared statements kept per thread; the statement texts are literals, so
+/// the working set is small and fixed
+const stmt_cache_size = 32;
+
+const CachedStmt = struct {
+    /// address of the SQL text the statement was prepared from
+    key: usize = 0,
+    stmt: ?*c.sqlite3_stmt = null,
+    last_used: u64 = 0,
+    in_use: bool = false,
+};
+
+threadlocal var stmt_cache: [stmt_cache_size]CachedStmt = @splat(.{});
+threadlocal var stmt_tick: u64 = 0;
+
 // Template cache (shared across all threads, read-only after init)
 var template_cache: []const u8 = undefined;
 var template_allocator: std.mem.Allocator = undefined;
@@ -79,19 +93,85 @@ fn initThreadLocal() !void {
 
 fn prepareStmt(sql: []const u8) !?*c.sqlite3_stmt {
     var stmt: ?*c.sqlite3_stmt = null;
-    const rc = c.sqlite3_prepare_v2(thread_db, sql.ptr, @intCast(sql.len), &stmt, null);
+    const rc = c.sqlite3_prepare_v3(thread_db, sql.ptr, @intCast(sql.len), c.SQLITE_PREPARE_PERSISTENT, &stmt, null);
     if (rc != c.SQLITE_OK) {
-        std.debug.print("sqlite3_prepare_v2 error: {s}\n", .{std.mem.span(c.sqlite3_errmsg(thread_db.?))});
+        std.debug.print("sqlite3_prepare_v3 error: {s}\n", .{std.mem.span(c.sqlite3_errmsg(thread_db.?))});
         return error.PrepareFailed;
     }
     return stmt;
 }
 
+/// A statement checked out of the thread's cache. `release` resets it, which
+/// ends its read transaction and invalidates any column slices handed out.
+pub const Stmt = struct {
+    handle: ?*c.sqlite3_stmt,
+    /// null when the statement was prepared outside the cache
+    slot: ?*CachedStmt,
+
+    pub fn release(self: Stmt) void {
+        const slot = self.slot orelse {
+            _ = c.sqlite3_finalize(self.handle);
+            return;
+        };
+        _ = c.sqlite3_reset(self.handle);
+        _ = c.sqlite3_clear_bindings(self.handle);
+        slot.in_use = false;
+    }
+};
+
+/// Returns the cached statement for `sql`, preparing it on a miss and
+/// finalizing the least recently used one when the cache is full. Entries are
+/// keyed by the text's address and checked against the text SQLite kept, so
+/// a reused buffer never picks up another query's statement.
+fn acquireStmt(sql: []const u8) !Stmt {
+    try initThreadLocal();
+    if (thread_db == null) {
+        std.debug.print("thread_db is null after initThreadLocal\n", .{});
+        return error.DatabaseError;
+    }
+    stmt_tick += 1;
+    const key = @intFromPtr(sql.ptr);
+    var victim: ?*CachedStmt = null;
+    for (&stmt_cache) |*slot| {
+        if (slot.in_use) continue;
+        if (slot.key == key and slot.stmt != null) {
+            if (std.mem.eql(u8, std.mem.span(c.sqlite3_sql(slot.stmt)), sql)) {
+                slot.in_use = true;
+                slot.last_used = stmt_tick;
+                return .{ .handle = slot.stmt, .slot = slot };
+            }
+            // the address now holds different text
+            victim = slot;
+            break;
+        }
+        if (victim == null or slot.last_used < victim.?.last_used) victim = slot;
+    }
+    // nested use of a busy statement, or every slot checked out
+    const stmt = try prepareStmt(sql);
+    const slot = victim orelse return .{ .handle = stmt, .slot = null };
+    if (slot.stmt) |old| _ = c.sqlite3_finalize(old);
+    slot.* = .{ .key = key, .stmt = stmt, .last_used = stmt_tick, .in_use = true };
+    return .{ .handle = stmt, .slot = slot };
+}
+
+fn finalizeStmtCache() void {
+    for (&stmt_cache) |*slot| {
+        if (slot.stmt) |stmt| _ = c.sqlite3_finalize(stmt);
+        slot.* = .{};
+    }
+}
+
+/// Binds bytes as a BLOB rather than TEXT.
+pub const Blob = struct { bytes: []const u8 };
 
 fn bindArgs(allocator: std.mem.Allocator, stmt: ?*c.sqlite3_stmt, args: anytype) !void {
     const fields = @typeInfo(@TypeOf(args)).@"struct".fields;
     inline for (fields, 0..) |field, i| {
         const val = @field(args, field.name);
+        if (@TypeOf(val) == Blob) {
+            _ = c.sqlite3_bind_blob(stmt, @intCast(i + 1), val.bytes.ptr, @intCast(val.bytes.len), c.SQLITE_STATIC);
+            continue;
+        }
         switch (@typeInfo(@TypeOf(val))) {
             .int, .comptime_int => _ = c.sqlite3_bind_int64(stmt, @intCast(i + 1), @intCast(val)),
             .float, .comptime_float => _ = c.sqlite3_bind_double(stmt, @intCast(i + 1), @floatCast(val)),
@@ -118,87 +198,203 @@ fn bindArgs(allocator: std.mem.Allocator, stmt: ?*c.sqlite3_stmt, args: anytype)
     }
 }
 
-fn serializeRow(allocator: std.mem.Allocator, stmt: ?*c.sqlite3_stmt) ![]const u8 {
-    const col_count = c.sqlite3_column_count(stmt);
-    var row = std.ArrayList(u8){};
-    try row.append(allocator, '{');
-    for (0..@intCast(col_count)) |i| {
-        if (i > 0) try row.append(allocator, ',');
-        const col_name = std.mem.span(c.sqlite3_column_name(stmt, @intCast(i)));
-        const col_str = try std.fmt.allocPrint(allocator, "\"{s}\":", .{col_name});
-        defer allocator.free(col_str);
-        try row.appendSlice(allocator, col_str);
-        switch (c.sqlite3_column_type(stmt, @intCast(i))) {
-            c.SQLITE_INTEGER => {
-                const s = try std.fmt.allocPrint(allocator, "{d}", .{c.sqlite3_column_int64(stmt, @intCast(i))});
-                defer allocator.free(s);
-                try row.appendSlice(allocator, s);
+fn serializeRow(allocator: std.mem.Allocator, row: Row) ![]const u8 {
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    errdefer out.deinit();
+    const w = &out.writer;
+    try w.writeByte('{');
+    for (0..row.columnCount()) |i| {
+        if (i > 0) try w.writeByte(',');
+        try std.json.Stringify.encodeJsonString(row.columnName(i), .{}, w);
+        try w.writeByte(':');
+        switch (c.sqlite3_column_type(row.stmt, @intCast(i))) {
+            c.SQLITE_INTEGER => try w.print("{d}", .{row.int(i)}),
+            c.SQLITE_FLOAT => try w.print("{d}", .{row.float(i)}),
+            c.SQLITE_TEXT => try std.json.Stringify.encodeJsonString(row.text(i), .{}, w),
+            else => try w.writeAll("null"),
+        }
+    }
+    try w.writeByte('}');
+    return try out.toOwnedSlice();
+}
+
+/// The current row of a query. Text and blob slices point into SQLite's own
+/// buffers: they are valid until the next `Rows.next` or `Rows.deinit`.
+pub const Row = struct {
+    stmt: ?*c.sqlite3_stmt,
+
+    pub fn columnCount(self: Row) usize {
+        return @intCast(c.sqlite3_column_count(self.stmt));
+    }
+
+    pub fn columnName(self: Row, i: usize) []const u8 {
+        return std.mem.span(c.sqlite3_column_name(self.stmt, @intCast(i)));
+    }
+
+    pub fn isNull(self: Row, i: usize) bool {
+        return c.sqlite3_column_type(self.stmt, @intCast(i)) == c.SQLITE_NULL;
+    }
+
+    pub fn int(self: Row, i: usize) i64 {
+        return c.sqlite3_column_int64(self.stmt, @intCast(i));
+    }
+
+    pub fn float(self: Row, i: usize) f64 {
+        return c.sqlite3_column_double(self.stmt, @intCast(i));
+    }
+
+    pub fn text(self: Row, i: usize) []const u8 {
+        const ptr = c.sqlite3_column_text(self.stmt, @intCast(i));
+        if (ptr == null) return "";
+        const len: usize = @intCast(c.sqlite3_column_bytes(self.stmt, @intCast(i)));
+        return ptr[0..len];
+    }
+
+    pub fn blob(self: Row, i: usize) []const u8 {
+        const ptr = c.sqlite3_column_blob(self.stmt, @intCast(i)) orelse return "";
+        const len: usize = @intCast(c.sqlite3_column_bytes(self.stmt, @intCast(i)));
+        return @as([*]const u8, @ptrCast(ptr))[0..len];
+    }
+
+    /// Decodes the columns, in order, into the fields of `T`. Strings borrow
+    /// from the row; pass them through `one` to own them.
+    pub fn decode(self: Row, comptime T: type) T {
+        var out: T = undefined;
+        inline for (@typeInfo(T).@"struct".fields, 0..) |field, i| {
+            @field(out, field.name) = self.column(field.type, i);
+        }
+        return out;
+    }
+
+    fn column(self: Row, comptime T: type, i: usize) T {
+        switch (@typeInfo(T)) {
+            .optional => |opt| return if (self.isNull(i)) null else self.column(opt.child, i),
+            .int => return @intCast(self.int(i)),
+            .float => return @floatCast(self.float(i)),
+            .bool => return self.int(i) != 0,
+            .pointer => |ptr| {
+                if (ptr.size != .slice or ptr.child != u8) @compileError("unsupported column type: " ++ @typeName(T));
+                return self.text(i);
             },
-            c.SQLITE_FLOAT => {
-                const s = try std.fmt.allocPrint(allocator, "{d}", .{c.sqlite3_column_double(stmt, @intCast(i))});
-                defer allocator.free(s);
-                try row.appendSlice(allocator, s);
+            else => @compileError("unsupported column type: " ++ @typeName(T)),
+        }
+    }
+};
+
+/// Rows of a query on a cached statement. Call `deinit` when done, which also
+/// returns the statement to the cache.
+pub const Rows = struct {
+    stmt: Stmt,
+
+    pub fn next(self: *Rows) !?Row {
+        return switch (c.sqlite3_step(self.stmt.handle)) {
+            c.SQLITE_ROW => .{ .stmt = self.stmt.handle },
+            c.SQLITE_DONE => null,
+            else => {
+                std.debug.print("sqlite3_step error: {s}\n", .{std.mem.span(c.sqlite3_errmsg(thread_db.?))});
+                return error.StepFailed;
             },
-            c.SQLITE_TEXT => {
-                const s = try std.fmt.allocPrint(allocator, "\"{s}\"", .{std.mem.span(c.sqlite3_column_text(stmt, @intCast(i)))});
-                defer allocator.free(s);
-                try row.appendSlice(allocator, s);
+        };
+    }
+
+    pub fn deinit(self: *Rows) void {
+        self.stmt.release();
+    }
+};
+
+pub fn query(allocator: std.mem.Allocator, sql: []const u8, args: anytype) !Rows {
+    const stmt = try acquireStmt(sql);
+    errdefer stmt.release();
+    try bindArgs(allocator, stmt.handle, args);
+    return .{ .stmt = stmt };
+}
+
+/// Runs `sql` and decodes its first row into `T`, copying strings into
+/// `allocator`. Returns null when there is no row.
+pub fn one(comptime T: type, allocator: std.mem.Allocator, sql: []const u8, args: anytype) !?T {
+    var rows = try query(allocator, sql, args);
+    defer rows.deinit();
+    const row = (try rows.next()) orelse return null;
+    var out = row.decode(T);
+    inline for (@typeInfo(T).@"struct".fields) |field| {
+        switch (field.type) {
+            []const u8 => @field(out, field.name) = try allocator.dupe(u8, @field(out, field.name)),
+            ?[]const u8 => if (@field(out, field.name)) |v| {
+                @field(out, field.name) = try allocator.dupe(u8, v);
             },
-            else => try row.appendSlice(allocator, "null"),
+            else => {},
         }
     }
-    try row.append(allocator, '}');
-    return try row.toOwnedSlice(allocator);
+    return out;
 }
 
 pub fn exec(allocator: std.mem.Allocator, sql: []const u8, args: anytype) !void {
-    try initThreadLocal();
-    if (thread_db == null) {
-        std.debug.print("thread_db is null after initThreadLocal\n", .{});
-        return error.DatabaseError;
-    }
-    const stmt = try prepareStmt(sql);
-    defer _ = c.sqlite3_finalize(stmt);
-    try bindArgs(allocator, stmt, args);
-    const step_rc = c.sqlite3_step(stmt);
+    const stmt = try acquireStmt(sql);
+    defer stmt.release();
+    try bindArgs(allocator, stmt.handle, args);
+    const step_rc = c.sqlite3_step(stmt.handle);
     if (step_rc != c.SQLITE_DONE and step_rc != c.SQLITE_ROW) {
         std.debug.print("sqlite3_step error: {s}\n", .{std.mem.span(c.sqlite3_errmsg(thread_db.?))});
         return error.ExecFailed;
     }
 }
 
+/// Rows changed by the last statement this thread ran.
+pub fn changes() usize {
+    return @intCast(c.sqlite3_changes(thread_db));
+}
+
+/// Returns every row as a JSON object. Prefer `query` or `one` on hot paths.
 pub fn getAll(allocator: std.mem.Allocator, sql: []const u8, args: anytype) ![][]const u8 {
-    try initThreadLocal();
-    const stmt = try prepareStmt(sql);
-    defer _ = c.sqlite3_finalize(stmt);
-    try bindArgs(allocator, stmt, args);
+    var rows = try query(allocator, sql, args);
+    defer rows.deinit();
 
-    var rows = std.ArrayList([]const u8){};
-    defer rows.deinit(allocator);
+    var out = std.ArrayList([]const u8){};
+    defer out.deinit(allocator);
 
-    while (c.sqlite3_step(stmt) == c.SQLITE_ROW) {
-        try rows.append(allocator, try serializeRow(allocator, stmt));
+    while (try rows.next()) |row| {
+        try out.append(allocator, try serializeRow(allocator, row));
     }
 
-    return rows.toOwnedSlice(allocator);
+    return out.toOwnedSlice(allocator);
 }
 
 pub fn getOne(allocator: std.mem.Allocator, sql: []const u8, args: anytype) !?[]const u8 {
-    try initThreadLocal();
-    const stmt = try prepareStmt(sql);
-    defer _ = c.sqlite3_finalize(stmt);
-    try bindArgs(allocator, stmt, args);
+    var rows = try query(allocator, sql, args);
+    defer rows.deinit();
+    const row = (try rows.next()) orelse return null;
+    return try serializeRow(allocator, row);
+}
+
+/// rows the sweeper deletes per statement, small enough that request writers
+/// are never held off the write lock for long
+const sweep_batch = 500;
+const sweep_interval_seconds = 60;
+const sweep_sql = std.fmt.comptimePrint("DELETE FROM fetch_cache WHERE id IN (SELECT id FROM fetch_cache WHERE expires_at <= unixepoch() LIMIT {d})", .{sweep_batch});
 
-    if (c.sqlite3_step(stmt) != c.SQLITE_ROW) return null;
-    return try serializeRow(allocator, stmt);
+/// Deletes expired fetch_cache rows forever, in batches walked through the
+/// expires_at index. Runs on its own thread and connection.
+pub fn sweepFetchCache(io: std.Io) void {
+    while (true) {
+        var removed: usize = 0;
+        while (true) {
+            exec(std.heap.c_allocator, sweep_sql, .{}) catch |err| {
+                std.debug.print("fetch_cache sweep failed: {}\n", .{err});
+                break;
+            };
+            const n = changes();
+            removed += n;
+            if (n < sweep_batch) break;
+            std.Io.sleep(io, std.Io.Duration.fromMilliseconds(10), std.Io.Clock.awake) catch {};
+        }
+        if (removed > 0) std.debug.print("fetch_cache sweep removed {d} rows\n", .{removed});
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(sweep_interval_seconds * 1000), std.Io.Clock.awake) catch {};
+    }
 }
 
 pub fn deinit() void {
     // Clean up thread-local resources
-    if (thread_stmt) |stmt| {
-        _ = c.sqlite3_finalize(stmt);
-        thread_stmt = null;
-    }
+    finalizeStmtCache();
     if (thread_db) |db| {
         _ = c.sqlite3_close(db);
         thread_db = null;
@@ -211,10 +407,7 @@ pub fn deinit() void {
 
 // Call this from each thread when it exits (if you have thread cleanup)
 pub fn deinitThread() void {
-    if (thread_stmt) |stmt| {
-        _ = c.sqlite3_finalize(stmt);
-        thread_stmt = null;
-    }
+    finalizeStmtCache();
     if (thread_db) |db| {
         _ = c.sqlite3_close(db);
         thread_db = null;
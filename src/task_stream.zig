@@ -0,0 +1,205 @@
+//! Server-sent events for task progress. A browser holds one
+//! `GET /tasks/stream` connection, the socket is detached from the worker
+//! pool and registered here under the user's email, and every task update
+//! is pushed to that user's streams as it is written. Subscribers are kept
+//! in lock-striped shards like the session cache.
+const std = @import("std");
+
+const shard_count = 16;
+/// open streams one user may hold, further tabs replace the oldest
+const max_per_user = 8;
+/// a write that stalls this long marks the client as gone
+const send_timeout_seconds = 2;
+/// comment lines sent to idle streams so proxies keep them open and dead
+/// clients are found
+pub const heartbeat_seconds = 20;
+
+const Subscriber = struct {
+    stream: std.Io.net.Stream,
+    /// serializes writers so events never interleave on the wire
+    lock: std.Io.Mutex = .init,
+    dead: std.atomic.Value(bool) = .init(false),
+    refs: std.atomic.Value(u32) = .init(1),
+
+    fn acquire(self: *Subscriber) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+
+    fn release(self: *Subscriber, io: std.Io) void {
+        if (self.refs.fetchSub(1, .acq_rel) != 1) return;
+        self.stream.close(io);
+        std.heap.c_allocator.destroy(self);
+    }
+
+    /// Writes one chunk of the chunked response body. Returns false once the
+    /// client is gone.
+    fn send(self: *Subscriber, io: std.Io, payload: []const u8) bool {
+        if (self.dead.load(.acquire)) return false;
+        self.lock.lock(io) catch return false;
+        defer self.lock.unlock(io);
+        var size: [18]u8 = undefined;
+        const head = std.fmt.bufPrint(&size, "{x}\r\n", .{payload.len}) catch unreachable;
+        if (writeAll(self.stream, head) and writeAll(self.stream, payload) and writeAll(self.stream, "\r\n")) return true;
+        self.dead.store(true, .release);
+        return false;
+    }
+};
+
+const Shard = struct {
+    lock: std.Io.Mutex = .init,
+    /// owned email -> that user's open streams, oldest first
+    users: std.StringHashMapUnmanaged(std.ArrayList(*Subscriber)) = .empty,
+};
+
+var shards: [shard_count]Shard = @splat(.{});
+
+fn shardOf(email: []const u8) *Shard {
+    return &shards[std.hash.Wyhash.hash(0, email) % shard_count];
+}
+
+const send_flags: u32 = if (@hasDecl(std.c.MSG, "NOSIGNAL")) std.c.MSG.NOSIGNAL else 0;
+
+fn writeAll(stream: std.Io.net.Stream, bytes: []const u8) bool {
+    var rest = bytes;
+    while (rest.len > 0) {
+        const n = std.c.send(stream.socket.handle, rest.ptr, rest.len, send_flags);
+        if (n <= 0) return false;
+        rest = rest[@intCast(n)..];
+    }
+    return true;
+}
+
+/// Starts the event stream on a detached socket: writes the response head
+/// and `initial` events, then registers the stream for `email`. The stream
+/// is closed on failure.
+pub fn subscribe(io: std.Io, stream: std.Io.net.Stream, email: []const u8, origin: []const u8, initial: []const u8) !void {
+    const sub = try std.heap.c_allocator.create(Subscriber);
+    sub.* = .{ .stream = stream };
+    errdefer sub.release(io);
+
+    const tv: std.c.timeval = .{ .sec = send_timeout_seconds, .usec = 0 };
+    _ = std.c.setsockopt(stream.socket.handle, std.c.SOL.SOCKET, std.c.SO.SNDTIMEO, std.mem.asBytes(&tv), @sizeOf(std.c.timeval));
+
+    var head_buf: [512]u8 = undefined;
+    const head = try std.fmt.bufPrint(&head_buf, "HTTP/1.1 200 OK\r\n" ++
+        "Content-Type: text/event-stream\r\n" ++
+        "Cache-Control: no-cache\r\n" ++
+        "Transfer-Encoding: chunked\r\n" ++
+        "Access-Control-Allow-Origin: {s}\r\n" ++
+        "Access-Control-Allow-Credentials: true\r\n" ++
+        "X-Accel-Buffering: no\r\n\r\n", .{origin});
+    if (!writeAll(stream, head)) return error.ClientGone;
+    // retry hint for EventSource reconnects, then whatever the caller has
+    if (!sub.send(io, "retry: 3000\n\n")) return error.ClientGone;
+    if (initial.len > 0 and !sub.send(io, initial)) return error.ClientGone;
+
+    const shard = shardOf(email);
+    try shard.lock.lock(io);
+    defer shard.lock.unlock(io);
+    const slot = try shard.users.getOrPut(std.heap.c_allocator, email);
+    if (!slot.found_existing) {
+        slot.key_ptr.* = std.heap.c_allocator.dupe(u8, email) catch |err| {
+            shard.users.removeByPtr(slot.key_ptr);
+            return err;
+        };
+        slot.value_ptr.* = .empty;
+    }
+    const list = slot.value_ptr;
+    if (list.items.len >= max_per_user) list.orderedRemove(0).release(io);
+    try list.append(std.heap.c_allocator, sub);
+}
+
+/// Formats one SSE event; `data` must not contain newlines.
+pub fn writeEvent(w: *std.Io.Writer, event: []const u8, data: []const u8) !void {
+    try w.print("event: {s}\ndata: {s}\n\n", .{ event, data });
+}
+
+/// Pushes a formatted event to every stream `email` has open, dropping the
+/// ones whose client went away. A no-op when the user has none.
+pub fn publish(io: std.Io, email: []const u8, payload: []const u8) void {
+    var targets: [max_per_user]*Subscriber = undefined;
+    var n: usize = 0;
+    const shard = shardOf(email);
+    {
+        shard.lock.lock(io) catch return;
+        defer shard.lock.unlock(io);
+        const list = shard.users.get(email) orelse return;
+        for (list.items) |sub| {
+            sub.acquire();
+            targets[n] = sub;
+            n += 1;
+        }
+    }
+    var any_dead = false;
+    for (targets[0..n]) |sub| {
+        if (!sub.send(io, payload)) any_dead = true;
+        sub.release(io);
+    }
+    if (any_dead) prune(io, shard, email);
+}
+
+/// Drops dead streams of `email`, or of every user when null.
+fn prune(io: std.Io, shard: *Shard, email: ?[]const u8) void {
+    shard.lock.lock(io) catch return;
+    defer shard.lock.unlock(io);
+    var it = shard.users.iterator();
+    while (it.next()) |kv| {
+        if (email) |e| if (!std.mem.eql(u8, kv.key_ptr.*, e)) continue;
+        const list = kv.value_ptr;
+        var i: usize = 0;
+        while (i < list.items.len) {
+            const sub = list.items[i];
+            if (sub.dead.load(.acquire)) {
+                _ = list.orderedRemove(i);
+                sub.release(io);
+            } else i += 1;
+        }
+    }
+    // empty users are removed after the walk, the iterator must not see it
+    while (true) {
+        var empty: ?[]const u8 = null;
+        var kit = shard.users.iterator();
+        while (kit.next()) |kv| {
+            if (kv.value_ptr.items.len == 0) {
+                empty = kv.key_ptr.*;
+                break;
+            }
+        }
+        const key = empty orelse return;
+        if (shard.users.fetchRemove(key)) |kv| {
+            var list = kv.value;
+            list.deinit(std.heap.c_allocator);
+            std.heap.c_allocator.free(kv.key);
+        }
+    }
+}
+
+/// Pings every open stream forever so dead clients are noticed and their
+/// sockets closed. Runs on its own thread.
+pub fn heartbeat(io: std.Io) void {
+    while (true) {
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(heartbeat_seconds * 1000), std.Io.Clock.awake) catch {};
+        var batch: std.ArrayList(*Subscriber) = .empty;
+        defer batch.deinit(std.heap.c_allocator);
+        for (&shards) |*shard| {
+            batch.clearRetainingCapacity();
+            {
+                shard.lock.lock(io) catch continue;
+                defer shard.lock.unlock(io);
+                var it = shard.users.valueIterator();
+                while (it.next()) |list| {
+                    for (list.items) |sub| {
+                        batch.append(std.heap.c_allocator, sub) catch break;
+                        sub.acquire();
+                    }
+                }
+            }
+            var any_dead = false;
+            for (batch.items) |sub| {
+                if (!sub.send(io, ": ping\n\n")) any_dead = true;
+                sub.release(io);
+            }
+            if (any_dead) prune(io, shard, null);
+        }
+    }
+}
@@ -1,27 +1,81 @@
 const std = @import("std");
 const auth = @import("auth.zig");
 const sql = @import("sql.zig");
+const task_stream = @import("task_stream.zig");
+const changes = @import("changes.zig");
+const list_cache = @import("list_cache.zig");
 
-// CREATE TABLE IF NOT EXISTS task_queue (
-//     id INTEGER PRIMARY KEY AUTOINCREMENT,
-//     task TEXT NOT NULL,
-//     step INTEGER DEFAULT 0,
-//     token TEXT NOT NULL, -- used for other services to be able to make updates to a specific task
-//     user_email TEXT NOT NULL,
-//     status TEXT NOT NULL DEFAULT 'ready' CHECK (status IN ('ready', 'stopped', 'running', 'complete', 'error')),
-//     is_complete INTEGER DEFAULT 0,
-//     meta_data TEXT NOT NULL CHECK (json_valid(meta_data)),
-//     created_at DATETIME DEFAULT (datetime('now', 'utc')),
-//     updated_at DATETIME DEFAULT (datetime('now', 'utc'))
-// );
-pub fn createTask(allocator: std.mem.Allocator, task: []const u8, reference:[]const u8, email: []const u8, meta: anytype) ![]const u8 {
+// task_queue is defined in migration.sql. sk and pk are generated from the
+// request body in meta_data, and updated_at is set by the UPDATEs below.
+// Every write returns the task's new state and pushes it to the owner's
+// open task streams.
+
+/// task state as pushed to task streams, columns in `task_columns` order
+pub const TaskEvent = struct {
+    user_email: []const u8,
+    task: []const u8,
+    reference: ?[]const u8,
+    status: []const u8,
+    step: i64,
+    is_complete: bool,
+    sk: ?[]const u8,
+    pk: ?[]const u8,
+};
+const task_columns = "user_email, task, reference, status, step, is_complete, sk, pk";
+const returning = " RETURNING " ++ task_columns;
+
+/// Writes `ev` as an SSE `task` event. The fields match the status polls.
+pub fn writeTaskEvent(allocator: std.mem.Allocator, w: *std.Io.Writer, ev: TaskEvent) !void {
+    const data = try std.json.Stringify.valueAlloc(allocator, .{
+        .task = ev.task,
+        .reference = ev.reference,
+        .status = ev.status,
+        .step = ev.step,
+        .steps = 5,
+        .isComplete = ev.is_complete,
+        .sk = ev.sk,
+        .pk = ev.pk,
+    }, .{});
+    defer allocator.free(data);
+    try task_stream.writeEvent(w, "task", data);
+}
+
+/// Runs a task write and pushes the row it returns. The statement is done
+/// before anything is sent, so a slow client never holds the write lock.
+fn writeAndPublish(io: std.Io, allocator: std.mem.Allocator, comptime statement: []const u8, args: anytype) !void {
+    const ev = (try sql.one(TaskEvent, allocator, statement ++ returning, args)) orelse return;
+    var out: std.Io.Writer.Allocating = .init(allocator);
+    defer out.deinit();
+    writeTaskEvent(allocator, &out.writer, ev) catch return;
+    task_stream.publish(io, ev.user_email, out.written());
+    // a finished grading run has rewritten its submission, patch it into
+    // the owner's cached list and change log; whoever started the grading
+    // may be a teacher it is shared with
+    if (ev.is_complete and std.mem.eql(u8, ev.task, "grade_submission")) {
+        const pk = ev.pk orelse return;
+        const sk = ev.sk orelse return;
+        const item = list_cache.refreshSubmission(allocator, pk, sk) orelse return;
+        const owner = list_cache.stringField(item, "OWNER") orelse return;
+        changes.record(allocator, owner, pk, sk, false);
+    }
+}
+
+/// Writes the `email`'s unfinished tasks from the last few minutes as
+/// events, the state a new task stream starts from.
+pub fn writeActiveTasks(allocator: std.mem.Allocator, w: *std.Io.Writer, email: []const u8) !void {
+    var rows = try sql.query(allocator, "SELECT " ++ task_columns ++ " FROM task_queue WHERE user_email = ? AND is_complete = 0 AND updated_at >= datetime('now', '-5 minutes', 'utc')", .{email});
+    defer rows.deinit();
+    while (try rows.next()) |row| try writeTaskEvent(allocator, w, row.decode(TaskEvent));
+}
+
+pub fn createTask(io: std.Io, allocator: std.mem.Allocator, task: []const u8, reference:[]const u8, email: []const u8, meta: anytype) ![]const u8 {
     const token = auth.generateSecureToken() catch |err| {
         std.log.err("generateSecureToken failed: {}\n", .{err});
         return err;
     };
     std.log.info("token {s}\n", .{token});
 
-    sql.exec(allocator, "INSERT INTO task_queue (task, reference, token, user_email, meta_data) VALUES (?, ?, ?, ?, ?)", .{ task, reference, token, email, meta }) catch |err| {
+    writeAndPublish(io, allocator, "INSERT INTO task_queue (task, reference, token, user_email, meta_data) VALUES (?, ?, ?, ?, ?)", .{ task, reference, token, email, meta }) catch |err| {
         std.log.err("task insert failed: {}\n", .{err});
         return err;
     };
@@ -32,7 +86,7 @@ pub fn getTask(allocator: std.mem.Allocator, token: []const u8, email: []const u
     return sql.getOne(allocator, "SELECT * FROM task_queue WHERE token = ? AND user_email = ?", .{ token, email });
 }
 
-pub fn updateTask(allocator: std.mem.Allocator, token: []const u8, status: []const u8, step: usize, is_complete: bool, meta: anytype) !void {
+pub fn updateTask(io: std.Io, allocator: std.mem.Allocator, token: []const u8, status: []const u8, step: usize, is_complete: bool, meta: anytype) !void {
     const has_meta = switch (@typeInfo(@TypeOf(meta))) {
         .null => false,
         .optional => meta != null,
@@ -41,15 +95,15 @@ pub fn updateTask(allocator: std.mem.Allocator, token: []const u8, status: []con
     if (has_meta) {
         const md = try std.json.Stringify.valueAlloc(allocator, meta, .{ .emit_null_optional_fields = false });
         defer allocator.free(md);
-        try sql.exec(allocator, "UPDATE task_queue SET status = ?, step = ?, is_complete = ?, meta_data = ? WHERE token = ?", .{ status, step, is_complete, md, token });
+        try writeAndPublish(io, allocator, "UPDATE task_queue SET status = ?, step = ?, is_complete = ?, meta_data = ?, updated_at = datetime('now', 'utc') WHERE token = ?", .{ status, step, is_complete, md, token });
     } else {
-        try sql.exec(allocator, "UPDATE task_queue SET status = ?, step = ?, is_complete = ? WHERE token = ?", .{ status, step, is_complete, token });
+        try writeAndPublish(io, allocator, "UPDATE task_queue SET status = ?, step = ?, is_complete = ?, updated_at = datetime('now', 'utc') WHERE token = ?", .{ status, step, is_complete, token });
     }
 }
 
 
 
-pub fn markError(allocator: std.mem.Allocator, token: []const u8, meta: anytype) !void {
+pub fn markError(io: std.Io, allocator: std.mem.Allocator, token: []const u8, meta: anytype) !void {
     const has_meta = switch (@typeInfo(@TypeOf(meta))) {
         .null => false,
         .optional => meta != null,
@@ -58,8 +112,53 @@ pub fn markError(allocator: std.mem.Allocator, token: []const u8, meta: anytype)
     if (has_meta) {
         const md = try std.json.Stringify.valueAlloc(allocator, meta, .{ .emit_null_optional_fields = false });
         defer allocator.free(md);
-        try sql.exec(allocator, "UPDATE task_queue SET status = 'error', meta_data = ? WHERE token = ?", .{md, token });
+        try writeAndPublish(io, allocator, "UPDATE task_queue SET status = 'error', meta_data = ?, updated_at = datetime('now', 'utc') WHERE token = ?", .{md, token });
     } else {
-        try sql.exec(allocator, "UPDATE task_queue SET status = 'error' WHERE token = ?", .{token });
+        try writeAndPublish(io, allocator, "UPDATE task_queue SET status = 'error', updated_at = datetime('now', 'utc') WHERE token = ?", .{token });
     }
 }
+
+/// rows moved per transaction, so the write lock is held only briefly
+const archive_batch = 500;
+const archive_interval_seconds = 60 * 60;
+/// finished tasks stay in the live table a day for status pages; tasks left
+/// unfinished for a week are assumed abandoned
+const archive_where = "((is_complete = 1 OR status = 'error') AND updated_at < datetime('now', '-1 day', 'utc')) OR updated_at < datetime('now', '-7 days', 'utc')";
+const archive_ids = std.fmt.comptimePrint("SELECT id FROM task_queue WHERE {s} ORDER BY id LIMIT {d}", .{ archive_where, archive_batch });
+
+/// Moves old tasks into task_queue_archive forever, keeping task_queue and its
+/// indexes small. Runs on its own thread and connection.
+pub fn archiveFinished(io: std.Io) void {
+    while (true) {
+        var moved: usize = 0;
+        while (true) {
+            const n = archiveBatch() catch |err| {
+                std.log.err("task archive failed: {}\n", .{err});
+                break;
+            };
+            moved += n;
+            if (n < archive_batch) break;
+            std.Io.sleep(io, std.Io.Duration.fromMilliseconds(10), std.Io.Clock.awake) catch {};
+        }
+        if (moved > 0) std.log.info("archived {d} tasks\n", .{moved});
+        std.Io.sleep(io, std.Io.Duration.fromMilliseconds(archive_interval_seconds * 1000), std.Io.Clock.awake) catch {};
+    }
+}
+
+fn archiveBatch() !usize {
+    const allocator = std.heap.c_allocator;
+    try sql.exec(allocator, "CREATE TEMP TABLE IF NOT EXISTS archive_batch_ids (id INTEGER PRIMARY KEY)", .{});
+    try sql.exec(allocator, "BEGIN IMMEDIATE", .{});
+    errdefer sql.exec(allocator, "ROLLBACK", .{}) catch {};
+    // the batch is picked once: archive_where reads the clock, so running it
+    // again for the DELETE could match rows the INSERT never copied
+    try sql.exec(allocator, "DELETE FROM archive_batch_ids", .{});
+    try sql.exec(allocator, "INSERT INTO archive_batch_ids (id) " ++ archive_ids, .{});
+    // OR REPLACE so rows left behind by an interrupted batch move on retry
+    try sql.exec(allocator, "INSERT OR REPLACE INTO task_queue_archive (id, task, step, reference, token, user_email, status, is_complete, meta_data, sk, pk, created_at, updated_at) " ++
+        "SELECT id, task, step, reference, token, user_email, status, is_complete, meta_data, sk, pk, created_at, updated_at FROM task_queue WHERE id IN (SELECT id FROM archive_batch_ids)", .{});
+    try sql.exec(allocator, "DELETE FROM task_queue WHERE id IN (SELECT id FROM archive_batch_ids)", .{});
+    const n = sql.changes();
+    try sql.exec(allocator, "COMMIT", .{});
+    return n;
+}
@@ -6,6 +6,7 @@ const Callback = server.Callback;
 const dynamo = @import("dynamo.zig");
 const auth = @import("auth.zig");
 const sql = @import("sql.zig");
+const list_cache = @import("list_cache.zig");
 
 /// Builds a JSON array from pre-serialised JSON object strings.
 /// Returns a slice of exactly the right length — no trailing garbage bytes.
@@ -48,40 +49,11 @@ pub fn checkAssignmentAccess(allocator: std.mem.Allocator, user_email: []const u
 
     if (class_id.len == 0 or assignment_id.len == 0) return false;
 
-    const cache_key = try std.fmt.allocPrint(allocator, "{s}#{s}", .{ class_id, assignment_id });
-
-    const cached = sql.getAll(allocator, "SELECT data FROM fetch_cache WHERE data_type = 'assignment' AND name = ? AND updated_at > datetime('now', '-5 minutes') LIMIT 1", .{cache_key}) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            const assignment = std.json.parseFromSliceLeaky(AssignmentAccess, allocator, data, .{ .ignore_unknown_fields = true }) catch return false;
-            if (std.mem.eql(u8, user_email, assignment.OWNER)) return true;
-            for (assignment.sharedWith) |sw| {
-                if (std.mem.eql(u8, user_email, sw)) return true;
-            }
-            return false;
-        }
-    }
-
-    const cpx = try std.heap.c_allocator.dupeZ(u8, "ASSIGNMENT");
-    defer std.heap.c_allocator.free(cpx);
-    const cpk = try std.heap.c_allocator.dupeZ(u8, class_id);
-    defer std.heap.c_allocator.free(cpk);
-    const csk = try std.heap.c_allocator.dupeZ(u8, assignment_id);
-    defer std.heap.c_allocator.free(csk);
-
-    const result = dynamo.c.get_item_pk_sk(cpx, cpk, csk) orelse {
+    // served from the shared item cache when the assignment was read recently
+    const assignment = (try dynamo.getItemPkSkProj(AssignmentAccess, allocator, "ASSIGNMENT", class_id, assignment_id, "#o, sharedWith", "\"#o\":\"OWNER\"")) orelse {
         server.debugPrint("no assignment found anyone can write \n", .{});
         return true;
     };
-    defer std.c.free(result);
-    const slice = std.mem.span(result);
-
-    sql.exec(allocator, "INSERT OR REPLACE INTO fetch_cache (data_type, user_email, name, data) VALUES ('assignment', ?, ?, ?)", .{ cache_key, cache_key, slice }) catch |err| {
-        std.debug.print("assignment cache write failed: {}\n", .{err});
-    };
-
-    const assignment = std.json.parseFromSliceLeaky(AssignmentAccess, allocator, slice, .{ .ignore_unknown_fields = true }) catch return false;
     if (std.mem.eql(u8, user_email, assignment.OWNER)) return true;
     for (assignment.sharedWith) |sw| {
         if (std.mem.eql(u8, user_email, sw)) return true;
@@ -89,32 +61,19 @@ pub fn checkAssignmentAccess(allocator: std.mem.Allocator, user_email: []const u
     return false;
 }
 
-pub fn isItemNew(allocator: std.mem.Allocator, user_email: []const u8, cache_type: []const u8, pk: []const u8, sk: []const u8) !bool {
+pub fn isItemNew(allocator: std.mem.Allocator, user_email: []const u8, list: list_cache.List, pk: []const u8, sk: []const u8) !bool {
+    const cache_type = @tagName(list);
 
     // 1. Check item cache (ignore staleness)
-    const cached = sql.getAll(allocator, "SELECT data FROM fetch_cache WHERE data_type = '?' AND name = ? LIMIT 1", .{ cache_type, user_email }) catch null;
-    if (cached) |rows| {
-        if (rows.len > 0 and rows[0].len > 11) {
-            const data = rows[0][9 .. rows[0].len - 2];
-            if (std.mem.containsAtLeast(u8, data, 1, sk)) {
-                std.debug.print("{s} {s} found in cache, is existing\n", .{ cache_type, sk });
-                return false;
-            }
-        }
+    if (list_cache.contains(allocator, user_email, list, sk) catch false) {
+        std.debug.print("{s} {s} found in cache, is existing\n", .{ cache_type, sk });
+        return false;
     }
 
     // 2. Not in cache — check DynamoDB
     const pk_stem = if (std.mem.indexOf(u8, pk, "#")) |idx| pk[idx + 1 ..] else pk;
     const sk_stem = if (std.mem.indexOf(u8, sk, "#")) |idx| sk[idx + 1 ..] else sk;
-    const cpx = try std.heap.c_allocator.dupeZ(u8, "SUBMISSION");
-    defer std.heap.c_allocator.free(cpx);
-    const cpk = try std.heap.c_allocator.dupeZ(u8, pk_stem);
-    defer std.heap.c_allocator.free(cpk);
-    const csk = try std.heap.c_allocator.dupeZ(u8, sk_stem);
-    defer std.heap.c_allocator.free(csk);
-    const result = dynamo.c.get_item_pk_sk(cpx, cpk, csk);
-    if (result != null) {
-        std.c.free(result);
+    if (try dynamo.itemExists(allocator, "SUBMISSION", pk_stem, sk_stem)) {
         std.debug.print("{s} {s} found in dynamo, is existing\n", .{ cache_type, sk });
         return false;
     }